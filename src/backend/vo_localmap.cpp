@@ -47,7 +47,7 @@ static int64_t edge_id;
 namespace flvis_ns
 {
 
-std::deque<KeyFrameStruct> kfs;
+std::deque<KeyFrameView> kfs;//borrowed views, the window holds the messages
 PoseLMBag* bag;
 
 enum LMOPTIMIZER_STATE{
@@ -87,19 +87,8 @@ private:
             cout << "reset the local map" << endl;
             return;
         }
-        KeyFrameStruct kf;
-        ros::Time tt;
-        KeyFrameMsg::unpack(msg,
-                            kf.frame_id,
-                            kf.img,
-                            kf.d_img,
-                            kf.lm_count,
-                            kf.lm_id,
-                            kf.lm_2d,
-                            kf.lm_3d,
-                            kf.lm_descriptor,
-                            kf.T_c_w,
-                            tt);
+        KeyFrameView kf;
+        KeyFrameMsg::view(msg,kf);
 
 
         kfs.push_back(kf);
@@ -127,8 +116,8 @@ private:
                         //cout << "lm_cout " << kfs.at(f_idx).lm_count << " " << kfs.at(f_idx).lm_3d.size() << endl;
                         for(int lm_idx=0; lm_idx < kfs.at(f_idx).lm_count; lm_idx++)//add landmarks
                         {
-                            bag->addLMObservation(kfs.at(f_idx).lm_id.at(lm_idx),
-                                                  kfs.at(f_idx).lm_3d.at(lm_idx));
+                            bag->addLMObservation(kfs.at(f_idx).lmId(lm_idx),
+                                                  kfs.at(f_idx).lm3d(lm_idx));
                         }
                     }
                     cout << "LocalMap: Initialize Optimizer*****" << endl;
@@ -186,10 +175,10 @@ private:
                             edge->cy = cy;
                             edge->setId(edge_id);
                             edge_id++;
-                            int64_t lm_vertex_idx = kfs.at(f_idx).lm_id.at(lm_idx);
+                            int64_t lm_vertex_idx = kfs.at(f_idx).lmId(lm_idx);
                             edge->setVertex(0,dynamic_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex(  lm_vertex_idx)));
                             edge->setVertex(1,dynamic_cast<g2o::VertexSE3Expmap*>  (optimizer.vertex(pose_vertex_idx)));
-                            edge->setMeasurement(kfs.at(f_idx).lm_2d.at(lm_idx));
+                            edge->setMeasurement(kfs.at(f_idx).lm2d(lm_idx));
                             edge->setInformation(Eigen::Matrix2d::Identity() );
                             edge->setParameterId(0,0);
                             edge->setRobustKernel(new g2o::RobustKernelHuber());
@@ -214,8 +203,9 @@ private:
                 //STEP2: Add new Frame, LM and Observation;
 
                 optimizer.removeVertex(dynamic_cast<g2o::VertexSE3Expmap*>(optimizer.vertex(bag->getOldestPoseInOptimizerIdx())));
-                for(auto id:kfs.at(0).lm_id)
+                for(int i=0; i < kfs.at(0).lm_count; i++)
                 {
+                    int64_t id = kfs.at(0).lmId(i);
                     if(bag->removeLMObservation(id))
                     {
                         optimizer.removeVertex(dynamic_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex(id)));
@@ -232,12 +222,12 @@ private:
                 optimizer.vertex(bag->getOldestPoseInOptimizerIdx())->setFixed(true);
                 for(int i=0; i < kfs.back().lm_count; i++)
                 {
-                    if(bag->addLMObservationSlidingWindow(kfs.back().lm_id.at(i),
-                                                          kfs.back().lm_3d.at(i)))
+                    if(bag->addLMObservationSlidingWindow(kfs.back().lmId(i),
+                                                          kfs.back().lm3d(i)))
                     {
                         g2o::VertexSBAPointXYZ* v_lm = new g2o::VertexSBAPointXYZ();
-                        v_lm->setId (kfs.back().lm_id.at(i));
-                        v_lm->setEstimate (kfs.back().lm_3d.at(i));
+                        v_lm->setId (kfs.back().lmId(i));
+                        v_lm->setEstimate (kfs.back().lm3d(i));
                         v_lm->setMarginalized ( true );
                         optimizer.addVertex (v_lm);
                     }
@@ -258,12 +248,12 @@ private:
                     edge->cy = cy;
                     edge->setId(edge_id);
                     edge_id++;
-                    int64_t lm_vertex_idx = kfs.back().lm_id.at(i);
+                    int64_t lm_vertex_idx = kfs.back().lmId(i);
                     edge->setVertex(0,dynamic_cast<g2o::VertexSBAPointXYZ*>
                                     (optimizer.vertex(  lm_vertex_idx)));
                     edge->setVertex(1,dynamic_cast<g2o::VertexSE3Expmap*>
                                     (optimizer.vertex(bag->getNewestPoseInOptimizerIdx())));
-                    edge->setMeasurement(kfs.back().lm_2d.at(i));
+                    edge->setMeasurement(kfs.back().lm2d(i));
                     edge->setInformation(Eigen::Matrix2d::Identity() );
                     edge->setParameterId(0,0);
                     edge->setRobustKernel(new g2o::RobustKernelHuber());
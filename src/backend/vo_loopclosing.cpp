@@ -102,6 +102,7 @@ struct KeyFrameLC
   int             lm_count;
   vector<Vec2>    lm_2d;
   vector<double>  lm_d;
+  vector<Vec3>    lm_3d_c;//landmarks of the frontend in this camera frame, empty: use lm_d
   vector<cv::Mat>     lm_descriptor;
   BowVector       kf_bv;
   SE3             T_c_w_odom;
@@ -384,12 +385,19 @@ private:
                   {
                     common_pt++;
                     // save data for optimization
-                    //Vector3d P = kf0->lm_3d[lr_qdx];
-                    double d = kf0->lm_d[lr_qdx];
-                    Vector2d pl_map = kf0->lm_2d[lr_qdx];
-                    double x = (pl_map(0)-cx)/fx*d;
-                    double y = (pl_map(1)-cy)/fy*d;
-                    Vector3d P0(x,y,d);
+                    Vector3d P0;
+                    if(!kf0->lm_3d_c.empty())
+                    {
+                        P0 = kf0->lm_3d_c[lr_qdx];
+                    }
+                    else
+                    {
+                        double d = kf0->lm_d[lr_qdx];
+                        Vector2d pl_map = kf0->lm_2d[lr_qdx];
+                        double x = (pl_map(0)-cx)/fx*d;
+                        double y = (pl_map(1)-cy)/fy*d;
+                        P0 = Vector3d(x,y,d);
+                    }
                     Vector3f P = P0.cast<float>();
                     Vector2f pl_obs = kf1->lm_2d[lr_tdx].cast<float>();
                     cv::Point3f p3(P(0),P(1),P(2));
@@ -638,16 +646,14 @@ private:
         BowVector kf_bv;
         SE3 loop_pose;
 
-        cv::Mat img_unpack, d_img_unpack;
-        vector<int64_t> lm_id_unpack;
-        vector<Vec3> lm_3d_unpack;
-        vector<Vec2> lm_2d_unpack;
-        vector<cv::Mat>     lm_descriptor_unpack;
-        int lm_count_unpack;
-        
-        
-        KeyFrameMsg::unpack(msg,kf.frame_id,img_unpack,d_img_unpack,lm_count_unpack,
-                            lm_id_unpack,lm_2d_unpack,lm_3d_unpack,lm_descriptor_unpack,kf.T_c_w_odom,kf.t);
+        //borrowed, img_unpack/d_img_unpack share the message buffers (read only)
+        KeyFrameView kf_view;
+        KeyFrameMsg::view(msg,kf_view);
+        kf.frame_id   = kf_view.frame_id;
+        kf.T_c_w_odom = kf_view.T_c_w;
+        kf.t          = kf_view.stamp;
+        const cv::Mat& img_unpack   = kf_view.img;
+        const cv::Mat& d_img_unpack = kf_view.d_img;
         if(kf.frame_id < 40)
           return;
 
@@ -677,46 +683,67 @@ private:
         tic_toc_ros feature_tt;
 
 
-        vector<cv::KeyPoint> ORBFeatures;
-        vector<cv::Point2f>  kps;
-        cv::Mat ORBDescriptorsL;
-        vector<cv::Mat> ORBDescriptors;
+        if(kf_view.lm_desc!=NULL)
+        {
+          //descriptors of the frontend landmarks: no extraction, the 3D points come with them
+          cv::Mat lm_desc(kf_view.lm_count,LM_DESC_BYTES,CV_8UC1,const_cast<uint8_t*>(kf_view.lm_desc));
+          descriptors_to_vMat(lm_desc.clone(),kf.lm_descriptor);
+          kf.lm_2d.reserve(static_cast<size_t>(kf_view.lm_count));
+          kf.lm_d.reserve(static_cast<size_t>(kf_view.lm_count));
+          kf.lm_3d_c.reserve(static_cast<size_t>(kf_view.lm_count));
+          for(int i = 0; i<kf_view.lm_count; i++)
+          {
+            Vec3 p_c = kf.T_c_w_odom*kf_view.lm3d(i);
+            kf.lm_2d.push_back(kf_view.lm2d(i));
+            kf.lm_d.push_back(p_c[2]);
+            kf.lm_3d_c.push_back(p_c);
+          }
+          kf.lm_count = kf_view.lm_count;
+        }
+        else
+        {
+          //no descriptors in the message (older bags), extract ORB from the image
+          vector<cv::KeyPoint> ORBFeatures;
+          vector<cv::Point2f>  kps;
+          cv::Mat ORBDescriptorsL;
+          vector<cv::Mat> ORBDescriptors;
 
-        kps.clear();
-        ORBFeatures.clear();
-        ORBDescriptors.clear();
+          kps.clear();
+          ORBFeatures.clear();
+          ORBDescriptors.clear();
 
-        cv::Ptr<cv::ORB> orb = cv::ORB::create(500,1.2f,8,31,0,2, cv::ORB::HARRIS_SCORE,31,20);
-        orb->detectAndCompute(img_unpack,cv::Mat(),ORBFeatures,ORBDescriptorsL);
+          cv::Ptr<cv::ORB> orb = cv::ORB::create(500,1.2f,8,31,0,2, cv::ORB::HARRIS_SCORE,31,20);
+          orb->detectAndCompute(img_unpack,cv::Mat(),ORBFeatures,ORBDescriptorsL);
 
-        cv::KeyPoint::convert(ORBFeatures,kps);
-        descriptors_to_vMat(ORBDescriptorsL,ORBDescriptors);
+          cv::KeyPoint::convert(ORBFeatures,kps);
+          descriptors_to_vMat(ORBDescriptorsL,ORBDescriptors);
 
 
 
-        kf.lm_descriptor = ORBDescriptors;
+          kf.lm_descriptor = ORBDescriptors;
 
-       //cout<<"descriptor numbers: "<<ORBDescriptors.size()<<endl;
-       // cout<<"feature cost: ";feature_tt.toc();
+         //cout<<"descriptor numbers: "<<ORBDescriptors.size()<<endl;
+         // cout<<"feature cost: ";feature_tt.toc();
 
 
-        //pass feature and descriptor
-        vector<Vec2> lm_2d;
-        vector<double> lm_d;
-        for(size_t i = 0; i<ORBFeatures.size();i++)
-        {
-          cv::Point2f cvtmp = ORBFeatures[i].pt;
-          Vec2 tmp(cvtmp.x,cvtmp.y);
-          double d = (d_img_unpack.at<ushort>(cvtmp))/1000;
-          lm_2d.push_back(tmp);
-          lm_d.push_back(d);
+          //pass feature and descriptor
+          vector<Vec2> lm_2d;
+          vector<double> lm_d;
+          for(size_t i = 0; i<ORBFeatures.size();i++)
+          {
+            cv::Point2f cvtmp = ORBFeatures[i].pt;
+            Vec2 tmp(cvtmp.x,cvtmp.y);
+            double d = (d_img_unpack.at<ushort>(cvtmp))/1000;
+            lm_2d.push_back(tmp);
+            lm_d.push_back(d);
+          }
+          kf.lm_2d = lm_2d;
+          kf.lm_d = lm_d;
+          kf.lm_count = static_cast<int>(lm_2d.size());
+         // cout<<"pass feature number: "<<kf.lm_count;
+          lm_2d.clear();
+          lm_d.clear();
         }
-        kf.lm_2d = lm_2d;
-        kf.lm_d = lm_d;
-        kf.lm_count = static_cast<int>(lm_2d.size());
-       // cout<<"pass feature number: "<<kf.lm_count;
-        lm_2d.clear();
-        lm_d.clear();
 
 
 
@@ -872,8 +899,9 @@ private:
 
         path_lc_pub  = new RVIZPath(nh,"/vision_path_lc_all","map");
 
+        //appearance topic: images of the keyframes, the tracker only builds it while subscribed
         sub_kf = nh.subscribe<flvis::KeyFrame>(
-                    "/vo_kf",
+                    string("/vo_kf")+KFMSG_APPEARANCE_SUFFIX,
                     10,
                     boost::bind(&LoopClosingNodeletClass::frame_callback, this, _1));
 
@@ -1,4 +1,5 @@
 #include <include/camera_frame.h>
+#include <include/task_pool.h>
 
 CameraFrame::CameraFrame()
 {
@@ -11,48 +12,70 @@ void CameraFrame::clear()
     img0.release();
     img1.release();
     d_img.release();
+    img_holder[0].reset();
+    img_holder[1].reset();
+    img0_pyr.clear();
     landmarks.clear();
 }
 
+const vector<cv::Mat>& CameraFrame::getImg0Pyr(void)
+{
+    if(img0_pyr.empty() && !img0.empty())
+    {
+        cv::buildOpticalFlowPyramid(img0, img0_pyr,
+                                    cv::Size(PYR_WIN_SIZE,PYR_WIN_SIZE),
+                                    PYR_MAX_LEVEL_IMG0, true);
+    }
+    return img0_pyr;
+}
 
-void CameraFrame::eraseReprjOutlier()
+cv::Mat CameraFrame::getImg0Grad(void)
 {
-    for(int i=this->landmarks.size()-1; i>=0; i--)
+    const vector<cv::Mat>& pyr = getImg0Pyr();
+    if(pyr.size()<2)
     {
-        LandMarkInFrame lm=landmarks.at(i);
-        if(lm.is_tracking_inlier==false)
-        {
-            landmarks.erase(landmarks.begin()+i);
-        }
+        return cv::Mat();
     }
+    return pyr.at(1);
+}
+
+
+void CameraFrame::eraseReprjOutlier()
+{
+    landmarks.keep(landmarks.is_tracking_inlier);
 }
 
 void CameraFrame::calReprjInlierOutlier(double &mean_prjerr, vector<Vec2> &outlier, double sh_over_med)
 {
-    vector<double> distances;
-    vector<double> valid_distances;
-    for(int i=this->landmarks.size()-1; i>=0; i--)
-    {
-        LandMarkInFrame lm=landmarks.at(i);
-        if(lm.hasDepthInf())//has depth information
+    //relative reprojection error per landmark (0: no depth information)
+    int n = static_cast<int>(landmarks.size());
+    vector<double> distances(n,0);
+    TaskPool::instance().parallelFor(cv::Range(0,n),[&](const cv::Range& r){
+        for(int i=r.start; i<r.end; i++)
         {
-            Vec3 lm3d_w=lm.lm_3d_w;
-            Vec3 lm3d_c = DepthCamera::world2cameraT_c_w(lm3d_w,this->T_c_w);
-            Vec2 reProj=this->d_camera.camera2pixel(lm3d_c);
-            Vec2 lm2d = lm.lm_2d;
-            Vec2 err=lm2d-reProj;
-            double relativeDist = err.norm()/lm3d_c.norm();
-            //double relativeDist = sqrt(pow(lm2d(0)-reProj(0),2)+pow(lm2d(1)-reProj(1),2));
-            distances.push_back(relativeDist);
-            if(lm.is_tracking_inlier==true){
-                valid_distances.push_back(relativeDist);
+            if(landmarks.has_3d[i])//has depth information
+            {
+                Vec3 lm3d_c = DepthCamera::world2cameraT_c_w(landmarks.lm_3d_w[i],this->T_c_w);
+                Vec2 reProj=this->d_camera.camera2pixel(lm3d_c);
+                Vec2 err=landmarks.lm_2d[i]-reProj;
+                distances[i] = err.norm()/lm3d_c.norm();
             }
         }
-        else//no depth information
+    },std::max(1.0,n/128.0));
+    vector<double> valid_distances;
+    valid_distances.reserve(n);
+    for(int i=0; i<n; i++)
+    {
+        if(landmarks.has_3d[i] && landmarks.is_tracking_inlier[i])
         {
-            distances.push_back(0);
+            valid_distances.push_back(distances[i]);
         }
     }
+    if(valid_distances.empty())
+    {
+        mean_prjerr = 0;
+        return;
+    }
 
     //mean SH
     double sum=0;
@@ -71,116 +94,122 @@ void CameraFrame::calReprjInlierOutlier(double &mean_prjerr, vector<Vec2> &outli
     //cout << "MAD SH=" << sh << endl;
     if(sh>=5.0) sh=5.0;
     if(sh<=3.0) sh=3.0;
-    for(int i=this->landmarks.size()-1; i>=0; i--)
+    for(size_t i=0; i<landmarks.size(); i++)
     {
         if(distances.at(i)>sh)
         {
-            outlier.push_back(this->landmarks.at(i).lm_2d);
-            this->landmarks.at(i).is_tracking_inlier=false;
+            outlier.push_back(landmarks.lm_2d[i]);
+            landmarks.is_tracking_inlier[i]=false;
         }else
         {
-            this->landmarks.at(i).is_tracking_inlier=true;
+            landmarks.is_tracking_inlier[i]=true;
         }
     }
 
 }
 
-void CameraFrame::recover3DPts_c_FromStereo(vector<Vec3> &pt3ds,
-                                            vector<bool> &maskHas3DInf)
+void CameraFrame::recover3DPts_c_FromStereo(const vector<unsigned char>& to_measure,
+                                            vector<Vec3> &pt3ds,
+                                            vector<bool> &maskHas3DInf,
+                                            vector<double> &inv_depth_var)
 {
-    pt3ds.clear();
-    maskHas3DInf.clear();
+    size_t n = landmarks.size();
+    pt3ds.assign(n,Vec3(0,0,0));
+    maskHas3DInf.assign(n,false);
+    inv_depth_var.assign(n,0);
 
+    vector<int>  slots;
     vector<Vec2> pts2d_img0,pts2d_img1;
-    pts2d_img0 = this->get2dPtsVec();
-    vector<float>   err;
     vector<unsigned char> status;
-    vector<cv::Point2f> pts0 = vVec2_2_vcvP2f(pts2d_img0);
-    vector<cv::Point2f> pts1 = pts0;
-    for(int i=0; i<this->landmarks.size(); i++)
-    {   //reporject lm to cam1
-        if(landmarks.at(i).hasDepthInf()){
-            Vec3 lm3d_c = DepthCamera::world2cameraT_c_w(landmarks.at(i).lm_3d_w,
+    vector<double> disparity_prior;
+    slots.reserve(n);
+    pts2d_img0.reserve(n);
+    disparity_prior.reserve(n);
+    for(size_t i=0; i<n; i++)
+    {
+        if(!to_measure.at(i)) continue;
+        slots.push_back(static_cast<int>(i));
+        pts2d_img0.push_back(landmarks.lm_2d[i]);
+        double d_prior = -1.0;
+        if(landmarks.has_3d[i])
+        {   //reporject lm to cam1
+            Vec3 lm3d_c = DepthCamera::world2cameraT_c_w(landmarks.lm_3d_w[i],
                                                          this->d_camera.T_cam1_cam0*this->T_c_w);
             Vec2 reProj=this->d_camera.camera2pixel(lm3d_c,
                                                     this->d_camera.cam1_fx,
                                                     this->d_camera.cam1_fy,
                                                     this->d_camera.cam1_cx,
                                                     this->d_camera.cam1_cy);
-            pts1.at(i) = cv::Point2f(reProj[0],reProj[1]);
+            d_prior = landmarks.lm_2d[i][0]-reProj[0];
         }
+        disparity_prior.push_back(d_prior);
     }
-    cv::calcOpticalFlowPyrLK(this->img0, this->img1,
-                             pts0, pts1,
-                             status, err, cv::Size(31,31),10,
-                             cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, 30, 0.01),
-                             cv::OPTFLOW_USE_INITIAL_FLOW);
-    pts2d_img0.clear();
-    pts2d_img1.clear();
-    for(int i=0; i<status.size(); i++)
+    if(slots.empty()) return;
+    StereoMatcher matcher(this->d_camera.P0_,this->d_camera.P1_);
+    matcher.match(this->img0, this->img1,
+                  pts2d_img0, disparity_prior,
+                  pts2d_img1, status);
+
+    vector<Vec3> pts3d_c;
+    vector<unsigned char> has_depth;
+    Triangulation::trignaulationPtsFromStereo(pts2d_img0,pts2d_img1,
+                                              this->d_camera.P0_,
+                                              this->d_camera.P1_,
+                                              0,25,
+                                              pts3d_c,has_depth);
+    //inverse depth = (d-dcx)/fb
+    double fb = this->d_camera.P0_(0,3)-this->d_camera.P1_(0,3);
+    double stereo_var = pow(DEPTH_STEREO_DISPARITY_STD/fb,2);
+    for(size_t k=0; k<slots.size(); k++)
     {
-        pts2d_img0.push_back(Vec2(pts0.at(i).x,pts0.at(i).y));
-        pts2d_img1.push_back(Vec2(pts1.at(i).x,pts1.at(i).y));
-    }
-
-    for(size_t i=0; i<status.size(); i++)
-    {
-        if(status.at(i)==1)
+        int i = slots.at(k);
+        if(status.at(k)==STEREO_MATCH_OK)
         {
-            Vec3 pt3d_c;
-            if(Triangulation::trignaulationPtFromStereo(pts2d_img0.at(i),pts2d_img1.at(i),
-                                                        this->d_camera.P0_,
-                                                        this->d_camera.P1_,
-                                                        pt3d_c))
-            {
-                pt3ds.push_back(pt3d_c);
-                maskHas3DInf.push_back(true);
-                continue;
-            }
-            else
+            if(has_depth.at(k))
             {
-                pt3ds.push_back(Vec3(0,0,0));
-                maskHas3DInf.push_back(false);
-                continue;
+                pt3ds.at(i) = pts3d_c.at(k);
+                maskHas3DInf.at(i) = true;
+                inv_depth_var.at(i) = stereo_var;
             }
-
-
-        }else
+        }else if(status.at(k)==STEREO_MATCH_FAIL && !landmarks.has_3d[i])
         {
-            //stereo optical flow matching fail,
+            //stereo matching fail,
             //The point may too close to camera
             //use dummy depth writing technology
-            Vec3 pt3d_c;
+            //(STEREO_MATCH_FAR points are beyond max depth, they stay without depth)
             float d_rand;
             d_rand = 0.3 + static_cast<float>(rand())/(static_cast<float>(RAND_MAX/(0.4)));
-            pt3d_c = DepthCamera::pixel2camera(pts2d_img0.at(i),
-                                               this->d_camera.cam0_fx,
-                                               this->d_camera.cam0_fy,
-                                               this->d_camera.cam0_cx,
-                                               this->d_camera.cam0_cy,
-                                               d_rand);
-            pt3ds.push_back(pt3d_c);
-            maskHas3DInf.push_back(true);
-            continue;
+            pt3ds.at(i) = DepthCamera::pixel2camera(pts2d_img0.at(k),
+                                                    this->d_camera.cam0_fx,
+                                                    this->d_camera.cam0_fy,
+                                                    this->d_camera.cam0_cx,
+                                                    this->d_camera.cam0_cy,
+                                                    d_rand);
+            maskHas3DInf.at(i) = true;
+            inv_depth_var.at(i) = DEPTH_DUMMY_INV_DEPTH_STD*DEPTH_DUMMY_INV_DEPTH_STD;
         }
     }
 }
 
-void CameraFrame::recover3DPts_c_FromDepthImg(vector<Vec3>& pt3ds,
-                                              vector<bool>& maskHas3DInf)
+void CameraFrame::recover3DPts_c_FromDepthImg(const vector<unsigned char>& to_measure,
+                                              vector<Vec3>& pt3ds,
+                                              vector<bool>& maskHas3DInf,
+                                              vector<double>& inv_depth_var)
 {
-    pt3ds.clear();
-    maskHas3DInf.clear();
-    for(size_t i=0; i<landmarks.size(); i++)
+    size_t n = landmarks.size();
+    pt3ds.assign(n,Vec3(0,0,0));
+    maskHas3DInf.assign(n,false);
+    inv_depth_var.assign(n,0);
+    for(size_t i=0; i<n; i++)
     {
+        if(!to_measure.at(i)) continue;
         //use round to find the nearst pixel from depth image;
-        cv::Point2f pt=cv::Point2f(round(landmarks.at(i).lm_2d[0]),round(landmarks.at(i).lm_2d[1]));
+        cv::Point2f pt=cv::Point2f(round(landmarks.lm_2d[i][0]),round(landmarks.lm_2d[i][1]));
         Vec3 pt3d;
         //CV_16UC1 = Z16 16-Bit unsigned int
         if(isnan(d_img.at<ushort>(pt)))
         {
-            pt3ds.push_back(Vec3(0,0,0));
-            maskHas3DInf.push_back(false);
+            continue;
         }
         else
         {
@@ -190,12 +219,9 @@ void CameraFrame::recover3DPts_c_FromDepthImg(vector<Vec3>& pt3ds,
                 pt3d[2] = z;
                 pt3d[0] = (pt.x - d_camera.cam0_cx) * z / d_camera.cam0_fx;
                 pt3d[1] = (pt.y - d_camera.cam0_cy) * z / d_camera.cam0_fy;
-                pt3ds.push_back(pt3d);
-                maskHas3DInf.push_back(true);
-            }else
-            {
-                pt3ds.push_back(Vec3(0,0,0));
-                maskHas3DInf.push_back(false);
+                pt3ds.at(i) = pt3d;
+                maskHas3DInf.at(i) = true;
+                inv_depth_var.at(i) = DEPTH_IMG_INV_DEPTH_STD*DEPTH_IMG_INV_DEPTH_STD;
             }
         }
     }
@@ -203,98 +229,124 @@ void CameraFrame::recover3DPts_c_FromDepthImg(vector<Vec3>& pt3ds,
 
 void CameraFrame::recover3DPts_c_FromTriangulation(vector<Vec3> &pt3ds, vector<bool> &maskHas3DInf)
 {
-    pt3ds.clear();
-    maskHas3DInf.clear();
-    for(size_t i=0; i<landmarks.size(); i++)
+    size_t n = landmarks.size();
+    pt3ds.assign(n,Vec3(0,0,0));
+    maskHas3DInf.assign(n,false);
+    vector<Vec2> pts1,pts2;
+    vector<Vec3> pts3d_w;
+    vector<unsigned char> status;
+    //landmarks born in the same frame share lm_1st_obs_frame_pose and stay in one run,
+    //triangulate run by run
+    size_t begin = 0;
+    while(begin<n)
     {
-        SE3 T_c_w1=landmarks.at(i).lm_1st_obs_frame_pose;
+        const SE3& T_c_w1=landmarks.lm_1st_obs_frame_pose[begin];
+        size_t end = begin+1;
+        while(end<n && landmarks.lm_1st_obs_frame_pose[end].matrix()==T_c_w1.matrix()) end++;
         Vec3 baseline = T_c_w1.translation()-T_c_w.translation();
         if(baseline.norm()>=0.2)
         {
-            Vec3 pt3d_w = Triangulation::triangulationPt(landmarks.at(i).lm_1st_obs_2d,landmarks.at(i).lm_2d,
-                                                         landmarks.at(i).lm_1st_obs_frame_pose,T_c_w,
-                                                         d_camera.cam0_fx,
-                                                         d_camera.cam0_fy,
-                                                         d_camera.cam0_cx,
-                                                         d_camera.cam0_cy);
-            Vec3 pt3d_c = DepthCamera::world2cameraT_c_w(pt3d_w,T_c_w);
-            if(pt3d_c[2]>=0.5 && pt3d_c[2]<=15)
-            {
-                pt3ds.push_back(pt3d_c);
-                maskHas3DInf.push_back(true);
-            }
-            else
+            pts1.assign(landmarks.lm_1st_obs_2d.begin()+begin,landmarks.lm_1st_obs_2d.begin()+end);
+            pts2.assign(landmarks.lm_2d.begin()+begin,landmarks.lm_2d.begin()+end);
+            Triangulation::triangulationPts(pts1,pts2,
+                                            T_c_w1,T_c_w,
+                                            d_camera.cam0_fx,
+                                            d_camera.cam0_fy,
+                                            d_camera.cam0_cx,
+                                            d_camera.cam0_cy,
+                                            0.5,15,
+                                            pts3d_w,status);
+            for(size_t i=begin; i<end; i++)
             {
-                pt3ds.push_back(Vec3(0,0,0));
-                maskHas3DInf.push_back(false);
+                if(status.at(i-begin))
+                {
+                    pt3ds.at(i) = DepthCamera::world2cameraT_c_w(pts3d_w.at(i-begin),T_c_w);
+                    maskHas3DInf.at(i) = true;
+                }
             }
         }
-        else
-        {
-            pt3ds.push_back(Vec3(0,0,0));
-            maskHas3DInf.push_back(false);
-        }
+        begin = end;
     }
 }
+
 void CameraFrame::depthInnovation(void)
 {
-    vector<Vec3> pts3d_c_cam_measure;
-    vector<bool> cam_measure_mask;
-    //    vector<Vec3> pts3d_c_triangulation;
-    //    vector<bool> triangulation_mask;
-    //    this->recover3DPts_c_FromTriangulation(pts3d_c_triangulation,triangulation_mask);
+    size_t n = landmarks.size();
+    //STEP1: select the landmarks to be measured
+    vector<unsigned char> to_measure(n,1);
+    if(this->d_camera.cam_type==STEREO_EuRoC_MAV)
+    {
+        for(size_t i=0; i<n; i++)
+        {
+            if(landmarks.has_3d[i] && landmarks.depth_converged[i]
+                    && ((landmarks.lm_id[i]+frame_id)%DEPTH_REFRESH_PERIOD)!=0)
+            {
+                to_measure[i] = 0;
+            }
+        }
+    }
+    //STEP2: measure
+    vector<Vec3>   pts3d_c_cam_measure;
+    vector<bool>   cam_measure_mask;
+    vector<double> cam_measure_var;
     if(this->d_camera.cam_type==DEPTH_D435)
     {
-        this->recover3DPts_c_FromDepthImg(pts3d_c_cam_measure,cam_measure_mask);
+        this->recover3DPts_c_FromDepthImg(to_measure,pts3d_c_cam_measure,cam_measure_mask,cam_measure_var);
     }
     if(this->d_camera.cam_type==STEREO_EuRoC_MAV)
     {
-        this->recover3DPts_c_FromStereo(pts3d_c_cam_measure,cam_measure_mask);
+        this->recover3DPts_c_FromStereo(to_measure,pts3d_c_cam_measure,cam_measure_mask,cam_measure_var);
     }
-    for(size_t i=0; i<landmarks.size(); i++)
-    {
-        //        if(cam_measure_mask.at(i)==false && triangulation_mask.at(i)==false) continue;
-        //        Vec3 lm_c_measure;
-        //        if(cam_measure_mask.at(i)==true && triangulation_mask.at(i)==true)
-        //        {
-        //            lm_c_measure = 0.1*(pts3d_c_triangulation.at(i)+ 0.9*pts3d_c_cam_measure.at(i));
-        //        }else if(cam_measure_mask.at(i)==true && triangulation_mask.at(i)==false)
-        //        {
-        //            lm_c_measure = pts3d_c_cam_measure.at(i);
-        //        }else if(cam_measure_mask.at(i)==false && triangulation_mask.at(i)==true)
-        //        {
-        //            lm_c_measure = pts3d_c_triangulation.at(i);
-        //        }
-        if (cam_measure_mask.at(i)==false) continue;
-        Vec3 lm_c_measure = pts3d_c_cam_measure.at(i);
-        if(landmarks.at(i).hasDepthInf())
-        {
-            //transfor to Camera frame
-            Vec3 lm_c = DepthCamera::world2cameraT_c_w(landmarks.at(i).lm_3d_w,this->T_c_w);
-            //apply IIR Filter
-            Vec3 lm_c_update = lm_c*0.9+lm_c_measure*0.1;
-            //update to world frame
-            landmarks.at(i).lm_3d_c = lm_c_update;
-            landmarks.at(i).lm_3d_w = DepthCamera::camera2worldT_c_w(lm_c_update,this->T_c_w);
-        }
-        else//Do not have position
+    //STEP3: inverse depth fusion, landmarks are independent
+    TaskPool::instance().parallelFor(cv::Range(0,static_cast<int>(n)),[&](const cv::Range& r){
+        for(int i=r.start; i<r.end; i++)
         {
-            Vec3 pt3d_w = DepthCamera::camera2worldT_c_w(lm_c_measure,this->T_c_w);
-            landmarks.at(i).lm_3d_c = lm_c_measure;
-            landmarks.at(i).lm_3d_w = pt3d_w;
-            landmarks.at(i).has_3d = true;
+            Vec3 lm_c = DepthCamera::world2cameraT_c_w(landmarks.lm_3d_w[i],this->T_c_w);
+            if(landmarks.has_3d[i]) landmarks.lm_3d_c[i] = lm_c;//keep lm_3d_c in this frame
+            if (cam_measure_mask.at(i)==false) continue;
+            Vec3   lm_c_measure = pts3d_c_cam_measure.at(i);
+            double rho_m = 1.0/lm_c_measure[2];
+            double var_m = cam_measure_var.at(i);
+            if(landmarks.has_3d[i] && landmarks.inv_depth_var[i]>0 && lm_c[2]>0)
+            {
+                double rho_p = 1.0/lm_c[2];
+                double var_p = landmarks.inv_depth_var[i];
+                double innovation = rho_m-rho_p;
+                if(innovation*innovation > DEPTH_GATE_SIGMA*DEPTH_GATE_SIGMA*(var_p+var_m))
+                {   //inconsistent measurement, keep the state but stop trusting it
+                    landmarks.inv_depth_var[i] = var_p+var_m;
+                    landmarks.depth_converged[i] = false;
+                    continue;
+                }
+                double k = var_p/(var_p+var_m);
+                double rho = rho_p+k*innovation;
+                Vec3 lm_c_update = lm_c*(rho_p/rho);
+                landmarks.lm_3d_c[i] = lm_c_update;
+                landmarks.lm_3d_w[i] = DepthCamera::camera2worldT_c_w(lm_c_update,this->T_c_w);
+                landmarks.inv_depth_var[i] = (1.0-k)*var_p;
+            }
+            else//Do not have position
+            {
+                Vec3 pt3d_w = DepthCamera::camera2worldT_c_w(lm_c_measure,this->T_c_w);
+                landmarks.lm_3d_c[i] = lm_c_measure;
+                landmarks.lm_3d_w[i] = pt3d_w;
+                landmarks.has_3d[i] = true;
+                landmarks.inv_depth_var[i] = var_m;
+            }
+            double rho = 1.0/landmarks.lm_3d_c[i][2];
+            landmarks.depth_converged[i] = sqrt(landmarks.inv_depth_var[i]) < DEPTH_CONVERGED_RATIO*rho;
         }
-    }
+    },std::max(1.0,n/128.0));
 }
 
 void CameraFrame::correctLMP3DWByLMP3DCandT(void)
 {
-    SE3 T=this->T_c_w;
-    for(auto lm:landmarks)
+    const SE3& T=this->T_c_w;
+    for(size_t i=0; i<landmarks.size(); i++)
     {
-        if(lm.hasDepthInf())
+        if(landmarks.has_3d[i])
         {
-            lm.lm_3d_w = DepthCamera::camera2worldT_c_w(lm.lm_3d_c,T);
+            landmarks.lm_3d_w[i] = DepthCamera::camera2worldT_c_w(landmarks.lm_3d_c[i],T);
         }
     }
 }
@@ -304,14 +356,10 @@ void CameraFrame::forceCorrectLM3DW(const int &cnt, const vector<int64_t> &ids,
     if(cnt<=0) return;
     for(int i=0; i<cnt; i++)
     {
-        int correct_lm_id=ids.at(i);
-        for(size_t j=0; j<landmarks.size(); j++)
+        int slot = landmarks.find(ids.at(i));
+        if(slot>=0)
         {
-            if(landmarks.at(j).lm_id==correct_lm_id)
-            {
-                landmarks.at(j).lm_3d_w=lms_3d.at(i);
-                break;
-            }
+            landmarks.lm_3d_w[slot]=lms_3d.at(i);
         }
     }
 }
@@ -321,14 +369,10 @@ void CameraFrame::forceMarkOutlier(const int &cnt, const vector<int64_t> &ids)
     if(cnt<=0) return;
     for(int i=0; i<cnt; i++)
     {
-        int correct_lm_id=ids.at(i);
-        for(size_t j=0; j<landmarks.size(); j++)
+        int slot = landmarks.find(ids.at(i));
+        if(slot>=0)
         {
-            if(landmarks.at(j).lm_id==correct_lm_id)
-            {
-                //                cout <<"match!" << endl;
-                landmarks.at(j).is_tracking_inlier=false;
-            }
+            landmarks.is_tracking_inlier[slot]=false;
         }
     }
 }
@@ -336,14 +380,11 @@ void CameraFrame::forceMarkOutlier(const int &cnt, const vector<int64_t> &ids)
 int CameraFrame::validLMCount()
 {
     int ret=0;
-    if(landmarks.size()>0)
+    for(size_t i=0; i<landmarks.size(); i++)
     {
-        for(size_t i=0; i<landmarks.size(); i++)
+        if(landmarks.isValid(i))
         {
-            if(landmarks.at(i).hasDepthInf()&&(landmarks.at(i).is_tracking_inlier==true))
-            {
-                ret++;
-            }
+            ret++;
         }
     }
     return ret;
@@ -355,11 +396,12 @@ void CameraFrame::getValid2d3dPair_cvPf(vector<cv::Point2f> &p2d, vector<cv::Poi
     p3d.clear();
     for(size_t i=0; i<landmarks.size(); i++)
     {
-        LandMarkInFrame lm=landmarks.at(i);
-        if(lm.hasDepthInf() && lm.is_tracking_inlier==true)
+        if(landmarks.isValid(i))
         {
-            p2d.push_back(cv::Point2f(lm.lm_2d[0],lm.lm_2d[1]));
-            p3d.push_back(cv::Point3f(lm.lm_3d_w[0],lm.lm_3d_w[1],lm.lm_3d_w[2]));
+            const Vec2& lm_2d = landmarks.lm_2d[i];
+            const Vec3& lm_3d_w = landmarks.lm_3d_w[i];
+            p2d.push_back(cv::Point2f(lm_2d[0],lm_2d[1]));
+            p3d.push_back(cv::Point3f(lm_3d_w[0],lm_3d_w[1],lm_3d_w[2]));
         }
     }
 }
@@ -369,11 +411,10 @@ void CameraFrame::updateLMState(vector<uchar> status)
     int indexLM = 0;
     for(size_t i=0; i<landmarks.size(); i++)
     {
-        LandMarkInFrame lm=landmarks.at(i);
-        if(lm.hasDepthInf() && lm.is_tracking_inlier==true)
+        if(landmarks.isValid(i))
         {
             if(status[indexLM] == 0)
-                landmarks[i].is_tracking_inlier = false;
+                landmarks.is_tracking_inlier[i] = false;
             indexLM += 1;
         }
     }
@@ -381,38 +422,10 @@ void CameraFrame::updateLMState(vector<uchar> status)
     //cout<<status.size()<<" compare "<<indexLM<<endl;
 
 }
-void CameraFrame::getValidInliersPair(vector<LandMarkInFrame> &lms)
-{
-    lms.clear();
-    for(size_t i=0; i<landmarks.size(); i++)
-    {
-        LandMarkInFrame lm=landmarks.at(i);
-        if(lm.hasDepthInf() && lm.is_tracking_inlier==true)
-        {
-            lms.push_back(lm);
-        }
-    }
-}
 
-void CameraFrame::unpack(vector<Vec2> &pt2d,
-                         vector<cv::Mat>  &descriptors,
-                         vector<Vec3> &pt3d,
-                         vector<unsigned char> &mask3d)
+LandMarkView CameraFrame::getValidInliersView(void)
 {
-    pt2d.clear();
-    descriptors.clear();
-    pt3d.clear();
-    mask3d.clear();
-    for(size_t i=0; i<pt2d.size(); i++)
-    {
-        pt2d.push_back(landmarks.at(i).lm_2d);
-        pt3d.push_back(landmarks.at(i).lm_3d_w);
-        //descriptors.push_back(landmarks.at(i).lm_descriptor);
-        if(landmarks.at(i).hasDepthInf())
-        {mask3d.push_back(1);}
-        else
-        {mask3d.push_back(0);}
-    }
+    return landmarks.validView(true);
 }
 
 vector<Vec3> CameraFrame::getValid3dPts(void)
@@ -420,10 +433,9 @@ vector<Vec3> CameraFrame::getValid3dPts(void)
     vector<Vec3> ret;
     for(size_t i=0; i<landmarks.size(); i++)
     {
-        LandMarkInFrame lm=landmarks.at(i);
-        if(lm.hasDepthInf())
+        if(landmarks.has_3d[i])
         {
-            ret.push_back(lm.lm_3d_w);
+            ret.push_back(landmarks.lm_3d_w[i]);
         }
     }
     return ret;
@@ -433,47 +445,23 @@ vector<Vec3> CameraFrame::getValid3dPts(void)
 vector<cv::Point2f> CameraFrame::get2dPtsVec_cvP2f(void)
 {
     vector<cv::Point2f> ret;
-    ret.clear();
-    for(size_t i=0; i<landmarks.size(); i++)
-    {
-        ret.push_back(cv::Point2f(landmarks.at(i).lm_2d[0],
-                      landmarks.at(i).lm_2d[1]));
-    }
-    return ret;
-}
-vector<cv::Point3f> CameraFrame::get3dPtsVec_cvP3f(void)
-{
-    vector<cv::Point3f> ret;
-    ret.clear();
+    ret.reserve(landmarks.size());
     for(size_t i=0; i<landmarks.size(); i++)
     {
-        ret.push_back(cv::Point3f(landmarks.at(i).lm_2d[0],
-                      landmarks.at(i).lm_2d[1],
-                landmarks.at(i).lm_2d[3]));
+        ret.push_back(cv::Point2f(landmarks.lm_2d[i][0],
+                      landmarks.lm_2d[i][1]));
     }
     return ret;
 }
 
-vector<Vec2> CameraFrame::get2dPtsVec(void)
+const vector<Vec2>& CameraFrame::get2dPtsVec(void)
 {
-    vector<Vec2> ret;
-    ret.clear();
-    for(size_t i=0; i<landmarks.size(); i++)
-    {
-        ret.push_back(landmarks.at(i).lm_2d);
-    }
-    return ret;
+    return landmarks.lm_2d;
 }
 
-vector<Vec3> CameraFrame::get3dPtsVec(void)
+const vector<Vec3>& CameraFrame::get3dPtsVec(void)
 {
-    vector<Vec3> ret;
-    ret.clear();
-    for(size_t i=0; i<landmarks.size(); i++)
-    {
-        ret.push_back(landmarks.at(i).lm_3d_w);
-    }
-    return ret;
+    return landmarks.lm_3d_w;
 }
 
 
@@ -484,12 +472,11 @@ void CameraFrame::getKeyFrameInf(vector<int64_t> &lm_id, vector<Vec2> &lm_2d, ve
     lm_3d.clear();
     for(size_t i=0; i<landmarks.size(); i++)
     {
-        LandMarkInFrame lm=landmarks.at(i);
-        if(lm.hasDepthInf())
+        if(landmarks.has_3d[i])
         {
-            lm_3d.push_back(lm.lm_3d_w);
-            lm_2d.push_back(lm.lm_2d);
-            lm_id.push_back(lm.lm_id);
+            lm_3d.push_back(landmarks.lm_3d_w[i]);
+            lm_2d.push_back(landmarks.lm_2d[i]);
+            lm_id.push_back(landmarks.lm_id[i]);
         }
     }
 
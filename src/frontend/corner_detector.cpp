@@ -0,0 +1,324 @@
+#include "include/corner_detector.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+//Bresenham circle of radius 3, 16 pixels in order
+static const int circle_dx[16] = { 0, 1, 2, 3, 3, 3, 2, 1, 0,-1,-2,-3,-3,-3,-2,-1};
+static const int circle_dy[16] = {-3,-3,-2,-1, 0, 1, 2, 3, 3, 3, 2, 1, 0,-1,-2,-3};
+
+//FAST-9 segment test of one pixel, ofs: circle offsets in bytes
+static inline bool fast9Pixel(const unsigned char* p, const int* ofs, const int t)
+{
+    int v  = p[0];
+    int hi = v+t;
+    int lo = v-t;
+    //a 9-arc always covers at least 2 of the pixels 0,4,8,12
+    int cnt_b=0,cnt_d=0;
+    for(int k=0; k<16; k+=4)
+    {
+        int x = p[ofs[k]];
+        cnt_b += (x>hi);
+        cnt_d += (x<lo);
+    }
+    if(cnt_b<2 && cnt_d<2) return false;
+    int run_b=0,run_d=0;
+    for(int k=0; k<25; k++)
+    {
+        int x = p[ofs[k&15]];
+        run_b = (x>hi)?(run_b+1):0;
+        run_d = (x<lo)?(run_d+1):0;
+        if(run_b>=9 || run_d>=9) return true;
+    }
+    return false;
+}
+
+//FAST-9 over rows [y0,y1) and cols [x0,x1), the caller keeps a 3 pixel margin
+//corners are appended to xy as (x,y) pairs
+static void fast9Detect(const unsigned char* img, const int step,
+                        const int x0, const int y0, const int x1, const int y1,
+                        const int t, vector<int>& xy)
+{
+    int ofs[16];
+    for(int k=0; k<16; k++) ofs[k] = circle_dy[k]*step+circle_dx[k];
+    for(int y=y0; y<y1; y++)
+    {
+        const unsigned char* row = img+y*step;
+        int x=x0;
+#if defined(__AVX2__)
+        const __m256i delta = _mm256_set1_epi8(static_cast<char>(0x80));
+        const __m256i t8    = _mm256_set1_epi8(static_cast<char>(t));
+        const __m256i one   = _mm256_set1_epi8(1);
+        const __m256i eight = _mm256_set1_epi8(8);
+        const __m256i zero  = _mm256_setzero_si256();
+        for(; x+32<=x1; x+=32)
+        {
+            const unsigned char* ptr = row+x;
+            __m256i v   = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+            //unsigned compare by signed compare of (value^0x80)
+            __m256i vhi = _mm256_xor_si256(_mm256_adds_epu8(v,t8),delta);
+            __m256i vlo = _mm256_xor_si256(_mm256_subs_epu8(v,t8),delta);
+            __m256i cb = zero, cd = zero;
+            for(int k=0; k<16; k+=4)
+            {
+                __m256i xk = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr+ofs[k])),delta);
+                cb = _mm256_sub_epi8(cb,_mm256_cmpgt_epi8(xk,vhi));
+                cd = _mm256_sub_epi8(cd,_mm256_cmpgt_epi8(vlo,xk));
+            }
+            __m256i q = _mm256_or_si256(_mm256_cmpgt_epi8(cb,one),_mm256_cmpgt_epi8(cd,one));
+            if(!_mm256_movemask_epi8(q)) continue;
+            //longest run of brighter/darker pixels, counters reset where the mask is 0
+            __m256i run_b = zero, run_d = zero, max_b = zero, max_d = zero;
+            for(int k=0; k<25; k++)
+            {
+                __m256i xk = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr+ofs[k&15])),delta);
+                __m256i mb = _mm256_cmpgt_epi8(xk,vhi);
+                __m256i md = _mm256_cmpgt_epi8(vlo,xk);
+                run_b = _mm256_and_si256(_mm256_sub_epi8(run_b,mb),mb);
+                run_d = _mm256_and_si256(_mm256_sub_epi8(run_d,md),md);
+                max_b = _mm256_max_epu8(max_b,run_b);
+                max_d = _mm256_max_epu8(max_d,run_d);
+            }
+            __m256i res = _mm256_and_si256(q,_mm256_or_si256(_mm256_cmpgt_epi8(max_b,eight),
+                                                             _mm256_cmpgt_epi8(max_d,eight)));
+            unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(res));
+            while(mask)
+            {
+                int b = __builtin_ctz(mask);
+                xy.push_back(x+b);
+                xy.push_back(y);
+                mask &= (mask-1);
+            }
+        }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        const uint8x16_t t8    = vdupq_n_u8(static_cast<unsigned char>(t));
+        const uint8x16_t one   = vdupq_n_u8(1);
+        const uint8x16_t eight = vdupq_n_u8(8);
+        const uint8x16_t zero  = vdupq_n_u8(0);
+        for(; x+16<=x1; x+=16)
+        {
+            const unsigned char* ptr = row+x;
+            uint8x16_t v   = vld1q_u8(ptr);
+            uint8x16_t vhi = vqaddq_u8(v,t8);
+            uint8x16_t vlo = vqsubq_u8(v,t8);
+            uint8x16_t cb = zero, cd = zero;
+            for(int k=0; k<16; k+=4)
+            {
+                uint8x16_t xk = vld1q_u8(ptr+ofs[k]);
+                cb = vsubq_u8(cb,vcgtq_u8(xk,vhi));
+                cd = vsubq_u8(cd,vcltq_u8(xk,vlo));
+            }
+            uint8x16_t q = vorrq_u8(vcgtq_u8(cb,one),vcgtq_u8(cd,one));
+            uint8x8_t  q_any = vpmax_u8(vget_low_u8(q),vget_high_u8(q));
+            q_any = vpmax_u8(q_any,q_any);
+            q_any = vpmax_u8(q_any,q_any);
+            q_any = vpmax_u8(q_any,q_any);
+            if(!vget_lane_u8(q_any,0)) continue;
+            uint8x16_t run_b = zero, run_d = zero, max_b = zero, max_d = zero;
+            for(int k=0; k<25; k++)
+            {
+                uint8x16_t xk = vld1q_u8(ptr+ofs[k&15]);
+                uint8x16_t mb = vcgtq_u8(xk,vhi);
+                uint8x16_t md = vcltq_u8(xk,vlo);
+                run_b = vandq_u8(vsubq_u8(run_b,mb),mb);
+                run_d = vandq_u8(vsubq_u8(run_d,md),md);
+                max_b = vmaxq_u8(max_b,run_b);
+                max_d = vmaxq_u8(max_d,run_d);
+            }
+            uint8x16_t res = vandq_u8(q,vorrq_u8(vcgtq_u8(max_b,eight),vcgtq_u8(max_d,eight)));
+            unsigned char res_lane[16];
+            vst1q_u8(res_lane,res);
+            for(int b=0; b<16; b++)
+            {
+                if(res_lane[b])
+                {
+                    xy.push_back(x+b);
+                    xy.push_back(y);
+                }
+            }
+        }
+#endif
+        for(; x<x1; x++)
+        {
+            if(fast9Pixel(row+x,ofs,t))
+            {
+                xy.push_back(x);
+                xy.push_back(y);
+            }
+        }
+    }
+}
+
+//Shi-Tomasi score (min eigen value of the structure tensor) in a 7x7 window
+//grad: interleaved (dx,dy) int16, gstep: row step in int16 elements
+static inline float shiTomasiScore(const short* grad, const int gstep, const int x, const int y)
+{
+    int sxx=0,syy=0,sxy=0;
+#if defined(__AVX2__)
+    //8 pixels (16 int16) are loaded per row, the 8th pixel is masked out
+    const __m256i mask7 = _mm256_setr_epi16(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,0,0);
+    const __m256i maskx = _mm256_setr_epi16(-1,0,-1,0,-1,0,-1,0,-1,0,-1,0,-1,0,-1,0);
+    __m256i acc_xx = _mm256_setzero_si256();
+    __m256i acc_yy = _mm256_setzero_si256();
+    __m256i acc_xy = _mm256_setzero_si256();
+    for(int dy=-SHI_TOMASI_RADIUS; dy<=SHI_TOMASI_RADIUS; dy++)
+    {
+        const short* p = grad+(y+dy)*gstep+(x-SHI_TOMASI_RADIUS)*2;
+        __m256i g  = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)),mask7);
+        __m256i gx = _mm256_and_si256(g,maskx);                 //(dx,0)
+        __m256i gy = _mm256_andnot_si256(maskx,g);              //(0,dy)
+        __m256i gs = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(g,0xB1),0xB1);//(dy,dx)
+        acc_xx = _mm256_add_epi32(acc_xx,_mm256_madd_epi16(g,gx));
+        acc_yy = _mm256_add_epi32(acc_yy,_mm256_madd_epi16(g,gy));
+        acc_xy = _mm256_add_epi32(acc_xy,_mm256_madd_epi16(gx,gs));
+    }
+    int buf[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf),acc_xx);
+    for(int i=0; i<8; i++) sxx+=buf[i];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf),acc_yy);
+    for(int i=0; i<8; i++) syy+=buf[i];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf),acc_xy);
+    for(int i=0; i<8; i++) sxy+=buf[i];
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    int32x4_t acc_xx = vdupq_n_s32(0);
+    int32x4_t acc_yy = vdupq_n_s32(0);
+    int32x4_t acc_xy = vdupq_n_s32(0);
+    for(int dy=-SHI_TOMASI_RADIUS; dy<=SHI_TOMASI_RADIUS; dy++)
+    {
+        const short* p = grad+(y+dy)*gstep+(x-SHI_TOMASI_RADIUS)*2;
+        int16x8x2_t g = vld2q_s16(p);//deinterleave dx,dy of 8 pixels
+        int16x8_t gx = vsetq_lane_s16(0,g.val[0],7);
+        int16x8_t gy = vsetq_lane_s16(0,g.val[1],7);
+        acc_xx = vmlal_s16(acc_xx,vget_low_s16(gx),vget_low_s16(gx));
+        acc_xx = vmlal_s16(acc_xx,vget_high_s16(gx),vget_high_s16(gx));
+        acc_yy = vmlal_s16(acc_yy,vget_low_s16(gy),vget_low_s16(gy));
+        acc_yy = vmlal_s16(acc_yy,vget_high_s16(gy),vget_high_s16(gy));
+        acc_xy = vmlal_s16(acc_xy,vget_low_s16(gx),vget_low_s16(gy));
+        acc_xy = vmlal_s16(acc_xy,vget_high_s16(gx),vget_high_s16(gy));
+    }
+    int buf[4];
+    vst1q_s32(buf,acc_xx);
+    sxx = buf[0]+buf[1]+buf[2]+buf[3];
+    vst1q_s32(buf,acc_yy);
+    syy = buf[0]+buf[1]+buf[2]+buf[3];
+    vst1q_s32(buf,acc_xy);
+    sxy = buf[0]+buf[1]+buf[2]+buf[3];
+#else
+    for(int dy=-SHI_TOMASI_RADIUS; dy<=SHI_TOMASI_RADIUS; dy++)
+    {
+        const short* p = grad+(y+dy)*gstep+(x-SHI_TOMASI_RADIUS)*2;
+        for(int dx=0; dx<(2*SHI_TOMASI_RADIUS+1); dx++)
+        {
+            int gx = p[2*dx];
+            int gy = p[2*dx+1];
+            sxx += gx*gx;
+            syy += gy*gy;
+            sxy += gx*gy;
+        }
+    }
+#endif
+    float a = 0.5f*sxx;
+    float b = static_cast<float>(sxy);
+    float c = 0.5f*syy;
+    return (a+c)-std::sqrt((a-c)*(a-c)+b*b);
+}
+
+CornerDetector::Ptr CornerDetector::create(const TYPEOFDETECTOR type)
+{
+    if(type==FAST_DETECTOR)
+    {
+        return std::make_shared<FASTCornerDetector>();
+    }
+    return std::make_shared<GFTTCornerDetector>();
+}
+
+void GFTTCornerDetector::detect(const cv::Mat& img,
+                                const cv::Mat& grad,
+                                const int maxCorners,
+                                vector<cv::Point2f>& corners)
+{
+    corners.clear();
+    cv::goodFeaturesToTrack(img, corners, maxCorners,
+                            DETECTOR_QUALITY_LEVEL, DETECTOR_MIN_DISTANCE, cv::noArray());
+}
+
+FASTCornerDetector::FASTCornerDetector(int threshold, int nms_cell_size)
+{
+    this->threshold = threshold;
+    this->nms_cell_size = (nms_cell_size<1)?1:nms_cell_size;
+}
+
+void FASTCornerDetector::detect(const cv::Mat& img,
+                                const cv::Mat& grad,
+                                const int maxCorners,
+                                vector<cv::Point2f>& corners)
+{
+    corners.clear();
+    if(img.empty() || grad.empty()) return;
+    //pixels outside the ROI are valid neighbours, only the real image border is excluded
+    cv::Size whole_size;
+    cv::Point ofs;
+    img.locateROI(whole_size,ofs);
+    //the 7x7 score loads 8 gradient pixels per row, one more column on the right
+    const int margin = 3;
+    int x0 = std::max(0,margin-ofs.x);
+    int y0 = std::max(0,margin-ofs.y);
+    int x1 = std::min(img.cols,whole_size.width-margin-1-ofs.x);
+    int y1 = std::min(img.rows,whole_size.height-margin-ofs.y);
+    if(x1<=x0 || y1<=y0) return;
+
+    //STEP1: FAST-9
+    vector<int> candidate_xy;//(x,y) pairs
+    fast9Detect(img.ptr<unsigned char>(0),static_cast<int>(img.step1()),
+                x0,y0,x1,y1,threshold,candidate_xy);
+    int n = static_cast<int>(candidate_xy.size()/2);
+    if(n==0) return;
+
+    //STEP2: Shi-Tomasi score and grid non-max suppression
+    const short* g = grad.ptr<short>(0);
+    const int gstep = static_cast<int>(grad.step1());
+    int cols = (img.cols+nms_cell_size-1)/nms_cell_size;
+    int rows = (img.rows+nms_cell_size-1)/nms_cell_size;
+    vector<int> best_idx(cols*rows,-1);
+    vector<float> candidate_score(n);
+    float max_score = 0;
+    for(int i=0; i<n; i++)
+    {
+        int x = candidate_xy[2*i];
+        int y = candidate_xy[2*i+1];
+        float score = shiTomasiScore(g,gstep,x,y);
+        candidate_score[i] = score;
+        if(score>max_score) max_score=score;
+        int cell = (y/nms_cell_size)*cols+(x/nms_cell_size);
+        if(best_idx[cell]<0 || candidate_score[best_idx[cell]]<score)
+        {
+            best_idx[cell] = i;
+        }
+    }
+
+    //STEP3: quality level and strongest maxCorners
+    float min_score = static_cast<float>(DETECTOR_QUALITY_LEVEL)*max_score;
+    vector<pair<float,int>> selected;
+    for(size_t c=0; c<best_idx.size(); c++)
+    {
+        int i = best_idx[c];
+        if(i>=0 && candidate_score[i]>min_score)
+        {
+            selected.push_back(make_pair(candidate_score[i],i));
+        }
+    }
+    sort(selected.begin(),selected.end(),
+         [](const pair<float,int>& a, const pair<float,int>& b){return a.first>b.first;});
+    if(maxCorners>0 && static_cast<int>(selected.size())>maxCorners)
+    {
+        selected.resize(maxCorners);
+    }
+    for(size_t k=0; k<selected.size(); k++)
+    {
+        int i = selected[k].second;
+        corners.push_back(cv::Point2f(candidate_xy[2*i],candidate_xy[2*i+1]));
+    }
+}
@@ -12,7 +12,9 @@ void F2FTracking::init(const int w, const int h,
                        const SE3 T_c0_c1)
 {
     this->feature_dem   = new FeatureDEM(w,h,5);
+    this->stereo_preprocess = NULL;
     this->lkorb_tracker = new LKORBTracking(w,h);
+    this->prior_pnp     = new PriorPnP();
     this->vimotion      = new VIMOTION(T_i_c0_in,  9.81,
                                        vi_para[0], vi_para[1],  vi_para[2], vi_para[3]);
     curr_frame = std::make_shared<CameraFrame>();
@@ -52,10 +54,11 @@ void F2FTracking::init(const int w, const int h,
                           CALIB_ZERO_DISPARITY,0,cv::Size(w,h));
 
         D1_rect = D0_rect = (cv::Mat1d(4, 1) << 0,0,0,0);
-        cv::initUndistortRectifyMap(K0,D0,R0,P0,cv::Size(w,h),CV_32F,
+        cv::initUndistortRectifyMap(K0,D0,R0,P0,cv::Size(w,h),CV_16SC2,
                                     c0_RM[0],c0_RM[1]);
-        cv::initUndistortRectifyMap(K1,D1,R1,P1,cv::Size(w,h),CV_32F,
+        cv::initUndistortRectifyMap(K1,D1,R1,P1,cv::Size(w,h),CV_16SC2,
                                     c1_RM[0],c1_RM[1]);
+        this->stereo_preprocess = new StereoPreprocess(c0_RM,c1_RM);
         K0_rect = P0.rowRange(0,3).colRange(0,3);
         K1_rect = P1.rowRange(0,3).colRange(0,3);
 
@@ -86,7 +89,7 @@ void F2FTracking::init(const int w, const int h,
     }
     this->frameCount = 0;
     this->vo_tracking_state = UnInit;
-    this->has_localmap_feedback = false;
+    this->pose_records_base = 0;
 }
 
 
@@ -105,10 +108,58 @@ void F2FTracking::imu_feed(const double time, const Vec3 acc, const Vec3 gyro,
     }
 }
 
-void F2FTracking::correction_feed(const double time, const CorrectionInfStruct corr)
+void F2FTracking::correction_feed(const flvis::CorrectionInfConstPtr& msg)
 {
-    this->correction_inf = corr;
-    this->has_localmap_feedback = true;
+    CorrectionInfStruct& corr = correction_mailbox.writeBuffer();
+    CorrectionInfMsg::unpack(msg,
+                             corr.frame_id,
+                             corr.T_c_w,
+                             corr.lm_count,
+                             corr.lm_id,
+                             corr.lm_3d,
+                             corr.lm_outlier_count,
+                             corr.lm_outlier_id);
+    correction_mailbox.publish();
+}
+
+void F2FTracking::recordPose(const CameraFrame::Ptr& frame)
+{
+    ID_POSE tmp;
+    tmp.frame_id = frame->frame_id;
+    tmp.T_c_w = frame->T_c_w;
+    pose_record_index[tmp.frame_id] = pose_records_base+pose_records.size();
+    pose_records.push_back(tmp);
+    if(pose_records.size() >= POSE_RECORDS_SIZE)
+    {
+        pose_record_index.erase(pose_records.front().frame_id);
+        pose_records.pop_front();
+        pose_records_base++;
+    }
+}
+
+void F2FTracking::applyCorrection(const CorrectionInfStruct& corr)
+{
+    //find pose, O(1)
+    unordered_map<int64_t,uint64_t>::const_iterator it = pose_record_index.find(corr.frame_id);
+    if(it==pose_record_index.end())
+    {
+        cout << "local map feedback of frame " << corr.frame_id << " is older than the pose records, ignored" << endl;
+        return;
+    }
+    size_t old_pose_idx = static_cast<size_t>(it->second-pose_records_base);
+    SE3 old_T_c_w = pose_records.at(old_pose_idx).T_c_w;
+    //T_new = T*old^-1*update for every pose after the corrected one
+    SE3 T_corr = old_T_c_w.inverse()*corr.T_c_w;
+    //update pose records
+    for(size_t i=old_pose_idx; i<pose_records.size(); i++)
+    {
+        pose_records.at(i).T_c_w = pose_records.at(i).T_c_w*T_corr;
+    }
+    last_frame->T_c_w = last_frame->T_c_w*T_corr;
+    last_frame->correctLMP3DWByLMP3DCandT();
+    //update last_frame landmake lm_3d_w and mask outlier, id hash lookup per corrected landmark
+    last_frame->forceCorrectLM3DW(corr.lm_count,corr.lm_id,corr.lm_3d);
+    last_frame->forceMarkOutlier(corr.lm_outlier_count,corr.lm_outlier_id);
 }
 
 
@@ -120,7 +171,7 @@ bool F2FTracking::init_frame()
     if(cam_type==DEPTH_D435)
     {
         vector<Vec2> pts2d;
-        this->feature_dem->detect(curr_frame->img0,pts2d);
+        this->feature_dem->detect(curr_frame->img0,curr_frame->getImg0Grad(),pts2d);
         cout << "Detect " << pts2d.size() << " Features for init process"<< endl;
         for(size_t i=0; i<pts2d.size(); i++)
         {
@@ -132,10 +183,7 @@ bool F2FTracking::init_frame()
         curr_frame->depthInnovation();
         if(curr_frame->validLMCount()>30)
         {
-            ID_POSE tmp;
-            tmp.frame_id = curr_frame->frame_id;
-            tmp.T_c_w = curr_frame->T_c_w;
-            pose_records.push_back(tmp);
+            recordPose(curr_frame);
             T_c_w_last_keyframe = curr_frame->T_c_w;
             init_succeed = true;
             cout << "vo_tracking_state = Tracking" << endl;
@@ -144,7 +192,7 @@ bool F2FTracking::init_frame()
     if(cam_type==STEREO_EuRoC_MAV){
 
         vector<Vec2> pts2d_img0,pts2d_img1;
-        this->feature_dem->detect(curr_frame->img0,pts2d_img0);
+        this->feature_dem->detect(curr_frame->img0,curr_frame->getImg0Grad(),pts2d_img0);
         cout << "Detect " << pts2d_img0.size() << " Features for init process"<< endl;
         for(size_t i=0; i<pts2d_img0.size(); i++)
         {
@@ -156,10 +204,7 @@ bool F2FTracking::init_frame()
         curr_frame->depthInnovation();
         if(curr_frame->validLMCount()>30)
         {
-            ID_POSE tmp;
-            tmp.frame_id = curr_frame->frame_id;
-            tmp.T_c_w = curr_frame->T_c_w;
-            pose_records.push_back(tmp);
+            recordPose(curr_frame);
             T_c_w_last_keyframe = curr_frame->T_c_w;
             init_succeed = true;
             cout << "vo_tracking_state = Tracking" << endl;
@@ -168,17 +213,38 @@ bool F2FTracking::init_frame()
     return init_succeed;
 }
 
+//convert 3/4 channel image to gray into pool, 1 channel image is returned as is (no copy)
+static cv::Mat toGray(const cv::Mat& img_in, cv::Mat& pool)
+{
+    bool mbRGB = 0;
+    if(img_in.channels()==3)
+    {
+        if(mbRGB)
+            cvtColor(img_in,pool,CV_RGB2GRAY);
+        else
+            cvtColor(img_in,pool,CV_BGR2GRAY);
+        return pool;
+    }
+    else if(img_in.channels()==4)
+    {
+        if(mbRGB)
+            cvtColor(img_in,pool,CV_RGBA2GRAY);
+        else
+            cvtColor(img_in,pool,CV_BGRA2GRAY);
+        return pool;
+    }
+    return img_in;
+}
+
 void F2FTracking::image_feed(const double time,
-                             const cv::Mat img0_in,
-                             const cv::Mat img1_in,
+                             const cv::Mat& img0_in,
+                             const cv::Mat& img1_in,
                              bool &new_keyframe,
-                             bool &reset_cmd)
+                             bool &reset_cmd,
+                             const boost::shared_ptr<const void> img0_holder,
+                             const boost::shared_ptr<const void> img1_holder)
 {
     auto start = high_resolution_clock::now();
-    new_keyframe = false;
-    reset_cmd = false;
-    frameCount++;
-
     //    if(frameCount==40)
     //    {
     //        vimotion->imu_initialized = false;
@@ -188,55 +254,66 @@ void F2FTracking::image_feed(const double time,
     //        return;
     //    }
 
-    last_frame.swap(curr_frame);
-    curr_frame->clear();
-    curr_frame->frame_id = frameCount;
-    curr_frame->frame_time = time;
-    bool mbRGB = 0;
-    if(img0_in.channels()==3)
-    {
-        if(mbRGB)
-            cvtColor(img0_in,img0_in,CV_RGB2GRAY);
-        else
-            cvtColor(img0_in,img0_in,CV_BGR2GRAY);
-    }
-    else if(img0_in.channels()==4)
-    {
-        if(mbRGB)
-            cvtColor(img0_in,img0_in,CV_RGBA2GRAY);
-        else
-            cvtColor(img0_in,img0_in,CV_BGRA2GRAY);
-    }
-    if(img1_in.channels()==3)
+    //the buffer of the frame before last_frame is reused
+    CameraFrame::Ptr frame = last_frame;
+    preprocess(frame,time,img0_in,img1_in,img0_holder,img1_holder);
+    if(trackFrame(frame,new_keyframe,reset_cmd))
     {
-        if(mbRGB)
-            cvtColor(img1_in,img1_in,CV_RGB2GRAY);
-        else
-            cvtColor(img1_in,img1_in,CV_BGR2GRAY);
-    }
-    else if(img1_in.channels()==4)
-    {
-        if(mbRGB)
-            cvtColor(img1_in,img1_in,CV_RGBA2GRAY);
-        else
-            cvtColor(img1_in,img1_in,CV_BGRA2GRAY);
+        updateMap(new_keyframe);
     }
 
+    auto stop = high_resolution_clock::now();
+    auto duration = duration_cast<milliseconds>(stop - start);
+    curr_frame->solving_time = (duration.count()/1000.0);
+}
+
+void F2FTracking::preprocess(CameraFrame::Ptr frame,
+                             const double time,
+                             const cv::Mat& img0_in,
+                             const cv::Mat& img1_in,
+                             const boost::shared_ptr<const void> img0_holder,
+                             const boost::shared_ptr<const void> img1_holder)
+{
+    frame->clear();
+    frame->frame_time = time;
+    //Mono8/16UC1 inputs are referenced directly (zero-copy),
+    //colour inputs are converted into the pooled buffer of the frame
+    frame->img_holder[0] = img0_holder;
+    frame->img_holder[1] = img1_holder;
+    cv::Mat img0_gray = toGray(img0_in,frame->cvt_pool[0]);
+    cv::Mat img1_gray = toGray(img1_in,frame->cvt_pool[1]);
 
     switch(this->cam_type)
     {
     case DEPTH_D435:
-        curr_frame->img0=img0_in;
-        curr_frame->d_img=img1_in;
-        //cv::equalizeHist(curr_frame->img0,curr_frame->img0);
+        frame->img0=img0_gray;
+        frame->d_img=img1_gray;
+        //cv::equalizeHist(frame->img0,frame->img0);
         break;
     case STEREO_EuRoC_MAV:
-        cv::remap(img0_in, curr_frame->img0, c0_RM[0], c0_RM[1],cv::INTER_LINEAR);
-        cv::remap(img1_in, curr_frame->img1, c1_RM[0], c1_RM[1],cv::INTER_LINEAR);
-        cv::equalizeHist(curr_frame->img0,curr_frame->img0);
-        cv::equalizeHist(curr_frame->img1,curr_frame->img1);
+        //rectify + equalize, both eyes in parallel
+        stereo_preprocess->process(img0_gray,img1_gray,
+                                   frame->rect_pool[0],frame->rect_pool[1]);
+        frame->img0 = frame->rect_pool[0];
+        frame->img1 = frame->rect_pool[1];
+        //rectified output is owned by the frame, the input message can be released
+        frame->img_holder[0].reset();
+        frame->img_holder[1].reset();
         break;
     }
+    //pyramid and gradient cache
+    frame->getImg0Pyr();
+}
+
+bool F2FTracking::trackFrame(CameraFrame::Ptr frame, bool &new_keyframe, bool &reset_cmd)
+{
+    new_keyframe = false;
+    reset_cmd = false;
+    bool need_map_update = false;
+    frameCount++;
+    last_frame = curr_frame;
+    curr_frame = frame;
+    curr_frame->frame_id = frameCount;
 
     switch(vo_tracking_state)
     {
@@ -296,45 +373,35 @@ void F2FTracking::image_feed(const double time,
                              STEP6: Update Landmarks(IIR)
                              STEP7: Record Pose
                              STEP8: Switch KeyFrame if needed
+                             STEP1-4 run here (stage B), STEP5-8 in updateMap() (stage C)
                     */
         //STEP1:
-        if(has_localmap_feedback)
+        CorrectionInfStruct* corr;
+        if(correction_mailbox.take(corr))
         {
-            //find pose;
-            int corr_id = correction_inf.frame_id;
-            int old_pose_idx = 0;
-            for(int i=(pose_records.size()-1); i>=0; i--)
-            {
-                if(pose_records.at(i).frame_id==corr_id)
-                {
-                    old_pose_idx=i;
-                    break;
-                }
-            }
-            SE3 old_T_c_w = pose_records.at(old_pose_idx).T_c_w;
-            SE3 old_T_c_w_inv = old_T_c_w.inverse();
-            SE3 update_T_c_w = correction_inf.T_c_w;
-            //update pose records
-            for(int i=old_pose_idx; i<pose_records.size(); i++)
+            applyCorrection(*corr);
+        }
+        //STEP2:
+        //(Option) ->IMU predicted pose as the initial flow of LK
+        bool has_prediction = false;
+        SE3  T_c_w_pred;
+        if(this->has_imu && vimotion->imu_initialized)
+        {
+            SE3 T_curr_last;
+            if(vimotion->viGetRelativeCamMotion(last_frame->frame_time,curr_frame->frame_time,T_curr_last))
             {
-                SE3 T_diff= pose_records.at(i).T_c_w * old_T_c_w_inv;
-                pose_records.at(i).T_c_w = T_diff * update_T_c_w;
+                T_c_w_pred = T_curr_last*last_frame->T_c_w;
+                has_prediction = true;
             }
-            SE3 T_diff= last_frame->T_c_w * old_T_c_w_inv;
-            last_frame->T_c_w = T_diff * update_T_c_w;
-            last_frame->correctLMP3DWByLMP3DCandT();
-            //update last_frame landmake lm_3d_w and mask outlier
-            last_frame->forceCorrectLM3DW(correction_inf.lm_count,correction_inf.lm_id,correction_inf.lm_3d);
-            last_frame->forceMarkOutlier(correction_inf.lm_outlier_count,correction_inf.lm_outlier_id);
-            has_localmap_feedback = false;
         }
-        //STEP2:
         vector<Vec2> lm2d_from,lm2d_to,outlier_tracking;
         this->lkorb_tracker->tracking(*last_frame,
                                       *curr_frame,
                                       lm2d_from,
                                       lm2d_to,
-                                      outlier_tracking);
+                                      outlier_tracking,
+                                      has_prediction,
+                                      T_c_w_pred);
         //STEP3:
         vector<cv::Point2f> p2d;
         vector<cv::Point3f> p3d;
@@ -354,21 +421,14 @@ void F2FTracking::image_feed(const double time,
             break;
         }
         continus_tracking_fail_cnt = 0;
-        cv::Mat r_ = cv::Mat::zeros(3, 1, CV_64FC1);
-        cv::Mat t_ = cv::Mat::zeros(3, 1, CV_64FC1);
-        SE3_to_rvec_tvec(last_frame->T_c_w, r_ , t_ );
-        cv::Mat inliers;
-        solvePnPRansac(p3d,p2d,K0_rect,D0_rect,
-                       r_,t_,false,100,3.0,0.99,inliers,cv::SOLVEPNP_ITERATIVE);
-        curr_frame->T_c_w = SE3_from_rvec_tvec(r_,t_);
+        //(Option) ->IMU predicted pose as the prior of PnP
         std::vector<uchar> status;
-        for (int i = 0; i < (int)p2d.size(); i++)
-            status.push_back(0);
-        for( int i = 0; i < inliers.rows; i++)
-        {
-            int n = inliers.at<int>(i);
-            status[n] = 1;
-        }
+        this->prior_pnp->solve(p3d,p2d,K0_rect,D0_rect,
+                               last_frame->T_c_w,
+                               has_prediction,
+                               T_c_w_pred,
+                               curr_frame->T_c_w,
+                               status);
         curr_frame->updateLMState(status);
         //curr_frame->eraseReprjOutlier();
         //(Option) ->IMU roll pitch compensation
@@ -392,41 +452,7 @@ void F2FTracking::image_feed(const double time,
                                              last_frame->frame_time,
                                              curr_frame->T_c_w);
         }
-        //STEP5:
-        vector<Vec2> newKeyPts;
-        int newPtsCount;
-        this->feature_dem->redetect(curr_frame->img0,
-                                    curr_frame->get2dPtsVec(),
-                                    newKeyPts,newPtsCount);
-        for(size_t i=0; i<newKeyPts.size(); i++)
-        {
-            curr_frame->landmarks.push_back(LandMarkInFrame(newKeyPts.at(i),
-                                                            Vec3(0,0,0),
-                                                            false,
-                                                            curr_frame->T_c_w));
-        }
-        //STEP6:
-        curr_frame->depthInnovation();
-        //STEP7:
-        ID_POSE tmp;
-        tmp.frame_id = curr_frame->frame_id;
-        tmp.T_c_w = curr_frame->T_c_w;
-        pose_records.push_back(tmp);
-        if(pose_records.size() >= 1000)
-        {
-            pose_records.pop_front();
-        }
-        //STEP8:
-        SE3 T_diff_key_curr = T_c_w_last_keyframe*(curr_frame->T_c_w.inverse());
-        Vec3 t=T_diff_key_curr.translation();
-        Vec3 r=T_diff_key_curr.so3().log();
-        double t_norm = fabs(t[0]) + fabs(t[1]) + fabs(t[2]);
-        double r_norm = fabs(r[0]) + fabs(r[1]) + fabs(r[2]);
-        if(t_norm>=0.03 || r_norm>=0.2)
-        {
-            new_keyframe = true;
-            T_c_w_last_keyframe = curr_frame->T_c_w;
-        }
+        need_map_update = true;
         break;
     }//end of state: Tracking
     case TrackingFail:
@@ -437,7 +463,7 @@ void F2FTracking::image_feed(const double time,
         {
             cout << "vision tracking fail, IMU motion only" << endl << "Tring to recover~" << endl;
             vector<Vec2> pts2d;
-            this->feature_dem->detect(curr_frame->img0,pts2d);
+            this->feature_dem->detect(curr_frame->img0,curr_frame->getImg0Grad(),pts2d);
             cout << "Detect " << pts2d.size() << " Features"<< endl;
             if(this->vimotion->viGetCorrFrameState(curr_frame->frame_time,curr_frame->T_c_w))
             {
@@ -451,10 +477,7 @@ void F2FTracking::image_feed(const double time,
                 curr_frame->depthInnovation();
                 if(curr_frame->validLMCount()>30)
                 {
-                    ID_POSE tmp;
-                    tmp.frame_id = curr_frame->frame_id;
-                    tmp.T_c_w = curr_frame->T_c_w;
-                    pose_records.push_back(tmp);
+                    recordPose(curr_frame);
                     T_c_w_last_keyframe = curr_frame->T_c_w;
                     new_keyframe = true;
                     vo_tracking_state = Tracking;
@@ -483,8 +506,38 @@ void F2FTracking::image_feed(const double time,
         break;
     }//end of state: TrackingFail
     }//end of state machine
+    return need_map_update;
+}
 
-    auto stop = high_resolution_clock::now();
-    auto duration = duration_cast<milliseconds>(stop - start);
-    curr_frame->solving_time = (duration.count()/1000.0);
+void F2FTracking::updateMap(bool &new_keyframe)
+{
+    //STEP5:
+    vector<Vec2> newKeyPts;
+    int newPtsCount;
+    this->feature_dem->redetect(curr_frame->img0,
+                                curr_frame->getImg0Grad(),
+                                curr_frame->get2dPtsVec(),
+                                newKeyPts,newPtsCount);
+    for(size_t i=0; i<newKeyPts.size(); i++)
+    {
+        curr_frame->landmarks.push_back(LandMarkInFrame(newKeyPts.at(i),
+                                                        Vec3(0,0,0),
+                                                        false,
+                                                        curr_frame->T_c_w));
+    }
+    //STEP6:
+    curr_frame->depthInnovation();
+    //STEP7:
+    recordPose(curr_frame);
+    //STEP8:
+    SE3 T_diff_key_curr = T_c_w_last_keyframe*(curr_frame->T_c_w.inverse());
+    Vec3 t=T_diff_key_curr.translation();
+    Vec3 r=T_diff_key_curr.so3().log();
+    double t_norm = fabs(t[0]) + fabs(t[1]) + fabs(t[2]);
+    double r_norm = fabs(r[0]) + fabs(r[1]) + fabs(r[2]);
+    if(t_norm>=0.03 || r_norm>=0.2)
+    {
+        new_keyframe = true;
+        T_c_w_last_keyframe = curr_frame->T_c_w;
+    }
 }
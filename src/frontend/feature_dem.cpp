@@ -1,4 +1,5 @@
 #include <include/feature_dem.h>
+#include <include/task_pool.h>
 #include <opencv2/features2d/features2d.hpp>
 
 // Driver function to sort the vector elements by
@@ -11,64 +12,98 @@ static bool sortbysecdesc(const pair<cv::Point2f,float> &a,
 
 FeatureDEM::FeatureDEM(const int image_width,
                        const int image_height,
-                       int boundaryBoxSize)
+                       int boundaryBoxSize,
+                       int occupancyCellSize)
 {
     width=image_width;
     height=image_height;
     regionWidth  = floor(width/4.0);
     regionHeight = floor(height/4.0);
     boundary_dis = floor(boundaryBoxSize/2.0);
-    int gridx[5],gridy[5];
-    for(int i=0; i<5; i++)
-    {
-        gridx[i]=i*regionWidth;
-        gridy[i]=i*regionHeight;
-    }
-    for(int i=0; i<16; i++)
+    cell_size = (occupancyCellSize<1)?1:occupancyCellSize;
+    grid_cols = (width+cell_size-1)/cell_size;
+    grid_rows = (height+cell_size-1)/cell_size;
+    occupancy.assign(grid_cols*grid_rows,0);
+    detector = CornerDetector::create(GFTT_DETECTOR);
+}
+
+void FeatureDEM::setDetectorBackend(const TYPEOFDETECTOR type)
+{
+    detector = CornerDetector::create(type);
+}
+
+FeatureDEM::~FeatureDEM()
+{;}
+
+int FeatureDEM::regionIdx(const cv::Point2f& pt)
+{
+    int rx = static_cast<int>(pt.x)/regionWidth;
+    int ry = static_cast<int>(pt.y)/regionHeight;
+    if(rx<0) rx=0;
+    if(rx>3) rx=3;
+    if(ry<0) ry=0;
+    if(ry>3) ry=3;
+    return 4*ry+rx;
+}
+
+void FeatureDEM::resetOccupancy(void)
+{
+    std::fill(occupancy.begin(),occupancy.end(),0);
+}
+
+//cells overlapped by the boundary box around pt
+void FeatureDEM::boxCells(const cv::Point2f& pt, int& cx0, int& cy0, int& cx1, int& cy1)
+{
+    int x = static_cast<int>(pt.x);
+    int y = static_cast<int>(pt.y);
+    cx0 = std::max(x-boundary_dis,0)/cell_size;
+    cy0 = std::max(y-boundary_dis,0)/cell_size;
+    cx1 = std::min(x+boundary_dis,width-1)/cell_size;
+    cy1 = std::min(y+boundary_dis,height-1)/cell_size;
+}
+
+bool FeatureDEM::isFree(const cv::Point2f& pt)
+{
+    int cx0,cy0,cx1,cy1;
+    boxCells(pt,cx0,cy0,cx1,cy1);
+    for(int cy=cy0; cy<=cy1; cy++)
     {
-        detectorMask[i] = cv::Mat(image_height, image_width, CV_8S,cv::Scalar(0));
-        int x_begin,x_end,y_begin,y_end;
-        x_begin = gridx[i%4];
-        x_end   = gridx[(i%4)+1];
-        y_begin = gridy[i/4];
-        y_end   = gridy[(i/4)+1];
-        for(int xx=x_begin; xx<x_end; xx++)
+        for(int cx=cx0; cx<=cx1; cx++)
         {
-            for(int yy=y_begin; yy<y_end; yy++)
-            {
-                detectorMask[i].at<schar>(yy,xx)=1;
-            }
+            if(occupancy[cy*grid_cols+cx]) return false;
         }
     }
+    return true;
 }
 
-FeatureDEM::~FeatureDEM()
-{;}
+void FeatureDEM::occupy(const cv::Point2f& pt)
+{
+    int x = static_cast<int>(pt.x);
+    int y = static_cast<int>(pt.y);
+    if(x<0 || y<0 || x>=width || y>=height) return;
+    occupancy[(y/cell_size)*grid_cols+(x/cell_size)]=1;
+}
 
-void FeatureDEM::calHarrisR(const cv::Mat& img,
+//Harris response from the cached Scharr derivative (dx,dy) in a 3x3 window
+void FeatureDEM::calHarrisR(const cv::Mat& grad,
                             cv::Point2f& Pt,
                             float &R)
 {
-    uchar patch[9];
     int xx = Pt.x;
     int yy = Pt.y;
-    patch[0]=img.at<uchar>(cv::Point(xx-1,yy-1));
-    patch[1]=img.at<uchar>(cv::Point(xx,yy-1));
-    patch[2]=img.at<uchar>(cv::Point(xx+1,yy-1));
-    patch[3]=img.at<uchar>(cv::Point(xx-1,yy));
-    patch[4]=img.at<uchar>(cv::Point(xx,yy));
-    patch[5]=img.at<uchar>(cv::Point(xx+1,yy+1));
-    patch[6]=img.at<uchar>(cv::Point(xx-1,yy+1));
-    patch[7]=img.at<uchar>(cv::Point(xx,yy+1));
-    patch[8]=img.at<uchar>(cv::Point(xx+1,yy+1));
-    float IX,IY;
-    float X2,Y2;
-    float XY;
-    IX = (patch[0]+patch[3]+patch[6]-(patch[2]+patch[5]+patch[8]))/3;
-    IY = (patch[0]+patch[1]+patch[2]-(patch[6]+patch[7]+patch[8]))/3;
-    X2 = IX*IX;
-    Y2 = IY*IX;
-    XY = IX*IX;
+    float X2=0,Y2=0,XY=0;
+    for(int dy=-1; dy<=1; dy++)
+    {
+        const cv::Vec2s* row = grad.ptr<cv::Vec2s>(yy+dy);
+        for(int dx=-1; dx<=1; dx++)
+        {
+            float IX = row[xx+dx][0];
+            float IY = row[xx+dx][1];
+            X2 += IX*IX;
+            Y2 += IY*IY;
+            XY += IX*IY;
+        }
+    }
     //M = | X2  XY |
     //    | XY  Y2 |
     //R = det(M)-k(trace^2(M))
@@ -78,36 +113,78 @@ void FeatureDEM::calHarrisR(const cv::Mat& img,
 
 
 //Devided all features into 16 regions
-void FeatureDEM::fillIntoRegion(const cv::Mat& img, const vector<cv::Point2f>& pts,
-                                vector<pair<cv::Point2f,float>> (&region)[16], bool existed_features)
+void FeatureDEM::fillIntoRegion(const cv::Mat& grad, const vector<cv::Point2f>& pts,
+                                vector<pair<cv::Point2f,float>> (&region)[16])
 {
-    if(existed_features)
-    {//do not calculate harris value
-        for(size_t i=0; i<pts.size(); i++)
+    for(size_t i=0; i<pts.size(); i++)
+    {
+        cv::Point2f pt = pts.at(i);
+        if (pt.x>=10 && pt.x<(width-10) && pt.y>=10 && pt.y<(height-10))
         {
-            cv::Point2f pt = pts.at(i);
-            int regionNum= 4*floor(pt.y/regionHeight) + (pt.x/regionWidth);
-            region[regionNum].push_back(make_pair(pt,99999.0));
+            float Harris_R;
+            calHarrisR(grad,pt,Harris_R);
+            region[regionIdx(pt)].push_back(make_pair(pt,Harris_R));
         }
     }
-    else
+}
+
+
+//Detect corners inside the ROI of one region and score them
+void FeatureDEM::detectInRegion(const cv::Mat& img,
+                                const cv::Mat& grad,
+                                const int regionNum,
+                                vector<pair<cv::Point2f,float>>& candidates)
+{
+    candidates.clear();
+    int x_begin = (regionNum%4)*regionWidth;
+    int y_begin = (regionNum/4)*regionHeight;
+    int x_end   = ((regionNum%4)==3)?width:(x_begin+regionWidth);
+    int y_end   = ((regionNum/4)==3)?height:(y_begin+regionHeight);
+    //skip the 10 pixel image border as fillIntoRegion does
+    x_begin = std::max(x_begin,10);
+    y_begin = std::max(y_begin,10);
+    x_end   = std::min(x_end,width-10);
+    y_end   = std::min(y_end,height-10);
+    if(x_end-x_begin<=0 || y_end-y_begin<=0) return;
+    cv::Rect roi(x_begin,y_begin,x_end-x_begin,y_end-y_begin);
+    vector<cv::Point2f>  features;
+    detector->detect(img(roi), grad(roi), REGION_DETECT_CORNERS_NUM, features);
+    for(size_t i=0; i<features.size(); i++)
     {
-        for(size_t i=0; i<pts.size(); i++)
-        {
-            cv::Point2f pt = pts.at(i);
-            if (pt.x>=10 && pt.x<(width-10) && pt.y>=10 && pt.y<(height-10))
-            {
-                float Harris_R;
-                calHarrisR(img,pt,Harris_R);
-                int regionNum= 4*floor(pt.y/regionHeight) + (pt.x/regionWidth);
-                region[regionNum].push_back(make_pair(pt,Harris_R));
-            }
-        }
+        cv::Point2f pt(features.at(i).x+x_begin,features.at(i).y+y_begin);
+        float Harris_R;
+        calHarrisR(grad,pt,Harris_R);
+        candidates.push_back(make_pair(pt,Harris_R));
     }
+    sort(candidates.begin(), candidates.end(), sortbysecdesc);
 }
 
+//Run detectInRegion for every under-populated region in parallel
+class RegionDetectLoopBody : public cv::ParallelLoopBody
+{
+public:
+    RegionDetectLoopBody(FeatureDEM* dem, const cv::Mat& img, const cv::Mat& grad,
+                         const vector<int>& regions,
+                         vector<pair<cv::Point2f,float>> (&candidates)[16])
+        :dem(dem),img(img),grad(grad),regions(regions),candidates(candidates){}
+    virtual void operator()(const cv::Range& range) const
+    {
+        for(int i=range.start; i<range.end; i++)
+        {
+            int regionNum = regions.at(i);
+            dem->detectInRegion(img,grad,regionNum,candidates[regionNum]);
+        }
+    }
+private:
+    FeatureDEM*     dem;
+    const cv::Mat&  img;
+    const cv::Mat&  grad;
+    const vector<int>& regions;
+    vector<pair<cv::Point2f,float>> (&candidates)[16];
+};
 
 void FeatureDEM::redetect(const cv::Mat& img,
+                          const cv::Mat& grad,
                           const vector<Vec2>& existedPts,
                           vector<Vec2>& newPts,
                           int &newPtscount)
@@ -115,118 +192,82 @@ void FeatureDEM::redetect(const cv::Mat& img,
     //Clear
     newPts.clear();
     newPtscount=0;
-    vector<cv::Point2f> new_features;
-    new_features.clear();
 
-    //fill the existed features into region
-    vector<cv::Point2f> existedPts_cvP2f=vVec2_2_vcvP2f(existedPts);
-    for(int i=0; i<16; i++)
+    //mark the existed features in occupancy grid and count them per region
+    int regionCount[16] = {0};
+    resetOccupancy();
+    for(size_t i=0; i<existedPts.size(); i++)
     {
-        regionKeyPts[i].clear();
+        cv::Point2f pt(existedPts.at(i)[0],existedPts.at(i)[1]);
+        occupy(pt);
+        regionCount[regionIdx(pt)]++;
     }
-    fillIntoRegion(img,existedPts_cvP2f,regionKeyPts,true);
 
-    //extract features and fill into region
-    vector<cv::Point2f>  features;
-    cv::goodFeaturesToTrack(img, features, 500, 0.01, 10, cv::noArray());
-    vector<pair<cv::Point2f,float>> regionKeyPts_prepare[16];
+    //only the under-populated regions need detection
+    vector<int> regions;
     for(int i=0; i<16; i++)
     {
-        regionKeyPts_prepare[i].clear();
-    }
-    fillIntoRegion(img,features,regionKeyPts_prepare,false);
-
-    //pith up new features
-    for(size_t i=0; i<16; i++)
-    {
-        sort(regionKeyPts_prepare[i].begin(), regionKeyPts_prepare[i].end(), sortbysecdesc);
-        for(size_t j=0; j<regionKeyPts_prepare[i].size(); j++)
+        regionKeyPts[i].clear();
+        if(regionCount[i] < MIN_REGION_FREATURES_NUM)
         {
-            int noFeatureNearby = 1;
-            cv::Point pt=regionKeyPts_prepare[i].at(j).first;
-            for(size_t k=0; k<regionKeyPts[i].size(); k++)
-            {
-                float dis_x = fabs(pt.x-regionKeyPts[i].at(k).first.x);
-                float dis_y = fabs(pt.y-regionKeyPts[i].at(k).first.y);
-                if(dis_x <= boundary_dis || dis_y <= boundary_dis)
-                {
-                    noFeatureNearby=0;
-                }
-            }
-            if(noFeatureNearby)
-            {
-                regionKeyPts[i].push_back(make_pair(pt,999999.0));
-                new_features.push_back(pt);
-                if(regionKeyPts[i].size() >= MAX_REGION_FREATURES_NUM) break;
-            }
+            regions.push_back(i);
         }
     }
+    if(regions.empty()) return;
+
+    //extract features in those regions
+    TaskPool::instance().parallelFor(cv::Range(0,static_cast<int>(regions.size())),
+                                     RegionDetectLoopBody(this,img,grad,regions,regionKeyPts));
 
-    //output
-    if(new_features.size()>0)
+    //pick up new features, fill the region up to MAX_REGION_FREATURES_NUM
+    for(size_t r=0; r<regions.size(); r++)
     {
-        //    trackedLMDescriptors.push_back(zeroDescriptor);
-        for(size_t i=0; i<new_features.size(); i++)
+        int i = regions.at(r);
+        for(size_t j=0; j<regionKeyPts[i].size(); j++)
         {
-            newPts.push_back(Vec2(new_features.at(i).x,new_features.at(i).y));
+            if(regionCount[i] >= MAX_REGION_FREATURES_NUM) break;
+            cv::Point2f pt=regionKeyPts[i].at(j).first;
+            if(isFree(pt))
+            {
+                occupy(pt);
+                regionCount[i]++;
+                newPts.push_back(Vec2(pt.x,pt.y));
+            }
         }
     }
+    newPtscount = static_cast<int>(newPts.size());
 }
 
-void FeatureDEM::detect(const cv::Mat& img, vector<Vec2>& newPts)
+void FeatureDEM::detect(const cv::Mat& img, const cv::Mat& grad, vector<Vec2>& newPts)
 {
     //Clear
     newPts.clear();
 
     vector<cv::Point2f>  features;
-    cv::goodFeaturesToTrack(img,features,1000,0.01,10);
+    detector->detect(img,grad,1000,features);
     for(int i=0; i<16; i++)
     {
         regionKeyPts[i].clear();
     }
-    fillIntoRegion(img,features,regionKeyPts,false);
+    fillIntoRegion(grad,features,regionKeyPts);
     //For every region, select features by Harris index and boundary size
+    resetOccupancy();
     for(int i=0; i<16; i++)
     {
         sort(regionKeyPts[i].begin(), regionKeyPts[i].end(), sortbysecdesc);
-        vector<pair<cv::Point2f,float>> tmp = regionKeyPts[i];
-        regionKeyPts[i].clear();
         int count = 0;
-        for(size_t j=0; j<tmp.size(); j++)
+        for(size_t j=0; j<regionKeyPts[i].size(); j++)
         {
-            int outSideConflictBoundary = 1;
-            for(size_t k=0; k<regionKeyPts[i].size(); k++)
-            {
-                float dis_x = fabs(tmp.at(j).first.x-regionKeyPts[i].at(k).first.x);
-                float dis_y = fabs(tmp.at(j).first.y-regionKeyPts[i].at(k).first.y);
-                if(dis_x<=boundary_dis || dis_y<=boundary_dis)
-                {
-                    outSideConflictBoundary=0;
-                }
-            }
-            if(outSideConflictBoundary)
+            cv::Point2f pt=regionKeyPts[i].at(j).first;
+            if(isFree(pt))
             {
-                regionKeyPts[i].push_back(tmp.at(j));
+                occupy(pt);
+                newPts.push_back(Vec2(pt.x,pt.y));
                 count++;
                 if(count>=MAX_REGION_FREATURES_NUM) break;
             }
         }
     }
-    //output
-    features.clear();
-    for(int i=0; i<16; i++)
-    {
-        //cout << regionKeyPts[i].size() << "in Region " << i << endl;
-        for(size_t j=0; j<regionKeyPts[i].size(); j++)
-        {
-            features.push_back(regionKeyPts[i].at(j).first);
-        }
-    }
-    //    trackedLMDescriptors.push_back(zeroDescriptor);
-    for(size_t i=0; i<features.size(); i++)
-    {
-        newPts.push_back(Vec2(features.at(i).x,features.at(i).y));
-    }
 }
 
 
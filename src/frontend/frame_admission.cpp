@@ -0,0 +1,153 @@
+#include "include/frame_admission.h"
+
+static inline double elapsedMs(const std::chrono::steady_clock::time_point& t0,
+                               const std::chrono::steady_clock::time_point& t1)
+{
+    return std::chrono::duration<double,std::milli>(t1-t0).count();
+}
+
+FrameAdmission::FrameAdmission(ProcessCallback process_cb,
+                               BridgeCallback bridge_cb,
+                               const double max_age_ms,
+                               const bool pipelined)
+    : process_cb(process_cb),
+      bridge_cb(bridge_cb),
+      max_age_ms(max_age_ms),
+      pipelined(pipelined),
+      has_pending(false),
+      stopping(false),
+      last_time(-1),
+      received(0),
+      processed(0)
+{
+    for(int i=0; i<DROP_TYPES; i++) dropped[i] = 0;
+    worker = std::thread(&FrameAdmission::workerLoop,this);
+}
+
+FrameAdmission::~FrameAdmission()
+{
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        stopping = true;
+        cv_pending.notify_all();
+    }
+    worker.join();
+}
+
+void FrameAdmission::drop(const TYPEOFDROP type, const double time)
+{
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        dropped[type]++;
+    }
+    //an out of order pair is older than what the tracker already has, nothing to bridge
+    if(type!=DROP_OUT_OF_ORDER && bridge_cb) bridge_cb(time);
+}
+
+void FrameAdmission::push(const double time,
+                          const double age_ms,
+                          const cv::Mat& img0_in,
+                          const cv::Mat& img1_in,
+                          const boost::shared_ptr<const void> img0_holder,
+                          const boost::shared_ptr<const void> img1_holder)
+{
+    bool report = false;
+    double superseded_time = -1;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        received++;
+        report = (ADMISSION_REPORT_PERIOD>0 && (received%ADMISSION_REPORT_PERIOD)==0);
+        age.add(age_ms);
+    }
+    //STEP1: reject
+    if(time<=last_time)
+    {
+        drop(DROP_OUT_OF_ORDER,time);
+        if(report) printStats();
+        return;
+    }
+    if(max_age_ms>0 && age_ms>max_age_ms)
+    {
+        drop(DROP_TOO_OLD,time);
+        if(report) printStats();
+        return;
+    }
+    //STEP2: newest wins
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if(last_time>0) period.add((time-last_time)*1000.0);
+        last_time = time;
+        if(has_pending)
+        {
+            superseded_time = pending.time;
+            dropped[DROP_SUPERSEDED]++;
+        }
+        pending.time = time;
+        pending.img0 = img0_in;
+        pending.img1 = img1_in;
+        pending.holder[0] = img0_holder;
+        pending.holder[1] = img1_holder;
+        has_pending = true;
+        cv_pending.notify_one();
+    }
+    if(superseded_time>0 && bridge_cb) bridge_cb(superseded_time);
+    if(report) printStats();
+}
+
+void FrameAdmission::workerLoop(void)
+{
+    while(true)
+    {
+        AdmittedFrame frame;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            cv_pending.wait(lk,[this]{return stopping || has_pending;});
+            if(stopping) return;
+            std::swap(frame,pending);
+            has_pending = false;
+        }
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        process_cb(frame);
+        double ms = elapsedMs(t0,std::chrono::steady_clock::now());
+        frame = AdmittedFrame();//release the message buffers before waiting
+        std::lock_guard<std::mutex> lk(mtx);
+        service.add(ms);
+        processed++;
+    }
+}
+
+uint64_t FrameAdmission::getDropped(const TYPEOFDROP type)
+{
+    std::lock_guard<std::mutex> lk(mtx);
+    return dropped[type];
+}
+
+uint64_t FrameAdmission::getProcessed(void)
+{
+    std::lock_guard<std::mutex> lk(mtx);
+    return processed;
+}
+
+bool FrameAdmission::isBehind(void)
+{
+    std::lock_guard<std::mutex> lk(mtx);
+    return period.count>0 && service.count>0 && service.mean_ms>period.mean_ms;
+}
+
+void FrameAdmission::printStats(void)
+{
+    const char* names[DROP_TYPES] = {"superseded","too old","out of order"};
+    std::lock_guard<std::mutex> lk(mtx);
+    bool behind = period.count>0 && service.count>0 && service.mean_ms>period.mean_ms;
+    cout << "frame admission: " << received << " received, " << processed << " processed"
+         << (behind?" (behind the camera)":"") << endl;
+    cout << "  camera period/" << (pipelined?"stage A queue push":"service") << " time [ms] (mean): "
+         << period.mean_ms << "/" << service.mean_ms
+         << ", arrival age [ms] (mean/max): " << age.mean_ms << "/" << age.max_ms << endl;
+    cout << "  dropped:";
+    for(int i=0; i<DROP_TYPES; i++)
+    {
+        cout << " " << names[i] << " " << dropped[i];
+    }
+    cout << endl;
+}
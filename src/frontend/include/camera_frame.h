@@ -2,11 +2,32 @@
 #define CAMERAFRAME_H
 
 #include <include/landmark.h>
+#include <include/landmark_table.h>
 #include <include/common.h>
 #include <include/depth_camera.h>
 #include <include/triangulation.h>
+#include <include/klt_tracker.h>
+#include <include/stereo_matcher.h>
 #include <opencv2/opencv.hpp>
 #include <opencv2/video/tracking.hpp>
+#include <boost/shared_ptr.hpp>
+
+//Pyramid cache parameters
+//The img0 pyramid is built once per frame with cv::buildOpticalFlowPyramid and shared by
+//temporal LK (LKORBTracking) and FeatureDEM.
+//PYR_WIN_SIZE is the border of the pyramid levels, the KLT patches are smaller.
+#define PYR_WIN_SIZE             (31)
+#define PYR_MAX_LEVEL_IMG0       (20)
+
+//Inverse depth filter (depthInnovation)
+//New, unconverged and a rotating 1/DEPTH_REFRESH_PERIOD subset of converged landmarks
+//are measured (stereo), the measurement is fused in inverse depth.
+#define DEPTH_STEREO_DISPARITY_STD  (0.5) //pixel
+#define DEPTH_IMG_INV_DEPTH_STD     (0.01)//1/m, depth image error grows with z^2
+#define DEPTH_DUMMY_INV_DEPTH_STD   (1.0) //1/m, dummy depth of failed stereo matching
+#define DEPTH_CONVERGED_RATIO       (0.03)//std(inverse depth)/inverse depth
+#define DEPTH_GATE_SIGMA            (3.0)
+#define DEPTH_REFRESH_PERIOD        (16)
 
 class CameraFrame
 {
@@ -18,13 +39,17 @@ public:
     cv::Mat img0;
     cv::Mat img1;
     cv::Mat d_img;
-
+    //Holder of the message buffer referenced by img0/img1/d_img (zero-copy ingest)
+    boost::shared_ptr<const void> img_holder[2];
+    //Buffer pool, not released in clear(), the allocation is reused by the next frame
+    cv::Mat cvt_pool[2];//colour conversion output
+    cv::Mat rect_pool[2];//stereo rectification output
 
     int width;
     int height;
     DepthCamera  d_camera;
 
-    vector<LandMarkInFrame> landmarks;
+    LandMarkTable landmarks;
 
     //camera_pose
     SE3          T_c_w;//Transform from world to camera
@@ -37,13 +62,22 @@ public:
     CameraFrame();
     void clear();
 
+    //Pyramid and gradient cache (lazily built, released in clear())
+    const vector<cv::Mat>& getImg0Pyr(void);
+    cv::Mat getImg0Grad(void);//CV_16SC2 Scharr derivative (dx,dy) of img0 at level 0
+
     void calReprjInlierOutlier(double &mean_prjerr, vector<Vec2> &outlier, double sh_over_med = 3.0);
     void eraseReprjOutlier();
     void updateLMT_c_w();
-    void recover3DPts_c_FromDepthImg(vector<Vec3>& pt3ds,
-                                     vector<bool>& maskHas3DInf);
-    void recover3DPts_c_FromStereo(vector<Vec3>& pt3ds,
-                                   vector<bool>& maskHas3DInf);
+    //to_measure: slots to be measured, inv_depth_var: variance of the measured inverse depth
+    void recover3DPts_c_FromDepthImg(const vector<unsigned char>& to_measure,
+                                     vector<Vec3>& pt3ds,
+                                     vector<bool>& maskHas3DInf,
+                                     vector<double>& inv_depth_var);
+    void recover3DPts_c_FromStereo(const vector<unsigned char>& to_measure,
+                                   vector<Vec3>& pt3ds,
+                                   vector<bool>& maskHas3DInf,
+                                   vector<double>& inv_depth_var);
     void recover3DPts_c_FromTriangulation(vector<Vec3>& pt3ds,
                                           vector<bool>& maskHas3DInf);
     void depthInnovation(void);
@@ -57,22 +91,17 @@ public:
     //IO
     int  validLMCount(void);
     void getValid2d3dPair_cvPf(vector<cv::Point2f>& p2d,vector<cv::Point3f>& p3d);
-    void getValidInliersPair(vector<LandMarkInFrame> &lms);
-    void unpack(vector<Vec2>& pt2d,
-                vector<cv::Mat> & descriptors,
-                vector<Vec3>& pt3d,
-                vector<unsigned char>& mask3d);
+    LandMarkView getValidInliersView(void);
     void getKeyFrameInf(vector<int64_t>& lm_id, vector<Vec2>& lm_2d, vector<Vec3>& lm_3d);
 
 
     vector<cv::Point2f> get2dPtsVec_cvP2f(void);
-    vector<cv::Point3f> get3dPtsVec_cvP3f(void);
-    vector<Vec2> get2dPtsVec(void);
-    vector<Vec3> get3dPtsVec(void);
+    const vector<Vec2>& get2dPtsVec(void);
+    const vector<Vec3>& get3dPtsVec(void);
     vector<Vec3> getValid3dPts(void);
 
 private:
-
+    vector<cv::Mat> img0_pyr;//[img,deriv,img,deriv...] layout from buildOpticalFlowPyramid
 
 };
 
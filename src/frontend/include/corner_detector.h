@@ -0,0 +1,59 @@
+#ifndef CORNER_DETECTOR_H
+#define CORNER_DETECTOR_H
+
+#include <include/common.h>
+
+/* Corner detector backends of FeatureDEM
+ *  GFTT: cv::goodFeaturesToTrack (min eigen value over the whole ROI)
+ *  FAST: FAST-9 segment test (AVX2/NEON/scalar), Shi-Tomasi score on the FAST candidates,
+ *        grid non-max suppression, keep the strongest corners
+ * */
+
+enum TYPEOFDETECTOR{GFTT_DETECTOR,
+                    FAST_DETECTOR};
+
+#define DETECTOR_QUALITY_LEVEL   (0.01)
+#define DETECTOR_MIN_DISTANCE    (10)
+#define FAST_THRESHOLD           (20)
+#define SHI_TOMASI_RADIUS        (3)//7x7 window
+
+//detect() must be reentrant, FeatureDEM calls it from several threads at the same time
+class CornerDetector
+{
+public:
+    typedef std::shared_ptr<CornerDetector> Ptr;
+    virtual ~CornerDetector(){}
+    //img : CV_8UC1 image (or ROI of it)
+    //grad: CV_16SC2 (dx,dy) derivative with the same size/ROI as img
+    //corners are in img coordinates, sorted by strength (descending)
+    virtual void detect(const cv::Mat& img,
+                        const cv::Mat& grad,
+                        const int maxCorners,
+                        vector<cv::Point2f>& corners) = 0;
+    static Ptr create(const TYPEOFDETECTOR type);
+};
+
+class GFTTCornerDetector : public CornerDetector
+{
+public:
+    virtual void detect(const cv::Mat& img,
+                        const cv::Mat& grad,
+                        const int maxCorners,
+                        vector<cv::Point2f>& corners);
+};
+
+class FASTCornerDetector : public CornerDetector
+{
+public:
+    FASTCornerDetector(int threshold=FAST_THRESHOLD,
+                       int nms_cell_size=DETECTOR_MIN_DISTANCE);
+    virtual void detect(const cv::Mat& img,
+                        const cv::Mat& grad,
+                        const int maxCorners,
+                        vector<cv::Point2f>& corners);
+private:
+    int threshold;
+    int nms_cell_size;
+};
+
+#endif // CORNER_DETECTOR_H
@@ -8,6 +8,10 @@
 #include "include/keyframe_msg.h"
 #include "include/correction_inf_msg.h"
 #include "include/optimize_in_frame.h"
+#include "include/prior_pnp.h"
+#include "include/stereo_preprocess.h"
+#include "include/latest_mailbox.h"
+#include <unordered_map>
 
 using namespace std::chrono;
 using namespace cv;
@@ -16,8 +20,10 @@ enum TRACKINGSTATE{UnInit,
                    Tracking,
                    TrackingFail};
 
+#define POSE_RECORDS_SIZE  (1000)
+
 struct ID_POSE {
-    int    frame_id;
+    int64_t frame_id;
     SE3    T_c_w;
 };
 
@@ -28,11 +34,12 @@ public:
     //Modules
     FeatureDEM         *feature_dem;
     LKORBTracking      *lkorb_tracker;
+    PriorPnP           *prior_pnp;
     VIMOTION           *vimotion;
+    StereoPreprocess   *stereo_preprocess;
 
     //states:
     bool has_imu;
-    bool has_localmap_feedback;
     int  frameCount;
     enum TRACKINGSTATE   vo_tracking_state;
 
@@ -42,12 +49,15 @@ public:
     cv::Mat D0_rect;//cam0 rectified distCoeffs;
     cv::Mat K1_rect;//cam1 rectified cameraMatrix;
     cv::Mat D1_rect;//cam1 rectified distCoeffs;
-    cv::Mat c0_RM[2];
+    cv::Mat c0_RM[2];//fixed-point rectify map CV_16SC2 + CV_16UC1
     cv::Mat c1_RM[2];
 
-    CorrectionInfStruct correction_inf;
+    //latest local map correction, filled by the callback thread, taken at STEP1
+    LatestMailbox<CorrectionInfStruct> correction_mailbox;
     SE3 T_c_w_last_keyframe;
     deque<ID_POSE> pose_records;
+    unordered_map<int64_t,uint64_t> pose_record_index;//frame_id -> logical index
+    uint64_t pose_records_base;//logical index of pose_records.front()
     CameraFrame::Ptr curr_frame,last_frame;
 
     void imu_feed(const double time,
@@ -57,13 +67,32 @@ public:
                   Vec3& pos_w_i,
                   Vec3& vel_w_i);
 
+    //img0_holder/img1_holder: owner of the buffer behind img0_in/img1_in (e.g. cv_bridge::CvImageConstPtr),
+    //kept by curr_frame when the image is referenced without copy
     void image_feed(const double time,
-                    const cv::Mat img0_in,
-                    const cv::Mat img1_in,
+                    const cv::Mat& img0_in,
+                    const cv::Mat& img1_in,
                     bool &new_keyframe,
-                    bool &reset_cmd);
+                    bool &reset_cmd,
+                    const boost::shared_ptr<const void> img0_holder=boost::shared_ptr<const void>(),
+                    const boost::shared_ptr<const void> img1_holder=boost::shared_ptr<const void>());
+
+    //Stages of image_feed, image_feed runs them in sequence, TrackingPipeline runs them
+    //on separate threads. The output (curr_frame, flags) is the same in both cases.
+    //A: gray conversion, rectify/equalize and pyramid of frame (does not touch the tracking state)
+    void preprocess(CameraFrame::Ptr frame,
+                    const double time,
+                    const cv::Mat& img0_in,
+                    const cv::Mat& img1_in,
+                    const boost::shared_ptr<const void> img0_holder=boost::shared_ptr<const void>(),
+                    const boost::shared_ptr<const void> img1_holder=boost::shared_ptr<const void>());
+    //B: frame becomes curr_frame, state machine up to PnP/BA, return true if stage C is required
+    bool trackFrame(CameraFrame::Ptr frame, bool &new_keyframe, bool &reset_cmd);
+    //C: redetect, depth innovation, pose record and keyframe switch of curr_frame
+    void updateMap(bool &new_keyframe);
 
-    void correction_feed(const double time, const CorrectionInfStruct corr);
+    //callback thread, unpacks into the mailbox and returns (never waits for the tracking thread)
+    void correction_feed(const flvis::CorrectionInfConstPtr& msg);
 
     void init(const int w, const int h,
               const Mat c0_cameraMatrix_in,
@@ -78,6 +107,8 @@ public:
 
 private:
     bool init_frame(void);
+    void recordPose(const CameraFrame::Ptr& frame);
+    void applyCorrection(const CorrectionInfStruct& corr);
 
 };//class F2FTracking
 
@@ -2,6 +2,7 @@
 #define FEATUREDEM_H
 
 #include <include/common.h>
+#include <include/corner_detector.h>
 #include <iostream>
 #include <utility>
 
@@ -21,13 +22,19 @@
  *  //Detect FAST features
  *  //Devided all features into 16 regions
  *  //For every region, select features by Harris index and boundary size
+ *  //Boundary conflicts are checked against an occupancy grid (cell_size x cell_size pixels per cell),
+ *    the cells overlapped by the boundary box of a candidate must all be free
+ *  //Redetect only runs the detector inside regions with less than MIN_REGION_FREATURES_NUM
+ *    features (in parallel), then fills them up to MAX_REGION_FREATURES_NUM
  * */
 
 #define MAX_REGION_FREATURES_NUM (30)
 #define MIN_REGION_FREATURES_NUM (20)
+#define REGION_DETECT_CORNERS_NUM (40)
 
 
 #define BOUNDARYBOXSIZE          (5)
+#define OCCUPANCY_CELL_SIZE      (5)
 
 
 using namespace std;
@@ -40,10 +47,16 @@ public:
 
   FeatureDEM(const int image_width,
              const int image_height,
-             int boundaryBoxSize=BOUNDARYBOXSIZE);
+             int boundaryBoxSize=BOUNDARYBOXSIZE,
+             int occupancyCellSize=OCCUPANCY_CELL_SIZE);
   ~FeatureDEM();
 
+  //select the corner detector backend (GFTT by default)
+  void setDetectorBackend(const TYPEOFDETECTOR type);
+
+  //grad: CV_16SC2 (dx,dy) derivative of img, see CameraFrame::getImg0Grad()
   void detect(const cv::Mat& img,
+              const cv::Mat& grad,
               vector<Vec2>& newPts);
 
 //  void detect_conventional(const cv::Mat& img,
@@ -51,25 +64,42 @@ public:
 //              vector<cv::Mat>& descriptors);
 
   void redetect(const cv::Mat& img,
+                const cv::Mat& grad,
                 const vector<Vec2>& existedPts,
                 vector<Vec2>& newPts,
                 int &newKeyPtscount);
 
 private:
+  friend class RegionDetectLoopBody;
+  CornerDetector::Ptr detector;
   int width;
   int height;
   int regionWidth;
   int regionHeight;
   int boundary_dis;
   vector<pair<cv::Point2f,float>> regionKeyPts[16];
-  cv::Mat detectorMask[16];
+  //occupancy grid
+  int cell_size;
+  int grid_cols;
+  int grid_rows;
+  vector<uchar> occupancy;
+
+  int  regionIdx(const cv::Point2f& pt);
+  void resetOccupancy(void);
+  void boxCells(const cv::Point2f& pt, int& cx0, int& cy0, int& cx1, int& cy1);
+  bool isFree(const cv::Point2f& pt);
+  void occupy(const cv::Point2f& pt);
 
-  void calHarrisR(const cv::Mat& img, cv::Point2f& Pt, float &R);
+  void calHarrisR(const cv::Mat& grad, cv::Point2f& Pt, float &R);
 
-  void fillIntoRegion(const cv::Mat& img,
+  void fillIntoRegion(const cv::Mat& grad,
                       const vector<cv::Point2f>& pts,
-                      vector<pair<cv::Point2f,float>> (&region)[16],
-                      bool  existed_features);
+                      vector<pair<cv::Point2f,float>> (&region)[16]);
+
+  void detectInRegion(const cv::Mat& img,
+                      const cv::Mat& grad,
+                      const int regionNum,
+                      vector<pair<cv::Point2f,float>>& candidates);
 
 
 
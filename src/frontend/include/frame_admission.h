@@ -0,0 +1,93 @@
+#ifndef FRAME_ADMISSION_H
+#define FRAME_ADMISSION_H
+
+#include "include/tracking_pipeline.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+/* Latency aware admission of the synchronized image pairs (newest frame wins)
+ *  //push() (image callback) never waits for the tracking, the pair goes to a one slot mailbox,
+ *    a pair that is still waiting is replaced by the newer one (dropped: superseded)
+ *  //The admission thread takes the newest pair and runs the process callback
+ *    (image_feed or TrackingPipeline::push), so the tracker is always on the freshest image
+ *  //Service time (one process call) is measured against the camera period (stamp interval),
+ *    service > period means the tracker is behind and frames are skipped
+ *  //pipelined: the process call is only the push into the stage A queue of TrackingPipeline,
+ *    the service time is then the queue push (it only grows once the queue is full, i.e.
+ *    the slowest stage is behind), see TrackingPipeline::printLatency for the stage times
+ *  //Pairs older than max_age_ms on arrival (transport latency) are dropped: too old,
+ *    out of order stamps are dropped: out of order
+ *  //The bridge callback is called with the time of every dropped pair (push thread),
+ *    the nodelet publishes the IMU propagated pose there
+ * */
+
+#define ADMISSION_NO_MAX_AGE     (0)
+#define ADMISSION_REPORT_PERIOD  (300)//frames, 0: no report
+
+enum TYPEOFDROP{DROP_SUPERSEDED=0,
+                DROP_TOO_OLD,
+                DROP_OUT_OF_ORDER,
+                DROP_TYPES};
+
+struct AdmittedFrame
+{
+    double  time;
+    cv::Mat img0, img1;
+    boost::shared_ptr<const void> holder[2];
+};
+
+class FrameAdmission
+{
+public:
+    typedef std::function<void(const AdmittedFrame& frame)> ProcessCallback;
+    typedef std::function<void(const double time)> BridgeCallback;
+
+    FrameAdmission(ProcessCallback process_cb,
+                   BridgeCallback bridge_cb,
+                   const double max_age_ms=ADMISSION_NO_MAX_AGE,
+                   const bool pipelined=false);
+    ~FrameAdmission();
+
+    //age_ms: receive time - stamp of the pair
+    void push(const double time,
+              const double age_ms,
+              const cv::Mat& img0_in,
+              const cv::Mat& img1_in,
+              const boost::shared_ptr<const void> img0_holder=boost::shared_ptr<const void>(),
+              const boost::shared_ptr<const void> img1_holder=boost::shared_ptr<const void>());
+
+    uint64_t getDropped(const TYPEOFDROP type);
+    uint64_t getProcessed(void);
+    bool     isBehind(void);
+    void     printStats(void);
+
+private:
+    ProcessCallback process_cb;
+    BridgeCallback  bridge_cb;
+    double          max_age_ms;
+    bool            pipelined;
+
+    std::mutex              mtx;
+    std::condition_variable cv_pending;
+    AdmittedFrame           pending;
+    bool                    has_pending;
+    bool                    stopping;
+    //stats, under mtx
+    double       last_time;//last stamp accepted by push
+    StageLatency period;//stamp interval of the accepted pairs
+    StageLatency service;//one process call (stage A queue push if pipelined)
+    StageLatency age;//transport latency on arrival
+    uint64_t     received;
+    uint64_t     processed;
+    uint64_t     dropped[DROP_TYPES];
+
+    std::thread worker;
+
+    void workerLoop(void);
+    void drop(const TYPEOFDROP type, const double time);
+};
+
+#endif // FRAME_ADMISSION_H
@@ -0,0 +1,67 @@
+#ifndef KLT_TRACKER_H
+#define KLT_TRACKER_H
+
+#include <include/common.h>
+#include <opencv2/opencv.hpp>
+
+/* Sparse pyramidal KLT tracker (inverse compositional, translation only)
+ *  //Stand-in for cv::calcOpticalFlowPyrLK on the pyramids of cv::buildOpticalFlowPyramid
+ *    (with or without derivatives, see CameraFrame::getImg0Pyr())
+ *  //The template patch (PxP int16, intensity<<5) and its gradient are sampled once per
+ *    feature per level, the Hessian is constant during the iterations
+ *  //Each iteration resamples the target patch (fixed point bilinear) and sums the
+ *    steepest descent images with int16 SIMD (AVX2/SSE2/NEON, scalar fallback)
+ *  //Early exit once the update is smaller than eps
+ *  //Optional forward-backward check: track back and reject points whose round trip
+ *    error is larger than fb_threshold
+ * */
+
+#define KLT_PATCH_SIZE           (12)
+#define KLT_MAX_PATCH_SIZE       (16)
+#define KLT_MAX_ITER             (30)
+#define KLT_EPS                  (0.01)
+#define KLT_MIN_EIG_THRESHOLD    (1e-4)
+#define KLT_FB_THRESHOLD         (1.0)
+
+class KLTTracker
+{
+public:
+    KLTTracker(int max_iter=KLT_MAX_ITER,
+               double eps=KLT_EPS);
+    void setForwardBackwardCheck(const bool enable,
+                                 const double threshold=KLT_FB_THRESHOLD);
+    //patch_size: multiple of 4, up to KLT_MAX_PATCH_SIZE
+    //status: 1 tracked, 0 lost
+    void track(const vector<cv::Mat>& from_pyr,
+               const vector<cv::Mat>& to_pyr,
+               const vector<cv::Point2f>& from_pts,
+               vector<cv::Point2f>& to_pts,
+               vector<unsigned char>& status,
+               const int patch_size=KLT_PATCH_SIZE,
+               const int max_level=3,
+               const bool use_initial_flow=false);
+
+private:
+    friend class KLTLoopBody;
+    int    max_iter;
+    float  eps;
+    bool   fb_check;
+    float  fb_threshold;
+
+    void trackPoint(const vector<cv::Mat>& from_pyr,
+                    const vector<cv::Mat>& to_pyr,
+                    const int patch_size,
+                    const int max_level,
+                    const cv::Point2f& from_pt,
+                    cv::Point2f& to_pt,
+                    unsigned char& status);
+    void trackBatch(const vector<cv::Mat>& from_pyr,
+                    const vector<cv::Mat>& to_pyr,
+                    const vector<cv::Point2f>& from_pts,
+                    vector<cv::Point2f>& to_pts,
+                    vector<unsigned char>& status,
+                    const int patch_size,
+                    const int max_level);
+};
+
+#endif // KLT_TRACKER_H
@@ -0,0 +1,89 @@
+#ifndef LANDMARK_TABLE_H
+#define LANDMARK_TABLE_H
+
+#include "include/landmark.h"
+#include "include/common.h"
+#include <unordered_map>
+
+/* Landmarks of one frame as a struct of arrays
+ *  //Slot i of every column belongs to the same landmark
+ *  //Hot columns (lm_2d, lm_3d_w, flags) are contiguous, the first observation
+ *    (only used by triangulation) is kept in cold columns
+ *  //Inverse depth filter state (CameraFrame::depthInnovation): the mean is the depth of
+ *    lm_3d_w in the current camera, the variance and converged flag are kept per slot
+ *  //lm_id -> slot lookup by hash (find)
+ *  //Columns may be read and written element-wise, the number of slots is only
+ *    changed by push_back/append/keep/clear
+ * */
+
+class LandMarkTable;
+
+//Filtered view, holds the slots of the table that passed the filter (no element copy)
+class LandMarkView
+{
+public:
+    LandMarkView();
+    explicit LandMarkView(const LandMarkTable* table);
+    size_t size(void) const {return slots.size();}
+    bool   empty(void) const {return slots.empty();}
+    int    slot(const size_t k) const {return slots[k];}
+    int64_t     lm_id(const size_t k) const;
+    const Vec2& lm_2d(const size_t k) const;
+    const Vec3& lm_3d_w(const size_t k) const;
+    const Vec3& lm_3d_c(const size_t k) const;
+
+    vector<int> slots;
+private:
+    const LandMarkTable* table;
+};
+
+class LandMarkTable
+{
+public:
+    //hot columns
+    vector<int64_t>       lm_id;
+    vector<Vec2>          lm_2d;
+    vector<Vec3>          lm_3d_w;
+    vector<Vec3>          lm_3d_c;      //land mark 3d in camera frame
+    vector<unsigned char> has_3d;
+    vector<unsigned char> is_belong_to_kf;
+    vector<unsigned char> is_tracking_inlier;
+    vector<double>        inv_depth_var;//variance of the inverse depth, <0 no depth state
+    vector<unsigned char> depth_converged;
+    //cold columns (for triangulation only)
+    vector<Vec2>          lm_1st_obs_2d;
+    vector<SE3>           lm_1st_obs_frame_pose;
+
+    LandMarkTable();
+    size_t size(void)  const {return lm_id.size();}
+    bool   empty(void) const {return lm_id.empty();}
+    void   clear(void);
+    void   reserve(const size_t n);
+
+    void push_back(const LandMarkInFrame& lm);
+    //append slot src_slot of another table
+    void append(const LandMarkTable& src, const int src_slot);
+    //keep the slots with keep_mask[i]!=0 (order preserved)
+    //keep_mask may be a column of this table (is_tracking_inlier): the compaction only
+    //writes slots that were already read
+    void keep(const vector<unsigned char>& keep_mask);
+    //slot of lm_id, -1 if not in the table
+    int  find(const int64_t id) const;
+
+    bool hasDepthInf(const int slot) const {return has_3d[slot]!=0;}
+    bool isValid(const int slot) const {return has_3d[slot]!=0 && is_tracking_inlier[slot]!=0;}
+
+    //has depth information (and is tracking inlier)
+    LandMarkView validView(const bool inlier_only=true) const;
+
+private:
+    unordered_map<int64_t,int> id_to_slot;
+    void rebuildIndex(void);
+};
+
+inline int64_t     LandMarkView::lm_id(const size_t k)   const {return table->lm_id[slots[k]];}
+inline const Vec2& LandMarkView::lm_2d(const size_t k)   const {return table->lm_2d[slots[k]];}
+inline const Vec3& LandMarkView::lm_3d_w(const size_t k) const {return table->lm_3d_w[slots[k]];}
+inline const Vec3& LandMarkView::lm_3d_c(const size_t k) const {return table->lm_3d_c[slots[k]];}
+
+#endif // LANDMARK_TABLE_H
@@ -0,0 +1,56 @@
+#ifndef LATEST_MAILBOX_H
+#define LATEST_MAILBOX_H
+
+#include <atomic>
+#include <stdint.h>
+
+/* Single slot mailbox holding the latest item (one producer thread, one consumer thread)
+ *  //Triple buffer: the producer fills its back buffer and swaps it with the middle one,
+ *    the consumer swaps its front buffer with the middle one if it holds a fresh item
+ *  //Both sides are wait-free (one atomic exchange), no lock is shared with the consumer
+ *  //An item not taken yet is replaced by the newer one (counted in overwritten())
+ *  //Buffers are reused, containers inside T keep their capacity
+ * */
+
+#define MAILBOX_FRESH       (0x4)
+#define MAILBOX_INDEX_MASK  (0x3)
+
+template<typename T>
+class LatestMailbox
+{
+public:
+    LatestMailbox() : middle(1), back(0), front(2), published_cnt(0), overwritten_cnt(0) {}
+
+    //producer: fill writeBuffer(), then publish()
+    T& writeBuffer(void) {return buf[back];}
+    void publish(void)
+    {
+        uint8_t prev = middle.exchange(static_cast<uint8_t>(back|MAILBOX_FRESH),std::memory_order_acq_rel);
+        back = prev&MAILBOX_INDEX_MASK;
+        published_cnt.fetch_add(1,std::memory_order_relaxed);
+        if(prev&MAILBOX_FRESH) overwritten_cnt.fetch_add(1,std::memory_order_relaxed);
+    }
+
+    //consumer: the item stays valid until the next take()
+    bool take(T*& item)
+    {
+        if(!(middle.load(std::memory_order_relaxed)&MAILBOX_FRESH)) return false;
+        uint8_t prev = middle.exchange(front,std::memory_order_acq_rel);
+        front = prev&MAILBOX_INDEX_MASK;
+        item = &buf[front];
+        return true;
+    }
+
+    uint64_t published(void)   const {return published_cnt.load(std::memory_order_relaxed);}
+    uint64_t overwritten(void) const {return overwritten_cnt.load(std::memory_order_relaxed);}
+
+private:
+    T buf[3];
+    std::atomic<uint8_t>  middle;//index|MAILBOX_FRESH
+    uint8_t               back;//producer only
+    uint8_t               front;//consumer only
+    std::atomic<uint64_t> published_cnt;
+    std::atomic<uint64_t> overwritten_cnt;
+};
+
+#endif // LATEST_MAILBOX_H
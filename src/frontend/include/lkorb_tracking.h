@@ -4,17 +4,39 @@
 //Lucas-Kanade tracking with ORB feature verify
 
 #include "camera_frame.h"
+#include "klt_tracker.h"
+
+//Motion prediction (IMU) for the initial flow
+//Landmarks with depth are projected with lm_3d_w and the predicted pose,
+//the others are rotated by the predicted delta rotation (infinite homography).
+//With a prediction only the residual motion has to be searched: the patch size and the
+//pyramid depth are chosen from the predicted flow, points lost with the reduced search
+//are tracked again with the full search (KLT_PATCH_SIZE, PYR_MAX_LEVEL_IMG0, no initial flow).
+#define LK_PRED_WIN_SIZE_SMALL       (8)
+#define LK_PRED_WIN_SIZE             (12)
+#define LK_PRED_RESIDUAL_BASE        (3.0)//pixel
+#define LK_PRED_RESIDUAL_RATIO       (0.3)//residual/predicted flow
+#define LK_FORWARD_BACKWARD_CHECK    (false)
 
 class LKORBTracking
 {
     int width,height;
+    KLTTracker klt;
 public:
     LKORBTracking(int width_in,int height_in);
     bool tracking(CameraFrame &from,
                   CameraFrame &to,
                   vector<Vec2>& lm2d_from,
                   vector<Vec2>& lm2d_to,
-                  vector<Vec2>& outlier);
+                  vector<Vec2>& outlier,
+                  const bool has_prediction=false,
+                  const SE3 T_c_w_pred=SE3());
+private:
+    void predict(CameraFrame &from,
+                 const SE3 &T_c_w_pred,
+                 const vector<cv::Point2f>& from_cvP2f,
+                 vector<cv::Point2f>& pred_cvP2f,
+                 double& median_flow);
 };
 
 #endif // F2FTRACKING_H
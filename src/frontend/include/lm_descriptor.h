@@ -0,0 +1,35 @@
+#ifndef LM_DESCRIPTOR_H
+#define LM_DESCRIPTOR_H
+
+#include <include/common.h>
+
+/* ORB descriptors of the keyframe landmarks (for loop closing)
+ *  //Computed at the tracked 2D positions, no detection: a descriptor belongs to a landmark
+ *    (id, 3D) and the backend can match and verify without extracting features again
+ *  //Orientation by intensity centroid (as ORB detect does), one pyramid level
+ *  //Points closer than LM_DESC_EDGE to the border get no descriptor, index tells which point
+ *    every row belongs to
+ *  //Not thread safe (one extractor per thread)
+ * */
+
+#define LM_DESC_BYTES       (32)
+#define LM_DESC_PATCH_SIZE  (31)
+#define LM_DESC_HALF_PATCH  (15)
+#define LM_DESC_EDGE        (31)
+
+class LMDescriptorExtractor
+{
+public:
+    LMDescriptorExtractor();
+    //img: CV_8UC1, descriptors: n x LM_DESC_BYTES CV_8UC1, index: point of every row (ascending)
+    void compute(const cv::Mat& img,
+                 const vector<Vec2>& pts,
+                 cv::Mat& descriptors,
+                 vector<int>& index);
+private:
+    cv::Ptr<cv::ORB> orb;
+    vector<int>      umax;//half width of the circular patch per row
+    float icAngle(const cv::Mat& img, const int x, const int y) const;
+};
+
+#endif // LM_DESCRIPTOR_H
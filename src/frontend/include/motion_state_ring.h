@@ -0,0 +1,94 @@
+#ifndef MOTION_STATE_RING_H
+#define MOTION_STATE_RING_H
+
+#include <include/common.h>
+#include <include/imu_state.h>
+#include <atomic>
+#include <vector>
+
+struct MOTION_STATE{
+    Vec3 pos;
+    Vec3 vel;
+    Quaterniond q_w_i;//rotation of imu in world frame
+    IMUSTATE imu_data;
+};
+
+/* Time indexed ring of the propagated IMU states (VIMOTION)
+ *  //Single producer (the IMU thread), any number of lock-free readers
+ *  //Every slot is a seqlock: the writer makes the sequence odd, writes, makes it even,
+ *    a reader copies the slot and retries if the sequence was odd or has changed
+ *  //States are numbered by a logical index, head is the index of the next push,
+ *    a slot also stores its index so a reader can tell that it has been overwritten
+ *  //find(): binary search on the timestamps, O(log n)
+ *  //interpolate(): linear pos/vel, slerp orientation between the two samples around t
+ * */
+
+#define STATE_RING_READ_RETRY  (8)
+
+class MotionStateRing
+{
+public:
+    MotionStateRing();
+    //only while the producer is not running
+    void init(const int capacity);
+    int  capacity(void) const {return static_cast<int>(slots.size());}
+
+    //producer
+    void push(const MOTION_STATE& state);
+    void reset(const MOTION_STATE& state);//the ring only holds state afterwards
+    const MOTION_STATE& back(void) const {return latest;}//no lock, writer side copy
+    size_t size(void) const;
+    //rewrite the states with timestamp>=time, f(state) returns the new state
+    template<typename F>
+    void updateFrom(const double time, F f)
+    {
+        uint64_t lo, hi;
+        bounds(lo,hi);
+        for(uint64_t k=lo; k<hi; k++)
+        {
+            Slot& s = slots[k%slots.size()];
+            if(s.rec.t<time) continue;//writer reads its own slots without the seqlock
+            MOTION_STATE state = unpack(s.rec);
+            f(state);
+            write(k,state);
+            if(k+1==hi) latest = state;
+        }
+    }
+
+    //readers
+    bool latestState(MOTION_STATE& state) const;
+    //s0.t <= time <= s1.t, s0==s1 if time is after the latest state, false if before the oldest
+    bool find(const double time, MOTION_STATE& s0, MOTION_STATE& s1) const;
+    bool interpolate(const double time, MOTION_STATE& state) const;
+    static MOTION_STATE lerp(const MOTION_STATE& s0, const MOTION_STATE& s1, const double time);
+
+private:
+    struct Record{
+        uint64_t index;
+        double   t;
+        double   pos[3];
+        double   vel[3];
+        double   q[4];//w x y z
+        double   acc[3];
+        double   gyro[3];
+    };
+    struct Slot{
+        std::atomic<uint32_t> seq;
+        Record rec;
+        Slot() : seq(0) {}
+        Slot(const Slot& other) : seq(0), rec(other.rec) {}
+        Slot& operator=(const Slot& other) {seq.store(0); rec = other.rec; return *this;}
+    };
+    std::vector<Slot>     slots;
+    std::atomic<uint64_t> head;//next index
+    std::atomic<uint64_t> tail;//first index after the last reset
+    MOTION_STATE          latest;
+
+    static Record       pack(const uint64_t index, const MOTION_STATE& state);
+    static MOTION_STATE unpack(const Record& rec);
+    void write(const uint64_t index, const MOTION_STATE& state);
+    bool read(const uint64_t index, Record& rec) const;
+    void bounds(uint64_t& lo, uint64_t& hi) const;
+};
+
+#endif // MOTION_STATE_RING_H
@@ -24,11 +24,60 @@
 
 #include "include/camera_frame.h"
 
+/* Motion-only pose refinement of one frame (fixed landmarks)
+ *  //MotionOnlyPoseSolver: Levenberg-Marquardt on a single SE3 with 6x6 normal equations,
+ *    Huber weighted reprojection error, same update/damping strategy as the previous
+ *    g2o graph (VertexSE3Expmap + EdgeSE3ProjectXYZ + RobustKernelHuber)
+ *    -> optimize 2 iterations, drop edges with chi2>3, optimize 2 iterations
+ *  //The landmark columns are copied into SoA buffers which are reused between frames
+ *  //IN_FRAME_OPT_USE_G2O=1 switches back to the g2o graph
+ *  //IN_FRAME_OPT_COMPARE_G2O=1 (A/B check): every frame is also solved by the g2o graph from the
+ *    same initial pose, the max rotation/translation difference of the two results is reported
+ *    every IN_FRAME_OPT_COMPARE_REPORT frames (the frame keeps the result of the solver)
+ * */
+#define IN_FRAME_OPT_USE_G2O       (0)
+#define IN_FRAME_OPT_COMPARE_G2O   (0)
+#define IN_FRAME_OPT_COMPARE_REPORT (100)//frames
+#define IN_FRAME_OPT_MIN_LM_NUM    (10)
+#define IN_FRAME_OPT_ITERATIONS    (2)
+#define IN_FRAME_OPT_HUBER_DELTA   (1.0)
+#define IN_FRAME_OPT_CHI2_TH       (3.0)
+
+class MotionOnlyPoseSolver
+{
+public:
+    MotionOnlyPoseSolver();
+    //copy the valid (has depth and tracking inlier) landmarks, return the count
+    int  setProblem(const LandMarkTable& lms,
+                    const double fx, const double fy,
+                    const double cx, const double cy);
+    //Levenberg-Marquardt iterations on T_c_w
+    void solve(SE3& T_c_w, const int iterations);
+    //deactivate the observations with chi2 > chi2_th, return the number of active ones
+    int  rejectChi2Outlier(const SE3& T_c_w, const double chi2_th);
+    //map the active flags back to the slots of the table
+    void markOutlier(LandMarkTable& lms);
+
+private:
+    int    n;
+    double fx,fy,cx,cy;
+    vector<int>    slot;
+    vector<double> pw_x,pw_y,pw_z;
+    vector<double> obs_u,obs_v;
+    vector<unsigned char> active;
+    double robustChi2(const SE3& T_c_w);
+    void   buildNormalEquation(const SE3& T_c_w, Mat6x6& H, Vec6& b);
+};
+
 class OptimizeInFrame
 {
 public:
     OptimizeInFrame();
-    static void optimize(CameraFrame &frame);
+    //mark_outlier: set is_tracking_inlier=false for the chi2 outliers of the first pass
+    static void optimize(CameraFrame &frame, const bool mark_outlier=false);
+    static void optimize_g2o(CameraFrame &frame);
+private:
+    static void reportG2ODelta(const SE3 &T_c_w_g2o, const SE3 &T_c_w_solver);
 };
 
 #endif // BUNDLEADJUSTMENT_H
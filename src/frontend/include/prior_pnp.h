@@ -0,0 +1,62 @@
+#ifndef PRIOR_PNP_H
+#define PRIOR_PNP_H
+
+#include <include/common.h>
+#include <random>
+
+/* PnP with motion prior (IMU predicted pose)
+ *  //1: the predicted pose explains most points -> no RANSAC, take the prior
+ *  //2: rotation of the prior is trusted -> 2-point RANSAC on the translation only,
+ *       adaptive number of iterations, hypotheses are scored with early bail-out
+ *       (stop counting once the hypothesis can not beat the best one)
+ *  //3: otherwise (or no prior / distorted image) -> cv::solvePnPRansac as before
+ * */
+
+#define PNP_REPROJ_THRESHOLD          (3.0)//pixel
+#define PNP_CONFIDENCE                (0.99)
+#define PNP_MAX_ITERATIONS            (100)
+#define PNP_PRIOR_ACCEPT_RATIO        (0.8)//inlier ratio of the prior to skip RANSAC
+#define PNP_TRANSLATION_MIN_RATIO     (0.5)//inlier ratio to accept the translation only solution
+
+enum TYPEOFPNPRESULT{PNP_FROM_PRIOR,
+                     PNP_TRANSLATION_ONLY,
+                     PNP_FULL_RANSAC};
+
+class PriorPnP
+{
+public:
+    PriorPnP();
+    //p2d: pixels of the camera K/D, status: 1 inlier 0 outlier
+    TYPEOFPNPRESULT solve(const vector<cv::Point3f>& p3d,
+                          const vector<cv::Point2f>& p2d,
+                          const cv::Mat& K,
+                          const cv::Mat& D,
+                          const SE3& T_c_w_guess,
+                          const bool has_prior,
+                          const SE3& T_c_w_prior,
+                          SE3& T_c_w,
+                          vector<uchar>& status);
+private:
+    std::mt19937 rng;
+    double fx,fy,cx,cy;
+    double th_sq;
+    vector<Vec3> q;    //R*p_w of the hypothesis rotation
+    vector<Vec2> uv;   //observation
+    vector<Vec2> xy;   //normalized observation
+
+    void setRotation(const vector<cv::Point3f>& p3d, const Mat3x3& R);
+    //count the inliers of (R,t), stop once best_cnt can not be reached
+    int  countInliers(const Vec3& t, const int best_cnt, vector<uchar>* status);
+    //least squares translation from the selected points (R fixed)
+    bool solveTranslation(const int* idx, const int n, Vec3& t);
+    bool solveTranslation(const vector<uchar>& status, Vec3& t);
+    void fullRansac(const vector<cv::Point3f>& p3d,
+                    const vector<cv::Point2f>& p2d,
+                    const cv::Mat& K,
+                    const cv::Mat& D,
+                    const SE3& T_c_w_guess,
+                    SE3& T_c_w,
+                    vector<uchar>& status);
+};
+
+#endif // PRIOR_PNP_H
@@ -0,0 +1,69 @@
+#ifndef STEREO_MATCHER_H
+#define STEREO_MATCHER_H
+
+#include <include/common.h>
+#include <opencv2/opencv.hpp>
+
+/* Sparse scanline stereo matcher for rectified image pairs
+ *  //After stereoRectify the match of (u,v) in img0 is (u-d,v) in img1, the disparity d
+ *    is searched along the row inside the range given by the depth limits
+ *  //Cost: SAD of a 16x8 block (one SSE2/NEON register per row, scalar fallback)
+ *  //With a disparity prior (e.g. reprojection of a known landmark) only a narrow band
+ *    around the prior is searched, the full range is used if the band has no minimum
+ *  //Uniqueness test against the second best (non adjacent) disparity
+ *  //Left-right check: the block found in img1 is matched back to img0
+ *  //Sub-pixel disparity by parabola fit of the three costs around the minimum
+ * */
+
+#define STEREO_BLOCK_W             (16)
+#define STEREO_BLOCK_H             (8)
+#define STEREO_MIN_DEPTH           (0.2)
+#define STEREO_MAX_DEPTH           (25.0)
+#define STEREO_MAX_DISPARITY       (192)
+#define STEREO_PRIOR_BAND          (6)//+-pixel around the disparity prior
+#define STEREO_MAX_MEAN_SAD        (24)//per pixel
+#define STEREO_UNIQUENESS_RATIO    (10)//percent
+#define STEREO_LR_THRESHOLD        (1)//pixel
+
+//match status of a point, FAR: the minimum is at d_min (beyond max_depth), no depth but
+//not a failure (the caller must not treat it as a point too close to the camera)
+enum TYPEOFSTEREOMATCH{STEREO_MATCH_FAIL=0,
+                       STEREO_MATCH_OK=1,
+                       STEREO_MATCH_FAR=2};
+
+class StereoMatcher
+{
+public:
+    //P0/P1: projection matrices from stereoRectify (rectified cam0/cam1)
+    StereoMatcher(const Mat3x4& P0, const Mat3x4& P1,
+                  const double min_depth=STEREO_MIN_DEPTH,
+                  const double max_depth=STEREO_MAX_DEPTH);
+
+    //img0/img1: rectified CV_8UC1
+    //disparity_prior: optional (empty, or <0 for no prior)
+    //pts1: (u-d,v) of the matched points, status: TYPEOFSTEREOMATCH
+    void match(const cv::Mat& img0,
+               const cv::Mat& img1,
+               const vector<Vec2>& pts0,
+               const vector<double>& disparity_prior,
+               vector<Vec2>& pts1,
+               vector<unsigned char>& status) const;
+
+    //closed form depth of a rectified pair
+    double depthFromDisparity(const double d) const {return fb/(d-dcx);}
+
+private:
+    friend class StereoMatchLoopBody;
+    double fb; //P0(0,3)-P1(0,3) = focal*baseline
+    double dcx;//P0(0,2)-P1(0,2) disparity offset (0 with CALIB_ZERO_DISPARITY)
+    int    d_min;
+    int    d_max;
+
+    TYPEOFSTEREOMATCH matchPoint(const cv::Mat& img0,
+                                 const cv::Mat& img1,
+                                 const Vec2& pt0,
+                                 const double d_prior,
+                                 double& d) const;
+};
+
+#endif // STEREO_MATCHER_H
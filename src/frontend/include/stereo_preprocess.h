@@ -0,0 +1,37 @@
+#ifndef STEREO_PREPROCESS_H
+#define STEREO_PREPROCESS_H
+
+#include <include/common.h>
+
+/* Stereo preprocessing stage (rectify + histogram equalize)
+ *  //Both eyes are processed in parallel
+ *  //Histogram is sampled from a sparse grid of the raw image
+ *  //Remap (fixed-point CV_16SC2 maps) and LUT equalization are fused per row band,
+ *    the band is equalized while it is still in cache
+ * */
+
+#define PREPROCESS_HIST_GRID_STEP (2)
+#define PREPROCESS_BAND_ROWS      (16)
+
+class StereoPreprocess
+{
+public:
+    //c0_RM/c1_RM: maps from cv::initUndistortRectifyMap(...,CV_16SC2,...)
+    StereoPreprocess(const cv::Mat (&c0_RM)[2],
+                     const cv::Mat (&c1_RM)[2],
+                     int hist_grid_step=PREPROCESS_HIST_GRID_STEP);
+
+    void process(const cv::Mat& img0_in,
+                 const cv::Mat& img1_in,
+                 cv::Mat& img0_out,
+                 cv::Mat& img1_out);
+
+    static void calEqualizeLUT(const cv::Mat& img, int grid_step, cv::Mat& lut);
+
+private:
+    cv::Mat map1[2];//CV_16SC2 integer coordinates
+    cv::Mat map2[2];//CV_16UC1 interpolation table index
+    int     grid_step;
+};
+
+#endif // STEREO_PREPROCESS_H
@@ -0,0 +1,93 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <opencv2/opencv.hpp>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <exception>
+
+/* Process-wide work-stealing task pool for the data-parallel kernels of the frontend
+ *  //parallelFor() has the semantics of cv::parallel_for_ (range split into nstripes chunks),
+ *    existing cv::ParallelLoopBody classes can be submitted unchanged
+ *  //Chunks are dealt round-robin into per-worker deques, a worker pops its own deque from
+ *    the back and steals from the front of the others when it runs dry
+ *  //The submitting thread executes chunks too until its loop is done, nested loops and
+ *    loops submitted by several threads at once (TrackingPipeline stages) share the workers
+ *  //Size: workers besides the submitting thread(s), 0 runs every loop inline.
+ *    autoSize() leaves the cores of the other busy threads of the process (tracking
+ *    pipeline stages, backend nodelets) free, instead of one thread per core per module
+ *  //Optional CPU pinning of the workers (linux)
+ * */
+
+#define TASK_POOL_AUTO_SIZE        (-1)
+#define TASK_POOL_NO_PINNING       (-1)
+#define TASK_POOL_STRIPES_PER_CPU  (4)//default chunk count per thread (load balancing)
+
+class TaskPool
+{
+public:
+    static TaskPool& instance(void);
+
+    //(re)start the workers, only call it while no loop is running
+    //threads: TASK_POOL_AUTO_SIZE or number of workers
+    //first_cpu: worker i is pinned to cpu (first_cpu+i)%cpus, TASK_POOL_NO_PINNING: no pinning
+    void configure(const int threads, const int first_cpu=TASK_POOL_NO_PINNING);
+    //cores minus the threads that are busy besides the pool workers
+    static int autoSize(const int busy_threads=1);
+    int  size(void) const {return static_cast<int>(workers.size());}
+
+    //nstripes<=0: TASK_POOL_STRIPES_PER_CPU chunks per thread
+    //exceptions of the body are rethrown in the submitting thread
+    void parallelFor(const cv::Range& range,
+                     const cv::ParallelLoopBody& body,
+                     const double nstripes=-1);
+    void parallelFor(const cv::Range& range,
+                     const std::function<void(const cv::Range&)>& func,
+                     const double nstripes=-1);
+
+    ~TaskPool();
+
+private:
+    struct Group{
+        std::atomic<int>        pending;
+        std::mutex              mtx;
+        std::condition_variable done;
+        std::exception_ptr      error;
+        Group() : pending(0) {}
+    };
+    struct Task{
+        const cv::ParallelLoopBody* body;
+        cv::Range range;
+        Group*    group;
+    };
+    struct Worker{
+        std::mutex       mtx;
+        std::deque<Task> tasks;
+        std::thread      thread;
+    };
+
+    TaskPool();
+    TaskPool(const TaskPool&);
+    TaskPool& operator=(const TaskPool&);
+
+    std::vector<Worker*> workers;
+    std::atomic<unsigned> next_worker;//round-robin start of the next loop
+    //sleeping workers
+    std::mutex              sleep_mtx;
+    std::condition_variable wake;
+    std::atomic<int>        queued;//tasks in the deques
+    bool                    stopping;
+
+    void start(const int threads, const int first_cpu);
+    void stop(void);
+    void workerLoop(const int id, const int cpu);
+    bool tryPop(const int id, Task& task);//id<0: submitting thread, steal only
+    void run(const Task& task);
+};
+
+#endif // TASK_POOL_H
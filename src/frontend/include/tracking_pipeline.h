@@ -0,0 +1,158 @@
+#ifndef TRACKING_PIPELINE_H
+#define TRACKING_PIPELINE_H
+
+#include "include/f2f_tracking.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <chrono>
+
+/* Pipelined executor of F2FTracking (three stages, one thread each)
+ *  //A: preprocess (gray/rectify/equalize/pyramid) of frame k+1, overlaps B and C of frame k
+ *  //B: trackFrame (LK/PnP/BA) of frame k, the pose callback is called here
+ *  //C: updateMap (redetect/depth innovation/keyframe) of frame k, then the frame callback,
+ *       B of frame k+1 starts after C of frame k (it tracks the new landmarks)
+ *  //Stages are connected by bounded queues, push() blocks when the input queue is full
+ *  //Frames are taken from a pool, a frame is reused once no one holds it
+ *    (tracker curr/last, queues, callbacks)
+ *  //Latency of every stage, of the pose output and end-to-end (push -> frame callback)
+ * */
+
+#define PIPELINE_QUEUE_SIZE     (2)
+#define PIPELINE_REPORT_PERIOD  (300)//frames, 0: no report
+
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+    //block while full, return false if closed
+    bool push(const T& item)
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        not_full.wait(lk,[this]{return closed || q.size()<capacity;});
+        if(closed) return false;
+        q.push_back(item);
+        not_empty.notify_one();
+        return true;
+    }
+    //block while empty, return false if closed (pending items are dropped)
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lk(mtx);
+        not_empty.wait(lk,[this]{return closed || !q.empty();});
+        if(closed) return false;
+        item = q.front();
+        q.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+    void close(void)
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+private:
+    size_t capacity;
+    bool closed;
+    std::deque<T> q;
+    std::mutex mtx;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
+
+struct StageLatency
+{
+    double   last_ms;
+    double   mean_ms;//exponential moving average
+    double   max_ms;
+    uint64_t count;
+    StageLatency() : last_ms(0), mean_ms(0), max_ms(0), count(0) {}
+    void add(const double ms);
+};
+
+enum TYPEOFLATENCY{LATENCY_PREPROCESS=0,
+                   LATENCY_TRACKING,
+                   LATENCY_MAPPING,
+                   LATENCY_POSE_OUTPUT,
+                   LATENCY_END_TO_END,
+                   LATENCY_TYPES};
+
+class TrackingPipeline
+{
+public:
+    //pose_cb:  stage B, pose of curr_frame is known (landmarks are not yet updated)
+    //frame_cb: stage C, curr_frame is complete (same state as after F2FTracking::image_feed)
+    //time is the time of the input image
+    typedef std::function<void(const CameraFrame::Ptr& frame, const double time)> PoseCallback;
+    typedef std::function<void(const CameraFrame::Ptr& frame, const double time,
+                               const bool new_keyframe, const bool reset_cmd)> FrameCallback;
+
+    TrackingPipeline(F2FTracking* tracker,
+                     PoseCallback pose_cb,
+                     FrameCallback frame_cb,
+                     const int queue_size=PIPELINE_QUEUE_SIZE);
+    ~TrackingPipeline();
+
+    void push(const double time,
+              const cv::Mat& img0_in,
+              const cv::Mat& img1_in,
+              const boost::shared_ptr<const void> img0_holder=boost::shared_ptr<const void>(),
+              const boost::shared_ptr<const void> img1_holder=boost::shared_ptr<const void>());
+
+    StageLatency getLatency(const TYPEOFLATENCY type);
+    void printLatency(void);
+
+private:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    struct InputJob{
+        double    time;
+        cv::Mat   img0, img1;
+        boost::shared_ptr<const void> holder[2];
+        TimePoint t_in;
+    };
+    struct FrameJob{
+        CameraFrame::Ptr frame;
+        double    time;
+        TimePoint t_in;
+        bool      need_map_update;
+        bool      new_keyframe;
+        bool      reset_cmd;
+        double    tracking_ms;
+    };
+
+    F2FTracking*  tracker;
+    PoseCallback  pose_cb;
+    FrameCallback frame_cb;
+
+    BoundedQueue<InputJob> input_queue;
+    BoundedQueue<FrameJob> preprocessed_queue;
+    BoundedQueue<FrameJob> tracked_queue;
+
+    //B waits for C of the previous frame
+    std::mutex              map_mtx;
+    std::condition_variable map_cv;
+    bool                    map_pending;
+    bool                    stopping;
+
+    //frame pool (stage A only)
+    vector<CameraFrame::Ptr> pool;
+    CameraFrame::Ptr         frame_template;
+    CameraFrame::Ptr acquireFrame(void);
+    CameraFrame::Ptr newFrame(void);
+
+    std::mutex   latency_mtx;
+    StageLatency latency[LATENCY_TYPES];
+    void addLatency(const TYPEOFLATENCY type, const double ms);
+
+    std::thread thread_a, thread_b, thread_c;
+    void stagePreprocess(void);
+    void stageTracking(void);
+    void stageMapping(void);
+};
+
+#endif // TRACKING_PIPELINE_H
@@ -18,14 +18,31 @@ public:
                                           Mat3x3 c0Matrix, Mat3x3 c1Matrix,
                                           SE3 T_c1_c0,
                                           Vec3 &pt3d_c);
-    static bool trignaulationPtFromStereo(Vec2 pt0, Vec2 pt1,
-                                          Mat3x4 P0, Mat3x4 P1,
-                                          Vec3 &pt3d_c);
     static Vec3 triangulationPt(Vec2 pt1,
                                 Vec2 pt2,
                                 Mat3x4 projection_matrix1,
                                 Mat3x4 projection_matrix2);
     static Vec2 reProjection(Vec3 pt, SE3 T_c_w, double fx, double fy, double cx, double cy);
+
+    //Batched versions (one call per frame)
+    //pts1/pts2 observed from T_c_w1/T_c_w2 with the same intrinsics, midpoint of the two rays
+    //status: 1 in front of camera 1 and depth in camera 2 inside [min_depth,max_depth]
+    static void triangulationPts(const vector<Vec2>& pts1,
+                                 const vector<Vec2>& pts2,
+                                 const SE3& T_c_w1,
+                                 const SE3& T_c_w2,
+                                 double fx, double fy, double cx, double cy,
+                                 double min_depth, double max_depth,
+                                 vector<Vec3>& pts3d_w,
+                                 vector<unsigned char>& status);
+    //rectified stereo (P0/P1 from stereoRectify), pts3d_c in cam0
+    static void trignaulationPtsFromStereo(const vector<Vec2>& pts0,
+                                           const vector<Vec2>& pts1,
+                                           const Mat3x4& P0,
+                                           const Mat3x4& P1,
+                                           double min_depth, double max_depth,
+                                           vector<Vec3>& pts3d_c,
+                                           vector<unsigned char>& status);
 };
 
 #endif // TRIANGULATION_H
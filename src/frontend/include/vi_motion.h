@@ -4,16 +4,33 @@
 #include <include/common.h>
 #include <include/imu_state.h>
 #include <include/kinetic_math.h>
-#include <deque>
+#include <include/motion_state_ring.h>
 #include <mutex>
+#include <atomic>
 
-#define STATES_QUEUE_SIZE          (400)
+#define STATES_QUEUE_SIZE          (400)//default capacity of the state ring
 
-struct MOTION_STATE{
-    Vec3 pos;
-    Vec3 vel;
-    Quaterniond q_w_i;//rotation of imu in world frame
-    IMUSTATE imu_data;
+/* States and threads
+ *  //The IMU thread is the only writer of the state ring (initialization/propagation)
+ *  //The image thread reads the ring lock-free (interpolated at the frame time),
+ *    the vision trigger (reset) and the vision correction are posted as requests and
+ *    applied by the IMU thread before its next propagation, it never waits for them
+ * */
+
+//correction of the states after a vision pose (viCorrectionFromVision)
+struct VISION_CORRECTION{
+    double      t_vel;   //vel += dv for the states from t_vel
+    Vec3        dv;
+    double      t_pose;  //pose = [R|t]_diff*pose for the states from t_pose
+    Quaterniond q_diff;
+    Vec3        t_diff;
+};
+
+//one bias feedback step per viCorrectionFromVision call (zero estimates if there was no correction),
+//all are applied in order, a newer pose correction does not drop them
+struct BIAS_FEEDBACK{
+    Vec3        acc_bias_est;
+    Vec3        gyro_bias_est;
 };
 
 class VIMOTION
@@ -29,11 +46,10 @@ public:
     Vec3 acc_bias;
     Vec3 gyro_bias;
     Vec3 gravity;
-    std::deque<MOTION_STATE> states;
-    std::mutex mtx_states_RW;
+    MotionStateRing states;
 
     MOTION_STATE init_state;
-    bool imu_initialized;
+    std::atomic<bool> imu_initialized;
 
     bool is_first_data;
 
@@ -43,6 +59,8 @@ public:
              double para_2_in = 0.05,  //proportion of vision feedforware(roll and pich)
              double para_3_in = 0.01,  //acc-bias feedback parameter
              double para_4_in = 0.01); //gyro-bias feedback parameter
+    //capacity of the state ring, call it before the first IMU data
+    void setStatesCapacity(const int capacity);
 
     void viIMUinitialization(const IMUSTATE imu_read,
                              Quaterniond& q_w_i,
@@ -59,15 +77,29 @@ public:
     void viVisionRPCompensation(const double time, SE3& T_c_w);
     void viGetLatestImuState(SE3& T_w_i, Vec3& vel);//latest imu state in queue
     bool viGetCorrFrameState(const double time, SE3& T_c_w);//get correspond frame time
+    //camera pose interpolated at a time, false without any output if the time is not in the ring
+    //(called for every dropped frame)
+    bool viGetCamPoseAtTime(const double time, SE3& T_w_c);
+    //camera motion between two frame times from the propagated states (T_cto_cfrom)
+    bool viGetRelativeCamMotion(const double t_from, const double t_to, SE3& T_cto_cfrom);
 
     void viCorrectionFromVision(const double t_curr, const SE3 Tcw_curr,
                                 const double t_last, const SE3 Tcw_last);
     bool viGetIMURollPitchAtTime(const double time, double& roll, double& pitch);
 
 private:
+    //requests of the image thread, applied by the IMU thread
+    std::mutex         mtx_request;
+    std::atomic<bool>  has_request;
+    bool               has_reset;
+    MOTION_STATE       reset_state;
+    bool               has_correction;
+    VISION_CORRECTION  correction;
+    vector<BIAS_FEEDBACK> bias_feedback;
+    void postBiasFeedback(const Vec3& acc_bias_est, const Vec3& gyro_bias_est);
+    void applyRequests(void);
 
-    bool viFindStateIdx(const double time, int& idx_in_q);
-
+    bool viFindState(const double time, MOTION_STATE& state);
 
 };
 
@@ -0,0 +1,365 @@
+#include "include/klt_tracker.h"
+#include "include/task_pool.h"
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#define KLT_W_BITS   (14)//bilinear weight precision
+#define KLT_SHIFT    (KLT_W_BITS-5)//patch values are intensity<<5
+
+//[img,deriv,img,deriv...] or [img,img...]
+static inline int pyrStep(const vector<cv::Mat>& pyr)
+{
+    return (pyr.size()>1 && pyr.at(1).type()==CV_16SC2)?2:1;
+}
+
+//the w x h patch at (x,y) plus the right/bottom bilinear neighbour is inside img
+static inline bool patchInside(const cv::Mat& img, const float x, const float y, const int w, const int h)
+{
+    int ix = cvFloor(x);
+    int iy = cvFloor(y);
+    return (ix>=0 && iy>=0 && (ix+w)<img.cols && (iy+h)<img.rows);
+}
+
+//bilinear sampling of a w x h patch with top-left at (x,y), out = intensity<<5
+static void samplePatch(const cv::Mat& img, const float x, const float y,
+                        const int w, const int h, short* out)
+{
+    int ix = cvFloor(x);
+    int iy = cvFloor(y);
+    float ax = x-ix;
+    float ay = y-iy;
+    int iw00 = cvRound((1.f-ax)*(1.f-ay)*(1<<KLT_W_BITS));
+    int iw01 = cvRound(ax*(1.f-ay)*(1<<KLT_W_BITS));
+    int iw10 = cvRound((1.f-ax)*ay*(1<<KLT_W_BITS));
+    int iw11 = (1<<KLT_W_BITS)-iw00-iw01-iw10;
+    const size_t step = img.step;
+#if defined(__SSE2__)
+    const __m128i z   = _mm_setzero_si128();
+    const __m128i w0  = _mm_set1_epi32((iw01<<16)|(iw00&0xffff));
+    const __m128i w1  = _mm_set1_epi32((iw11<<16)|(iw10&0xffff));
+    const __m128i rnd = _mm_set1_epi32(1<<(KLT_SHIFT-1));
+#endif
+    for(int r=0; r<h; r++)
+    {
+        const unsigned char* s0 = img.ptr<unsigned char>(iy+r)+ix;
+        const unsigned char* s1 = s0+step;
+        short* d = out+r*w;
+        int c=0;
+#if defined(__SSE2__)
+        for(; c+8<=w; c+=8)
+        {
+            __m128i p00 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s0+c)),z);
+            __m128i p01 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s0+c+1)),z);
+            __m128i p10 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s1+c)),z);
+            __m128i p11 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(s1+c+1)),z);
+            __m128i t0 = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(p00,p01),w0),
+                                       _mm_madd_epi16(_mm_unpacklo_epi16(p10,p11),w1));
+            __m128i t1 = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(p00,p01),w0),
+                                       _mm_madd_epi16(_mm_unpackhi_epi16(p10,p11),w1));
+            t0 = _mm_srai_epi32(_mm_add_epi32(t0,rnd),KLT_SHIFT);
+            t1 = _mm_srai_epi32(_mm_add_epi32(t1,rnd),KLT_SHIFT);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(d+c),_mm_packs_epi32(t0,t1));
+        }
+        for(; c+4<=w; c+=4)
+        {
+            int v00,v01,v10,v11;
+            memcpy(&v00,s0+c,4);
+            memcpy(&v01,s0+c+1,4);
+            memcpy(&v10,s1+c,4);
+            memcpy(&v11,s1+c+1,4);
+            __m128i p00 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v00),z);
+            __m128i p01 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v01),z);
+            __m128i p10 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v10),z);
+            __m128i p11 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v11),z);
+            __m128i t0 = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(p00,p01),w0),
+                                       _mm_madd_epi16(_mm_unpacklo_epi16(p10,p11),w1));
+            t0 = _mm_srai_epi32(_mm_add_epi32(t0,rnd),KLT_SHIFT);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(d+c),_mm_packs_epi32(t0,t0));
+        }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        for(; c+8<=w; c+=8)
+        {
+            //signed accumulation, iw11 can be -1 when both offsets are tiny
+            int16x8_t p00 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(s0+c)));
+            int16x8_t p01 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(s0+c+1)));
+            int16x8_t p10 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(s1+c)));
+            int16x8_t p11 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(s1+c+1)));
+            int32x4_t t0 = vmull_n_s16(vget_low_s16(p00),static_cast<int16_t>(iw00));
+            t0 = vmlal_n_s16(t0,vget_low_s16(p01),static_cast<int16_t>(iw01));
+            t0 = vmlal_n_s16(t0,vget_low_s16(p10),static_cast<int16_t>(iw10));
+            t0 = vmlal_n_s16(t0,vget_low_s16(p11),static_cast<int16_t>(iw11));
+            int32x4_t t1 = vmull_n_s16(vget_high_s16(p00),static_cast<int16_t>(iw00));
+            t1 = vmlal_n_s16(t1,vget_high_s16(p01),static_cast<int16_t>(iw01));
+            t1 = vmlal_n_s16(t1,vget_high_s16(p10),static_cast<int16_t>(iw10));
+            t1 = vmlal_n_s16(t1,vget_high_s16(p11),static_cast<int16_t>(iw11));
+            vst1q_s16(d+c,vcombine_s16(vrshrn_n_s32(t0,KLT_SHIFT),vrshrn_n_s32(t1,KLT_SHIFT)));
+        }
+#endif
+        for(; c<w; c++)
+        {
+            int v = s0[c]*iw00+s0[c+1]*iw01+s1[c]*iw10+s1[c+1]*iw11;
+            d[c] = static_cast<short>((v+(1<<(KLT_SHIFT-1)))>>KLT_SHIFT);
+        }
+    }
+}
+
+//b = sum(grad*(J-T)), n is a multiple of 16
+static inline void steepestDescent(const short* T, const short* Tx, const short* Ty, const short* J,
+                                   const int n, int& bx, int& by)
+{
+    int i=0;
+    bx=0;
+    by=0;
+#if defined(__AVX2__)
+    __m256i ax = _mm256_setzero_si256();
+    __m256i ay = _mm256_setzero_si256();
+    for(; i+16<=n; i+=16)
+    {
+        __m256i d = _mm256_sub_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(J+i)),
+                                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(T+i)));
+        ax = _mm256_add_epi32(ax,_mm256_madd_epi16(d,_mm256_loadu_si256(reinterpret_cast<const __m256i*>(Tx+i))));
+        ay = _mm256_add_epi32(ay,_mm256_madd_epi16(d,_mm256_loadu_si256(reinterpret_cast<const __m256i*>(Ty+i))));
+    }
+    int buf[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf),ax);
+    for(int k=0; k<8; k++) bx+=buf[k];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf),ay);
+    for(int k=0; k<8; k++) by+=buf[k];
+#elif defined(__SSE2__)
+    __m128i ax = _mm_setzero_si128();
+    __m128i ay = _mm_setzero_si128();
+    for(; i+8<=n; i+=8)
+    {
+        __m128i d = _mm_sub_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(J+i)),
+                                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(T+i)));
+        ax = _mm_add_epi32(ax,_mm_madd_epi16(d,_mm_loadu_si128(reinterpret_cast<const __m128i*>(Tx+i))));
+        ay = _mm_add_epi32(ay,_mm_madd_epi16(d,_mm_loadu_si128(reinterpret_cast<const __m128i*>(Ty+i))));
+    }
+    int buf[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(buf),ax);
+    bx = buf[0]+buf[1]+buf[2]+buf[3];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(buf),ay);
+    by = buf[0]+buf[1]+buf[2]+buf[3];
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    int32x4_t ax = vdupq_n_s32(0);
+    int32x4_t ay = vdupq_n_s32(0);
+    for(; i+8<=n; i+=8)
+    {
+        int16x8_t d  = vsubq_s16(vld1q_s16(J+i),vld1q_s16(T+i));
+        int16x8_t gx = vld1q_s16(Tx+i);
+        int16x8_t gy = vld1q_s16(Ty+i);
+        ax = vmlal_s16(ax,vget_low_s16(d),vget_low_s16(gx));
+        ax = vmlal_s16(ax,vget_high_s16(d),vget_high_s16(gx));
+        ay = vmlal_s16(ay,vget_low_s16(d),vget_low_s16(gy));
+        ay = vmlal_s16(ay,vget_high_s16(d),vget_high_s16(gy));
+    }
+    int buf[4];
+    vst1q_s32(buf,ax);
+    bx = buf[0]+buf[1]+buf[2]+buf[3];
+    vst1q_s32(buf,ay);
+    by = buf[0]+buf[1]+buf[2]+buf[3];
+#endif
+    for(; i<n; i++)
+    {
+        int d = J[i]-T[i];
+        bx += d*Tx[i];
+        by += d*Ty[i];
+    }
+}
+
+//Split the features into batches, one batch per job
+class KLTLoopBody : public cv::ParallelLoopBody
+{
+public:
+    KLTLoopBody(KLTTracker* tracker,
+                const vector<cv::Mat>& from_pyr, const vector<cv::Mat>& to_pyr,
+                const vector<cv::Point2f>& from_pts, vector<cv::Point2f>& to_pts,
+                vector<unsigned char>& status,
+                const int patch_size, const int max_level)
+        : tracker(tracker), from_pyr(from_pyr), to_pyr(to_pyr),
+          from_pts(from_pts), to_pts(to_pts), status(status),
+          patch_size(patch_size), max_level(max_level) {}
+    virtual void operator()(const cv::Range& range) const
+    {
+        for(int i=range.start; i<range.end; i++)
+        {
+            tracker->trackPoint(from_pyr,to_pyr,patch_size,max_level,
+                                from_pts.at(i),to_pts.at(i),status.at(i));
+        }
+    }
+private:
+    KLTTracker* tracker;
+    const vector<cv::Mat>& from_pyr;
+    const vector<cv::Mat>& to_pyr;
+    const vector<cv::Point2f>& from_pts;
+    vector<cv::Point2f>& to_pts;
+    vector<unsigned char>& status;
+    int patch_size;
+    int max_level;
+};
+
+KLTTracker::KLTTracker(int max_iter, double eps)
+{
+    this->max_iter = (max_iter<1)?1:max_iter;
+    this->eps = static_cast<float>(eps);
+    this->fb_check = false;
+    this->fb_threshold = static_cast<float>(KLT_FB_THRESHOLD);
+}
+
+void KLTTracker::setForwardBackwardCheck(const bool enable, const double threshold)
+{
+    this->fb_check = enable;
+    this->fb_threshold = static_cast<float>(threshold);
+}
+
+void KLTTracker::trackPoint(const vector<cv::Mat>& from_pyr,
+                            const vector<cv::Mat>& to_pyr,
+                            const int patch_size,
+                            const int max_level,
+                            const cv::Point2f& from_pt,
+                            cv::Point2f& to_pt,
+                            unsigned char& status)
+{
+    const int P  = patch_size;
+    const int N  = P*P;
+    const int PB = P+2;//template with one pixel border for the gradient
+    const float half = (P-1)*0.5f;
+    const int from_step = pyrStep(from_pyr);
+    const int to_step   = pyrStep(to_pyr);
+    short buf[(KLT_MAX_PATCH_SIZE+2)*(KLT_MAX_PATCH_SIZE+2)];
+    short T[KLT_MAX_PATCH_SIZE*KLT_MAX_PATCH_SIZE];
+    short Tx[KLT_MAX_PATCH_SIZE*KLT_MAX_PATCH_SIZE];
+    short Ty[KLT_MAX_PATCH_SIZE*KLT_MAX_PATCH_SIZE];
+    short J[KLT_MAX_PATCH_SIZE*KLT_MAX_PATCH_SIZE];
+
+    status = 1;
+    cv::Point2f next_pt = to_pt*(1.f/(1<<max_level));
+    for(int level=max_level; level>=0; level--)
+    {
+        if(level!=max_level) next_pt *= 2.f;
+        const cv::Mat& I = from_pyr.at(level*from_step);
+        const cv::Mat& Jimg = to_pyr.at(level*to_step);
+        cv::Point2f prev_pt = from_pt*(1.f/(1<<level));
+        float tx0 = prev_pt.x-half;
+        float ty0 = prev_pt.y-half;
+        //STEP1: template and gradient, once per level
+        if(!patchInside(I,tx0-1.f,ty0-1.f,PB,PB))
+        {
+            if(level==0) status = 0;
+            continue;
+        }
+        samplePatch(I,tx0-1.f,ty0-1.f,PB,PB,buf);
+        double hxx=0,hxy=0,hyy=0;
+        for(int r=0; r<P; r++)
+        {
+            const short* b0 = buf+r*PB;
+            const short* b1 = b0+PB;
+            const short* b2 = b1+PB;
+            for(int c=0; c<P; c++)
+            {
+                int k = r*P+c;
+                T[k]  = b1[c+1];
+                Tx[k] = static_cast<short>((b1[c+2]-b1[c])>>1);
+                Ty[k] = static_cast<short>((b2[c+1]-b0[c+1])>>1);
+                hxx += Tx[k]*Tx[k];
+                hxy += Tx[k]*Ty[k];
+                hyy += Ty[k]*Ty[k];
+            }
+        }
+        double det = hxx*hyy-hxy*hxy;
+        double min_eig = (hxx+hyy-sqrt((hxx-hyy)*(hxx-hyy)+4.0*hxy*hxy))*0.5;
+        if(min_eig/(N*1048576.0) < KLT_MIN_EIG_THRESHOLD || det<1e-12)
+        {
+            if(level==0) status = 0;
+            continue;
+        }
+        double inv_det = 1.0/det;
+        //STEP2: iterate, only the target patch is resampled
+        for(int iter=0; iter<max_iter; iter++)
+        {
+            float jx0 = next_pt.x-half;
+            float jy0 = next_pt.y-half;
+            if(!patchInside(Jimg,jx0,jy0,P,P))
+            {
+                if(level==0) status = 0;
+                break;
+            }
+            samplePatch(Jimg,jx0,jy0,P,P,J);
+            int bx,by;
+            steepestDescent(T,Tx,Ty,J,N,bx,by);
+            float dx = static_cast<float>((hyy*bx-hxy*by)*inv_det);
+            float dy = static_cast<float>((hxx*by-hxy*bx)*inv_det);
+            next_pt.x -= dx;
+            next_pt.y -= dy;
+            if(dx*dx+dy*dy <= eps*eps) break;
+        }
+        if(status==0) break;
+    }
+    to_pt = next_pt;
+}
+
+void KLTTracker::trackBatch(const vector<cv::Mat>& from_pyr,
+                            const vector<cv::Mat>& to_pyr,
+                            const vector<cv::Point2f>& from_pts,
+                            vector<cv::Point2f>& to_pts,
+                            vector<unsigned char>& status,
+                            const int patch_size,
+                            const int max_level)
+{
+    int n = static_cast<int>(from_pts.size());
+    status.resize(n);
+    KLTLoopBody body(this,from_pyr,to_pyr,from_pts,to_pts,status,patch_size,max_level);
+    TaskPool::instance().parallelFor(cv::Range(0,n),body,std::max(1.0,n/64.0));
+}
+
+void KLTTracker::track(const vector<cv::Mat>& from_pyr,
+                       const vector<cv::Mat>& to_pyr,
+                       const vector<cv::Point2f>& from_pts,
+                       vector<cv::Point2f>& to_pts,
+                       vector<unsigned char>& status,
+                       const int patch_size,
+                       const int max_level,
+                       const bool use_initial_flow)
+{
+    status.clear();
+    if(from_pts.empty() || from_pyr.empty() || to_pyr.empty())
+    {
+        to_pts.clear();
+        return;
+    }
+    int P = ((patch_size+3)/4)*4;
+    if(P<4) P=4;
+    if(P>KLT_MAX_PATCH_SIZE) P=KLT_MAX_PATCH_SIZE;
+    int levels = std::min(static_cast<int>(from_pyr.size())/pyrStep(from_pyr),
+                          static_cast<int>(to_pyr.size())/pyrStep(to_pyr))-1;
+    levels = std::max(0,std::min(levels,max_level));
+    if(!use_initial_flow || to_pts.size()!=from_pts.size())
+    {
+        to_pts = from_pts;
+    }
+    trackBatch(from_pyr,to_pyr,from_pts,to_pts,status,P,levels);
+    if(fb_check)
+    {
+        vector<cv::Point2f>   back_pts = from_pts;
+        vector<unsigned char> back_status;
+        trackBatch(to_pyr,from_pyr,to_pts,back_pts,back_status,P,levels);
+        for(size_t i=0; i<status.size(); i++)
+        {
+            if(status.at(i)==0) continue;
+            cv::Point2f d = back_pts.at(i)-from_pts.at(i);
+            if(back_status.at(i)==0 || (d.x*d.x+d.y*d.y)>fb_threshold*fb_threshold)
+            {
+                status.at(i) = 0;
+            }
+        }
+    }
+}
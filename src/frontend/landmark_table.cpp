@@ -0,0 +1,147 @@
+#include "include/landmark_table.h"
+
+LandMarkView::LandMarkView()
+{
+    table = NULL;
+}
+
+LandMarkView::LandMarkView(const LandMarkTable* table)
+{
+    this->table = table;
+}
+
+LandMarkTable::LandMarkTable()
+{
+}
+
+void LandMarkTable::clear(void)
+{
+    lm_id.clear();
+    lm_2d.clear();
+    lm_3d_w.clear();
+    lm_3d_c.clear();
+    has_3d.clear();
+    is_belong_to_kf.clear();
+    is_tracking_inlier.clear();
+    inv_depth_var.clear();
+    depth_converged.clear();
+    lm_1st_obs_2d.clear();
+    lm_1st_obs_frame_pose.clear();
+    id_to_slot.clear();
+}
+
+void LandMarkTable::reserve(const size_t n)
+{
+    lm_id.reserve(n);
+    lm_2d.reserve(n);
+    lm_3d_w.reserve(n);
+    lm_3d_c.reserve(n);
+    has_3d.reserve(n);
+    is_belong_to_kf.reserve(n);
+    is_tracking_inlier.reserve(n);
+    inv_depth_var.reserve(n);
+    depth_converged.reserve(n);
+    lm_1st_obs_2d.reserve(n);
+    lm_1st_obs_frame_pose.reserve(n);
+    id_to_slot.reserve(n);
+}
+
+void LandMarkTable::push_back(const LandMarkInFrame& lm)
+{
+    id_to_slot[lm.lm_id] = static_cast<int>(lm_id.size());
+    lm_id.push_back(lm.lm_id);
+    lm_2d.push_back(lm.lm_2d);
+    lm_3d_w.push_back(lm.lm_3d_w);
+    lm_3d_c.push_back(lm.lm_3d_c);
+    has_3d.push_back(lm.has_3d);
+    is_belong_to_kf.push_back(lm.is_belong_to_kf);
+    is_tracking_inlier.push_back(lm.is_tracking_inlier);
+    inv_depth_var.push_back(-1.0);
+    depth_converged.push_back(0);
+    lm_1st_obs_2d.push_back(lm.lm_1st_obs_2d);
+    lm_1st_obs_frame_pose.push_back(lm.lm_1st_obs_frame_pose);
+}
+
+void LandMarkTable::append(const LandMarkTable& src, const int src_slot)
+{
+    id_to_slot[src.lm_id[src_slot]] = static_cast<int>(lm_id.size());
+    lm_id.push_back(src.lm_id[src_slot]);
+    lm_2d.push_back(src.lm_2d[src_slot]);
+    lm_3d_w.push_back(src.lm_3d_w[src_slot]);
+    lm_3d_c.push_back(src.lm_3d_c[src_slot]);
+    has_3d.push_back(src.has_3d[src_slot]);
+    is_belong_to_kf.push_back(src.is_belong_to_kf[src_slot]);
+    is_tracking_inlier.push_back(src.is_tracking_inlier[src_slot]);
+    inv_depth_var.push_back(src.inv_depth_var[src_slot]);
+    depth_converged.push_back(src.depth_converged[src_slot]);
+    lm_1st_obs_2d.push_back(src.lm_1st_obs_2d[src_slot]);
+    lm_1st_obs_frame_pose.push_back(src.lm_1st_obs_frame_pose[src_slot]);
+}
+
+void LandMarkTable::keep(const vector<unsigned char>& keep_mask)
+{
+    size_t n = size();
+    size_t w = 0;
+    for(size_t i=0; i<n; i++)
+    {
+        if(keep_mask[i]==0) continue;
+        if(w!=i)
+        {
+            lm_id[w] = lm_id[i];
+            lm_2d[w] = lm_2d[i];
+            lm_3d_w[w] = lm_3d_w[i];
+            lm_3d_c[w] = lm_3d_c[i];
+            has_3d[w] = has_3d[i];
+            is_belong_to_kf[w] = is_belong_to_kf[i];
+            is_tracking_inlier[w] = is_tracking_inlier[i];
+            inv_depth_var[w] = inv_depth_var[i];
+            depth_converged[w] = depth_converged[i];
+            lm_1st_obs_2d[w] = lm_1st_obs_2d[i];
+            lm_1st_obs_frame_pose[w] = lm_1st_obs_frame_pose[i];
+        }
+        w++;
+    }
+    if(w==n) return;
+    lm_id.resize(w);
+    lm_2d.resize(w);
+    lm_3d_w.resize(w);
+    lm_3d_c.resize(w);
+    has_3d.resize(w);
+    is_belong_to_kf.resize(w);
+    is_tracking_inlier.resize(w);
+    inv_depth_var.resize(w);
+    depth_converged.resize(w);
+    lm_1st_obs_2d.resize(w);
+    lm_1st_obs_frame_pose.resize(w);
+    rebuildIndex();
+}
+
+int LandMarkTable::find(const int64_t id) const
+{
+    unordered_map<int64_t,int>::const_iterator it = id_to_slot.find(id);
+    if(it==id_to_slot.end()) return -1;
+    return it->second;
+}
+
+LandMarkView LandMarkTable::validView(const bool inlier_only) const
+{
+    LandMarkView view(this);
+    view.slots.reserve(size());
+    for(size_t i=0; i<size(); i++)
+    {
+        if(has_3d[i] && (!inlier_only || is_tracking_inlier[i]))
+        {
+            view.slots.push_back(static_cast<int>(i));
+        }
+    }
+    return view;
+}
+
+void LandMarkTable::rebuildIndex(void)
+{
+    id_to_slot.clear();
+    for(size_t i=0; i<lm_id.size(); i++)
+    {
+        id_to_slot[lm_id[i]] = static_cast<int>(i);
+    }
+}
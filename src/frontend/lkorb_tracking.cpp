@@ -4,14 +4,60 @@ LKORBTracking::LKORBTracking(int width_in,int height_in)
 {
     this->width=width_in;
     this->height=height_in;
+    klt.setForwardBackwardCheck(LK_FORWARD_BACKWARD_CHECK);
 }
 
 
+void LKORBTracking::predict(CameraFrame &from,
+                            const SE3 &T_c_w_pred,
+                            const vector<cv::Point2f>& from_cvP2f,
+                            vector<cv::Point2f>& pred_cvP2f,
+                            double& median_flow)
+{
+    DepthCamera &cam = from.d_camera;
+    SE3  T_to_from = T_c_w_pred*from.T_c_w.inverse();
+    Mat3x3 R_to_from = T_to_from.rotation_matrix();
+    vector<double> flow;
+    pred_cvP2f.resize(from_cvP2f.size());
+    flow.reserve(from_cvP2f.size());
+    for(size_t i=0; i<from_cvP2f.size(); i++)
+    {
+        const Vec2& lm_2d = from.landmarks.lm_2d[i];
+        Vec3 p_c;
+        if(from.landmarks.has_3d[i])
+        {
+            p_c = DepthCamera::world2cameraT_c_w(from.landmarks.lm_3d_w[i],T_c_w_pred);
+        }else
+        {
+            p_c = R_to_from*cam.pixel2camera(lm_2d,1.0);
+        }
+        Vec2 uv = lm_2d;
+        if(p_c[2]>0.05)
+        {
+            uv = cam.camera2pixel(p_c);
+            if(uv[0]<0 || uv[1]<0 || uv[0]>(width-1) || uv[1]>(height-1))
+            {//predicted out of view, start from the old position
+                uv = lm_2d;
+            }
+        }
+        pred_cvP2f.at(i) = cv::Point2f(uv[0],uv[1]);
+        flow.push_back((uv-lm_2d).norm());
+    }
+    median_flow = 0;
+    if(!flow.empty())
+    {
+        std::nth_element(flow.begin(),flow.begin()+flow.size()/2,flow.end());
+        median_flow = flow.at(flow.size()/2);
+    }
+}
+
 bool LKORBTracking::tracking(CameraFrame& from,
                              CameraFrame& to,
                              vector<Vec2>& lm2d_from,
                              vector<Vec2>& lm2d_to,
-                             vector<Vec2>& outlier)
+                             vector<Vec2>& outlier,
+                             const bool has_prediction,
+                             const SE3 T_c_w_pred)
 {
     //STEP1: Optical Flow
     int outlier_untracked_cnt=0;
@@ -20,14 +66,51 @@ bool LKORBTracking::tracking(CameraFrame& from,
     vector<cv::Point2f> from_cvP2f = from.get2dPtsVec_cvP2f();
     vector<cv::Point2f> tracked_cvP2f;
     vector<cv::Mat>     trackedLMDescriptors;
-    vector<float>   err;
     vector<unsigned char> mask_tracked;
     vector<unsigned char> mask_hasorb;
     vector<unsigned char> mask_matched;
-    cv::TermCriteria criteria = cv::TermCriteria((cv::TermCriteria::COUNT) + (cv::TermCriteria::EPS), 30, 0.01);
 
-    cv::calcOpticalFlowPyrLK(from.img0, to.img0, from_cvP2f, tracked_cvP2f,
-                             mask_tracked, err, cv::Size(31,31), 20, criteria);
+    //from.getImg0Pyr() was built when "from" was the current frame, reuse it
+    if(has_prediction && !from_cvP2f.empty())
+    {
+        double median_flow;
+        predict(from,T_c_w_pred,from_cvP2f,tracked_cvP2f,median_flow);
+        //residual motion after prediction -> search window and pyramid levels
+        //(KLT converges for a residual of about half a patch at the top level)
+        double residual = LK_PRED_RESIDUAL_BASE+LK_PRED_RESIDUAL_RATIO*median_flow;
+        int win = (residual<4.0)?LK_PRED_WIN_SIZE_SMALL:LK_PRED_WIN_SIZE;
+        int level = static_cast<int>(ceil(log2(residual/(win/2.0))));
+        if(level<1) level=1;
+        if(level>PYR_MAX_LEVEL_IMG0) level=PYR_MAX_LEVEL_IMG0;
+        klt.track(from.getImg0Pyr(), to.getImg0Pyr(), from_cvP2f, tracked_cvP2f,
+                  mask_tracked, win, level, true);
+        //full search for the lost ones
+        vector<int> lost_idx;
+        vector<cv::Point2f> lost_from_cvP2f,lost_to_cvP2f;
+        for(size_t i=0; i<mask_tracked.size(); i++)
+        {
+            if(mask_tracked.at(i)!=1)
+            {
+                lost_idx.push_back(i);
+                lost_from_cvP2f.push_back(from_cvP2f.at(i));
+            }
+        }
+        if(!lost_idx.empty())
+        {
+            vector<unsigned char> lost_mask;
+            klt.track(from.getImg0Pyr(), to.getImg0Pyr(), lost_from_cvP2f, lost_to_cvP2f,
+                      lost_mask, KLT_PATCH_SIZE, PYR_MAX_LEVEL_IMG0);
+            for(size_t i=0; i<lost_idx.size(); i++)
+            {
+                tracked_cvP2f.at(lost_idx.at(i)) = lost_to_cvP2f.at(i);
+                mask_tracked.at(lost_idx.at(i))  = lost_mask.at(i);
+            }
+        }
+    }else
+    {
+        klt.track(from.getImg0Pyr(), to.getImg0Pyr(), from_cvP2f, tracked_cvP2f,
+                  mask_tracked, KLT_PATCH_SIZE, PYR_MAX_LEVEL_IMG0);
+    }
 
 
     //    cv::Ptr<cv::DescriptorExtractor> extractor = cv::ORB::create();
@@ -76,6 +159,7 @@ bool LKORBTracking::tracking(CameraFrame& from,
     int w=to.width-1;
     int h=to.height-1;
     bool reuslt = false;
+    to.landmarks.reserve(from.landmarks.size());
     for(int i=from.landmarks.size()-1; i>=0; i--)
     {
         //        if(mask_tracked.at(i)!=1     ||
@@ -87,14 +171,13 @@ bool LKORBTracking::tracking(CameraFrame& from,
                 &&tracked_cvP2f.at(i).x<w
                 &&tracked_cvP2f.at(i).y<h)
         {//inliers
-            lm2d_from.push_back(from.landmarks.at(i).lm_2d);
+            lm2d_from.push_back(from.landmarks.lm_2d[i]);
             lm2d_to.push_back(Vec2(tracked_cvP2f.at(i).x,tracked_cvP2f.at(i).y));
-            LandMarkInFrame lm=from.landmarks.at(i);
-            lm.lm_2d=Vec2(tracked_cvP2f.at(i).x,tracked_cvP2f.at(i).y);
-            to.landmarks.push_back(lm);
+            to.landmarks.append(from.landmarks,i);
+            to.landmarks.lm_2d.back()=Vec2(tracked_cvP2f.at(i).x,tracked_cvP2f.at(i).y);
         }else
         {//outliers
-            outlier.push_back(from.landmarks.at(i).lm_2d);
+            outlier.push_back(from.landmarks.lm_2d[i]);
         }
     }
 
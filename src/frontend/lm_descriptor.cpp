@@ -0,0 +1,65 @@
+#include "include/lm_descriptor.h"
+
+LMDescriptorExtractor::LMDescriptorExtractor()
+{
+    orb = cv::ORB::create(500,1.2f,1,LM_DESC_EDGE,0,2,cv::ORB::HARRIS_SCORE,LM_DESC_PATCH_SIZE,20);
+    umax.resize(LM_DESC_HALF_PATCH+1);
+    for(int v=0; v<=LM_DESC_HALF_PATCH; v++)
+    {
+        umax[v] = cvRound(sqrt(static_cast<double>(LM_DESC_HALF_PATCH*LM_DESC_HALF_PATCH-v*v)));
+    }
+}
+
+//moments of the circular patch, angle of the centroid in degree (cv::KeyPoint convention)
+float LMDescriptorExtractor::icAngle(const cv::Mat& img, const int x, const int y) const
+{
+    int m_01 = 0, m_10 = 0;
+    for(int v=-LM_DESC_HALF_PATCH; v<=LM_DESC_HALF_PATCH; v++)
+    {
+        const uchar* row = img.ptr<uchar>(y+v)+x;
+        const int d = umax[std::abs(v)];
+        int v_sum = 0;
+        for(int u=-d; u<=d; u++)
+        {
+            m_10 += u*row[u];
+            v_sum += row[u];
+        }
+        m_01 += v*v_sum;
+    }
+    return cv::fastAtan2(static_cast<float>(m_01),static_cast<float>(m_10));
+}
+
+void LMDescriptorExtractor::compute(const cv::Mat& img,
+                                    const vector<Vec2>& pts,
+                                    cv::Mat& descriptors,
+                                    vector<int>& index)
+{
+    descriptors.release();
+    index.clear();
+    if(img.empty() || img.type()!=CV_8UC1 || pts.empty()) return;
+    //STEP1: keypoints inside the border, class_id keeps the point index
+    vector<cv::KeyPoint> kps;
+    kps.reserve(pts.size());
+    for(size_t i=0; i<pts.size(); i++)
+    {
+        int x = cvRound(pts[i][0]);
+        int y = cvRound(pts[i][1]);
+        if(x<LM_DESC_EDGE || y<LM_DESC_EDGE || x>=img.cols-LM_DESC_EDGE || y>=img.rows-LM_DESC_EDGE) continue;
+        cv::KeyPoint kp(static_cast<float>(pts[i][0]),static_cast<float>(pts[i][1]),
+                        static_cast<float>(LM_DESC_PATCH_SIZE),icAngle(img,x,y),0,0,static_cast<int>(i));
+        kps.push_back(kp);
+    }
+    if(kps.empty()) return;
+    //STEP2: descriptors at the given keypoints (ORB drops the ones it cannot describe)
+    orb->compute(img,kps,descriptors);
+    if(descriptors.rows!=static_cast<int>(kps.size()))
+    {
+        descriptors.release();
+        return;
+    }
+    index.reserve(kps.size());
+    for(size_t i=0; i<kps.size(); i++)
+    {
+        index.push_back(kps[i].class_id);
+    }
+}
@@ -0,0 +1,184 @@
+#include "include/motion_state_ring.h"
+
+MotionStateRing::MotionStateRing()
+    : head(0),
+      tail(0)
+{
+    latest.pos = Vec3(0,0,0);
+    latest.vel = Vec3(0,0,0);
+    latest.q_w_i = Quaterniond(1,0,0,0);
+}
+
+void MotionStateRing::init(const int capacity)
+{
+    slots.assign(std::max(2,capacity),Slot());
+    head.store(0);
+    tail.store(0);
+}
+
+MotionStateRing::Record MotionStateRing::pack(const uint64_t index, const MOTION_STATE& state)
+{
+    Record rec;
+    rec.index = index;
+    rec.t = state.imu_data.timestamp;
+    for(int i=0; i<3; i++)
+    {
+        rec.pos[i]  = state.pos[i];
+        rec.vel[i]  = state.vel[i];
+        rec.acc[i]  = state.imu_data.acc_raw[i];
+        rec.gyro[i] = state.imu_data.gyro_raw[i];
+    }
+    rec.q[0] = state.q_w_i.w();
+    rec.q[1] = state.q_w_i.x();
+    rec.q[2] = state.q_w_i.y();
+    rec.q[3] = state.q_w_i.z();
+    return rec;
+}
+
+MOTION_STATE MotionStateRing::unpack(const Record& rec)
+{
+    MOTION_STATE state;
+    state.pos   = Vec3(rec.pos[0],rec.pos[1],rec.pos[2]);
+    state.vel   = Vec3(rec.vel[0],rec.vel[1],rec.vel[2]);
+    state.q_w_i = Quaterniond(rec.q[0],rec.q[1],rec.q[2],rec.q[3]);
+    state.imu_data = IMUSTATE(rec.t,
+                              Vec3(rec.acc[0],rec.acc[1],rec.acc[2]),
+                              Vec3(rec.gyro[0],rec.gyro[1],rec.gyro[2]));
+    return state;
+}
+
+void MotionStateRing::write(const uint64_t index, const MOTION_STATE& state)
+{
+    Slot& s = slots[index%slots.size()];
+    uint32_t seq = s.seq.load(std::memory_order_relaxed);
+    s.seq.store(seq+1,std::memory_order_relaxed);//odd: writing
+    std::atomic_thread_fence(std::memory_order_release);
+    s.rec = pack(index,state);
+    s.seq.store(seq+2,std::memory_order_release);
+}
+
+bool MotionStateRing::read(const uint64_t index, Record& rec) const
+{
+    const Slot& s = slots[index%slots.size()];
+    while(true)
+    {
+        uint32_t seq0 = s.seq.load(std::memory_order_acquire);
+        if(seq0&1) continue;//the writer is in this slot, it only stays for one copy
+        rec = s.rec;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint32_t seq1 = s.seq.load(std::memory_order_relaxed);
+        if(seq0==seq1) break;
+    }
+    return rec.index==index;//false: overwritten by a newer state
+}
+
+void MotionStateRing::bounds(uint64_t& lo, uint64_t& hi) const
+{
+    hi = head.load(std::memory_order_acquire);
+    lo = tail.load(std::memory_order_acquire);
+    uint64_t cap = slots.size();
+    if(hi>cap && lo<hi-cap) lo = hi-cap;
+    if(lo>hi) lo = hi;
+}
+
+size_t MotionStateRing::size(void) const
+{
+    uint64_t lo, hi;
+    bounds(lo,hi);
+    return static_cast<size_t>(hi-lo);
+}
+
+void MotionStateRing::push(const MOTION_STATE& state)
+{
+    uint64_t h = head.load(std::memory_order_relaxed);
+    write(h,state);
+    latest = state;
+    head.store(h+1,std::memory_order_release);
+}
+
+void MotionStateRing::reset(const MOTION_STATE& state)
+{
+    uint64_t h = head.load(std::memory_order_relaxed);
+    write(h,state);
+    latest = state;
+    tail.store(h,std::memory_order_release);
+    head.store(h+1,std::memory_order_release);
+}
+
+bool MotionStateRing::latestState(MOTION_STATE& state) const
+{
+    for(int attempt=0; attempt<STATE_RING_READ_RETRY; attempt++)
+    {
+        uint64_t lo, hi;
+        bounds(lo,hi);
+        if(lo>=hi) return false;
+        Record rec;
+        if(read(hi-1,rec))
+        {
+            state = unpack(rec);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MotionStateRing::find(const double time, MOTION_STATE& s0, MOTION_STATE& s1) const
+{
+    //retry if the producer overwrites a state the search is looking at
+    for(int attempt=0; attempt<STATE_RING_READ_RETRY; attempt++)
+    {
+        uint64_t lo, hi;
+        bounds(lo,hi);
+        if(lo>=hi) return false;
+        Record ra, rb;
+        if(!read(hi-1,rb)) continue;
+        if(rb.t<=time)
+        {   //after the latest state
+            s0 = s1 = unpack(rb);
+            return true;
+        }
+        if(!read(lo,ra)) continue;
+        if(ra.t>time) return false;//before the oldest state
+        //t(a)<=time<t(b)
+        uint64_t a = lo;
+        uint64_t b = hi-1;
+        bool torn = false;
+        while(b-a>1)
+        {
+            uint64_t m = a+(b-a)/2;
+            Record rm;
+            if(!read(m,rm)) {torn = true; break;}
+            if(rm.t<=time) {a = m; ra = rm;}
+            else           {b = m; rb = rm;}
+        }
+        if(torn) continue;
+        //a may have been overwritten after it was read
+        if(!read(a,ra)) continue;
+        s0 = unpack(ra);
+        s1 = unpack(rb);
+        return true;
+    }
+    return false;
+}
+
+MOTION_STATE MotionStateRing::lerp(const MOTION_STATE& s0, const MOTION_STATE& s1, const double time)
+{
+    double dt = s1.imu_data.timestamp-s0.imu_data.timestamp;
+    if(dt<=0) return s0;
+    double a = (time-s0.imu_data.timestamp)/dt;
+    MOTION_STATE state;
+    state.pos   = s0.pos+a*(s1.pos-s0.pos);
+    state.vel   = s0.vel+a*(s1.vel-s0.vel);
+    state.q_w_i = s0.q_w_i.slerp(a,s1.q_w_i);
+    state.imu_data = s0.imu_data;
+    state.imu_data.timestamp = time;
+    return state;
+}
+
+bool MotionStateRing::interpolate(const double time, MOTION_STATE& state) const
+{
+    MOTION_STATE s0, s1;
+    if(!find(time,s0,s1)) return false;
+    state = lerp(s0,s1,time);
+    return true;
+}
@@ -7,17 +7,71 @@ OptimizeInFrame::OptimizeInFrame()
 
 }
 
-void OptimizeInFrame::optimize(CameraFrame &frame)
+void OptimizeInFrame::optimize(CameraFrame &frame, const bool mark_outlier)
+{
+#if IN_FRAME_OPT_USE_G2O
+    optimize_g2o(frame);
+#else
+    //buffers are kept between frames, no allocation once the capacity is reached
+    static thread_local MotionOnlyPoseSolver solver;
+    int n = solver.setProblem(frame.landmarks,
+                              frame.d_camera.cam0_fx,
+                              frame.d_camera.cam0_fy,
+                              frame.d_camera.cam0_cx,
+                              frame.d_camera.cam0_cy);
+    if(n<IN_FRAME_OPT_MIN_LM_NUM)
+    {
+        return;
+    }
+#if IN_FRAME_OPT_COMPARE_G2O
+    //g2o graph on a copy, same landmarks (before markOutlier) and initial pose
+    CameraFrame ref = frame;
+    optimize_g2o(ref);
+#endif
+    SE3 T_c_w = frame.T_c_w;
+    solver.solve(T_c_w,IN_FRAME_OPT_ITERATIONS);
+    solver.rejectChi2Outlier(T_c_w,IN_FRAME_OPT_CHI2_TH);
+    if(mark_outlier)
+    {
+        solver.markOutlier(frame.landmarks);
+    }
+    solver.solve(T_c_w,IN_FRAME_OPT_ITERATIONS);
+#if IN_FRAME_OPT_COMPARE_G2O
+    reportG2ODelta(ref.T_c_w,T_c_w);
+#endif
+    frame.T_c_w = T_c_w;
+#endif
+}
+
+//A/B check, max difference of the solver result to the g2o graph
+void OptimizeInFrame::reportG2ODelta(const SE3 &T_c_w_g2o, const SE3 &T_c_w_solver)
+{
+    static thread_local uint64_t frames = 0;
+    static thread_local double   max_rot = 0;//rad
+    static thread_local double   max_trans = 0;//m
+    SE3 T_diff = T_c_w_g2o.inverse()*T_c_w_solver;
+    double rot   = T_diff.so3().log().norm();
+    double trans = (T_c_w_g2o.translation()-T_c_w_solver.translation()).norm();
+    if(rot>max_rot) max_rot = rot;
+    if(trans>max_trans) max_trans = trans;
+    frames++;
+    if((frames%IN_FRAME_OPT_COMPARE_REPORT)==0)
+    {
+        cout << "in frame optimization vs g2o (" << frames << " frames): max pose delta rot "
+             << max_rot << " rad, trans " << max_trans << " m" << endl;
+    }
+}
+
+void OptimizeInFrame::optimize_g2o(CameraFrame &frame)
 {
     //get all landmarks (has depth information and is inliers)
     double fx=frame.d_camera.cam0_fx;
     double fy=frame.d_camera.cam0_fy;
     double cx=frame.d_camera.cam0_cx;
     double cy=frame.d_camera.cam0_cy;
-    vector<LandMarkInFrame> lms_in_frame;
-    frame.getValidInliersPair(lms_in_frame);
+    LandMarkView lms_in_frame = frame.getValidInliersView();
 //    cout << lms_in_frame.size() << "|" << frame.landmarks.size() << endl;
-    if(lms_in_frame.size()<10)
+    if(lms_in_frame.size()<IN_FRAME_OPT_MIN_LM_NUM)
     {
         return;
     }
@@ -38,11 +92,12 @@ void OptimizeInFrame::optimize(CameraFrame &frame)
         optimizer.addVertex(v_pose);
 
         vector<g2o::EdgeSE3ProjectXYZ*> edges;
-        for(auto lm : lms_in_frame)
+        for(size_t k=0; k<lms_in_frame.size(); k++)
         {
+            int64_t lm_id = lms_in_frame.lm_id(k);
             g2o::VertexSBAPointXYZ* v_point = new g2o::VertexSBAPointXYZ();
-            v_point->setId (lm.lm_id);
-            v_point->setEstimate (lm.lm_3d_w);
+            v_point->setId (lm_id);
+            v_point->setEstimate (lms_in_frame.lm_3d_w(k));
             v_point->setFixed(true);
             optimizer.addVertex (v_point);
             g2o::EdgeSE3ProjectXYZ* edge = new g2o::EdgeSE3ProjectXYZ();
@@ -50,10 +105,10 @@ void OptimizeInFrame::optimize(CameraFrame &frame)
             edge->fy = fy;
             edge->cx = cx;
             edge->cy = cy;
-            edge->setId(lm.lm_id);
-            edge->setVertex( 0, dynamic_cast<g2o::VertexSBAPointXYZ*> (optimizer.vertex(lm.lm_id)));
+            edge->setId(lm_id);
+            edge->setVertex( 0, dynamic_cast<g2o::VertexSBAPointXYZ*> (optimizer.vertex(lm_id)));
             edge->setVertex( 1, dynamic_cast<g2o::VertexSE3Expmap*>   (optimizer.vertex(0)));
-            edge->setMeasurement(Eigen::Vector2d(lm.lm_2d));
+            edge->setMeasurement(Eigen::Vector2d(lms_in_frame.lm_2d(k)));
             edge->setInformation(Eigen::Matrix2d::Identity());
             edge->setParameterId(0,0);
             edge->setRobustKernel(new g2o::RobustKernelHuber());
@@ -82,3 +137,213 @@ void OptimizeInFrame::optimize(CameraFrame &frame)
 
     }
 }
+
+MotionOnlyPoseSolver::MotionOnlyPoseSolver()
+{
+    n=0;
+    fx=fy=cx=cy=0;
+}
+
+int MotionOnlyPoseSolver::setProblem(const LandMarkTable& lms,
+                                     const double fx, const double fy,
+                                     const double cx, const double cy)
+{
+    this->fx=fx;
+    this->fy=fy;
+    this->cx=cx;
+    this->cy=cy;
+    size_t cap = lms.size();
+    //resize() keeps the capacity, only grows
+    slot.resize(cap);
+    pw_x.resize(cap);
+    pw_y.resize(cap);
+    pw_z.resize(cap);
+    obs_u.resize(cap);
+    obs_v.resize(cap);
+    active.resize(cap);
+    n=0;
+    for(size_t i=0; i<lms.size(); i++)
+    {
+        if(!lms.isValid(i)) continue;
+        slot[n] = static_cast<int>(i);
+        pw_x[n] = lms.lm_3d_w[i][0];
+        pw_y[n] = lms.lm_3d_w[i][1];
+        pw_z[n] = lms.lm_3d_w[i][2];
+        obs_u[n] = lms.lm_2d[i][0];
+        obs_v[n] = lms.lm_2d[i][1];
+        active[n] = 1;
+        n++;
+    }
+    return n;
+}
+
+//Huber: rho(e2) = e2 (e2<=d^2), 2d*sqrt(e2)-d^2 otherwise
+double MotionOnlyPoseSolver::robustChi2(const SE3& T_c_w)
+{
+    const Mat3x3 R = T_c_w.rotation_matrix();
+    const Vec3   t = T_c_w.translation();
+    const double delta = IN_FRAME_OPT_HUBER_DELTA;
+    const double delta_sq = delta*delta;
+    double chi2 = 0;
+    for(int i=0; i<n; i++)
+    {
+        if(!active[i]) continue;
+        double x = R(0,0)*pw_x[i]+R(0,1)*pw_y[i]+R(0,2)*pw_z[i]+t[0];
+        double y = R(1,0)*pw_x[i]+R(1,1)*pw_y[i]+R(1,2)*pw_z[i]+t[1];
+        double z = R(2,0)*pw_x[i]+R(2,1)*pw_y[i]+R(2,2)*pw_z[i]+t[2];
+        double iz = 1.0/z;
+        double eu = obs_u[i]-(fx*x*iz+cx);
+        double ev = obs_v[i]-(fy*y*iz+cy);
+        double e2 = eu*eu+ev*ev;
+        chi2 += (e2<=delta_sq)?e2:(2.0*delta*sqrt(e2)-delta_sq);
+    }
+    return chi2;
+}
+
+//H = sum(w*J^T*J), b = -sum(w*J^T*e), update order (omega,upsilon) as g2o::SE3Quat
+void MotionOnlyPoseSolver::buildNormalEquation(const SE3& T_c_w, Mat6x6& H, Vec6& b)
+{
+    const Mat3x3 R = T_c_w.rotation_matrix();
+    const Vec3   t = T_c_w.translation();
+    const double delta = IN_FRAME_OPT_HUBER_DELTA;
+    const double delta_sq = delta*delta;
+    //upper triangle of H
+    double h[21] = {0};
+    double g[6] = {0};
+    for(int i=0; i<n; i++)
+    {
+        if(!active[i]) continue;
+        double x = R(0,0)*pw_x[i]+R(0,1)*pw_y[i]+R(0,2)*pw_z[i]+t[0];
+        double y = R(1,0)*pw_x[i]+R(1,1)*pw_y[i]+R(1,2)*pw_z[i]+t[1];
+        double z = R(2,0)*pw_x[i]+R(2,1)*pw_y[i]+R(2,2)*pw_z[i]+t[2];
+        double iz = 1.0/z;
+        double iz2 = iz*iz;
+        double eu = obs_u[i]-(fx*x*iz+cx);
+        double ev = obs_v[i]-(fy*y*iz+cy);
+        double e2 = eu*eu+ev*ev;
+        double w = (e2<=delta_sq)?1.0:(delta/sqrt(e2));
+        //jacobian of the error (EdgeSE3ProjectXYZ::linearizeOplus)
+        double ju[6],jv[6];
+        ju[0] =  x*y*iz2*fx;
+        ju[1] = -(1.0+x*x*iz2)*fx;
+        ju[2] =  y*iz*fx;
+        ju[3] = -iz*fx;
+        ju[4] =  0;
+        ju[5] =  x*iz2*fx;
+        jv[0] =  (1.0+y*y*iz2)*fy;
+        jv[1] = -x*y*iz2*fy;
+        jv[2] = -x*iz*fy;
+        jv[3] =  0;
+        jv[4] = -iz*fy;
+        jv[5] =  y*iz2*fy;
+        int k=0;
+        for(int r=0; r<6; r++)
+        {
+            double wju = w*ju[r];
+            double wjv = w*jv[r];
+            for(int c=r; c<6; c++)
+            {
+                h[k++] += wju*ju[c]+wjv*jv[c];
+            }
+            g[r] -= wju*eu+wjv*ev;
+        }
+    }
+    int k=0;
+    for(int r=0; r<6; r++)
+    {
+        for(int c=r; c<6; c++)
+        {
+            H(r,c) = H(c,r) = h[k++];
+        }
+        b[r] = g[r];
+    }
+}
+
+//Levenberg-Marquardt as g2o::OptimizationAlgorithmLevenberg (tau=1e-5, 10 trials)
+void MotionOnlyPoseSolver::solve(SE3& T_c_w, const int iterations)
+{
+    Mat6x6 H;
+    Vec6   b;
+    double lambda = 0;
+    double ni = 2.0;
+    double chi2 = robustChi2(T_c_w);
+    for(int iter=0; iter<iterations; iter++)
+    {
+        buildNormalEquation(T_c_w,H,b);
+        if(iter==0)
+        {
+            double max_diag = 0;
+            for(int k=0; k<6; k++) max_diag = std::max(fabs(H(k,k)),max_diag);
+            lambda = 1e-5*max_diag;
+            ni = 2.0;
+        }
+        double rho = 0;
+        int    trials = 0;
+        do
+        {
+            Mat6x6 H_lm = H;
+            H_lm.diagonal().array() += lambda;
+            Vec6 dx = H_lm.ldlt().solve(b);
+            //g2o::SE3Quat::exp(omega,upsilon) -> Sophus::SE3::exp(upsilon,omega)
+            Vec6 update;
+            update << dx.tail<3>(), dx.head<3>();
+            SE3 T_new = SE3::exp(update)*T_c_w;
+            double chi2_new = robustChi2(T_new);
+            double scale = dx.dot(lambda*dx+b)+1e-3;
+            rho = (chi2-chi2_new)/scale;
+            if(rho>0 && std::isfinite(chi2_new))
+            {
+                double alpha = 1.0-pow((2*rho-1),3);
+                alpha = std::min(alpha,2.0/3.0);
+                lambda *= std::max(1.0/3.0,alpha);
+                ni = 2.0;
+                T_c_w = T_new;
+                chi2 = chi2_new;
+            }
+            else
+            {
+                lambda *= ni;
+                ni *= 2.0;
+                if(!std::isfinite(lambda)) break;
+            }
+            trials++;
+        }while(rho<0 && trials<10);
+        //g2o stops the optimization here (Terminate)
+        if(trials==10 || rho==0 || !std::isfinite(lambda)) break;
+    }
+}
+
+int MotionOnlyPoseSolver::rejectChi2Outlier(const SE3& T_c_w, const double chi2_th)
+{
+    const Mat3x3 R = T_c_w.rotation_matrix();
+    const Vec3   t = T_c_w.translation();
+    int cnt=0;
+    for(int i=0; i<n; i++)
+    {
+        if(!active[i]) continue;
+        double x = R(0,0)*pw_x[i]+R(0,1)*pw_y[i]+R(0,2)*pw_z[i]+t[0];
+        double y = R(1,0)*pw_x[i]+R(1,1)*pw_y[i]+R(1,2)*pw_z[i]+t[1];
+        double z = R(2,0)*pw_x[i]+R(2,1)*pw_y[i]+R(2,2)*pw_z[i]+t[2];
+        double eu = obs_u[i]-(fx*x/z+cx);
+        double ev = obs_v[i]-(fy*y/z+cy);
+        if(eu*eu+ev*ev>chi2_th)
+        {
+            active[i] = 0;
+        }else
+        {
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+void MotionOnlyPoseSolver::markOutlier(LandMarkTable& lms)
+{
+    for(int i=0; i<n; i++)
+    {
+        if(!active[i])
+        {
+            lms.is_tracking_inlier[slot[i]] = false;
+        }
+    }
+}
@@ -0,0 +1,190 @@
+#include "include/prior_pnp.h"
+
+PriorPnP::PriorPnP()
+    :rng(5489u)
+{
+    fx=fy=1;
+    cx=cy=0;
+    th_sq=PNP_REPROJ_THRESHOLD*PNP_REPROJ_THRESHOLD;
+}
+
+void PriorPnP::setRotation(const vector<cv::Point3f>& p3d, const Mat3x3& R)
+{
+    q.resize(p3d.size());
+    for(size_t i=0; i<p3d.size(); i++)
+    {
+        q[i] = R*Vec3(p3d[i].x,p3d[i].y,p3d[i].z);
+    }
+}
+
+int PriorPnP::countInliers(const Vec3& t, const int best_cnt, vector<uchar>* status)
+{
+    int n = static_cast<int>(q.size());
+    int cnt = 0;
+    for(int i=0; i<n; i++)
+    {
+        //bail out, the rest can not make this hypothesis better than the best one
+        if(status==NULL && (cnt+(n-i))<=best_cnt) return cnt;
+        double z = q[i][2]+t[2];
+        bool inlier = false;
+        if(z>0)
+        {
+            double du = fx*(q[i][0]+t[0])/z+cx-uv[i][0];
+            double dv = fy*(q[i][1]+t[1])/z+cy-uv[i][1];
+            inlier = (du*du+dv*dv)<th_sq;
+        }
+        if(inlier) cnt++;
+        if(status!=NULL) (*status)[i] = inlier?1:0;
+    }
+    return cnt;
+}
+
+//x*(qz+tz) = qx+tx -> tx - x*tz = x*qz - qx
+//y*(qz+tz) = qy+ty -> ty - y*tz = y*qz - qy
+bool PriorPnP::solveTranslation(const int* idx, const int n, Vec3& t)
+{
+    Mat3x3 A = Mat3x3::Zero();
+    Vec3   b = Vec3::Zero();
+    for(int k=0; k<n; k++)
+    {
+        int i = idx[k];
+        double x = xy[i][0];
+        double y = xy[i][1];
+        Vec3 a0(1,0,-x);
+        Vec3 a1(0,1,-y);
+        double b0 = x*q[i][2]-q[i][0];
+        double b1 = y*q[i][2]-q[i][1];
+        A += a0*a0.transpose()+a1*a1.transpose();
+        b += a0*b0+a1*b1;
+    }
+    if(fabs(A.determinant())<1e-12) return false;
+    t = A.ldlt().solve(b);
+    return true;
+}
+
+bool PriorPnP::solveTranslation(const vector<uchar>& status, Vec3& t)
+{
+    vector<int> idx;
+    idx.reserve(status.size());
+    for(size_t i=0; i<status.size(); i++)
+    {
+        if(status[i]) idx.push_back(static_cast<int>(i));
+    }
+    if(idx.size()<2) return false;
+    return solveTranslation(idx.data(),static_cast<int>(idx.size()),t);
+}
+
+void PriorPnP::fullRansac(const vector<cv::Point3f>& p3d,
+                          const vector<cv::Point2f>& p2d,
+                          const cv::Mat& K,
+                          const cv::Mat& D,
+                          const SE3& T_c_w_guess,
+                          SE3& T_c_w,
+                          vector<uchar>& status)
+{
+    cv::Mat r_ = cv::Mat::zeros(3, 1, CV_64FC1);
+    cv::Mat t_ = cv::Mat::zeros(3, 1, CV_64FC1);
+    SE3_to_rvec_tvec(T_c_w_guess, r_ , t_ );
+    cv::Mat inliers;
+    cv::solvePnPRansac(p3d,p2d,K,D,
+                       r_,t_,false,PNP_MAX_ITERATIONS,PNP_REPROJ_THRESHOLD,PNP_CONFIDENCE,
+                       inliers,cv::SOLVEPNP_ITERATIVE);
+    T_c_w = SE3_from_rvec_tvec(r_,t_);
+    status.assign(p2d.size(),0);
+    for(int i=0; i<inliers.rows; i++)
+    {
+        status[inliers.at<int>(i)] = 1;
+    }
+}
+
+TYPEOFPNPRESULT PriorPnP::solve(const vector<cv::Point3f>& p3d,
+                                const vector<cv::Point2f>& p2d,
+                                const cv::Mat& K,
+                                const cv::Mat& D,
+                                const SE3& T_c_w_guess,
+                                const bool has_prior,
+                                const SE3& T_c_w_prior,
+                                SE3& T_c_w,
+                                vector<uchar>& status)
+{
+    int n = static_cast<int>(p2d.size());
+    //the prior is only used on undistorted (rectified) pixels
+    bool distorted = (!D.empty() && cv::countNonZero(D)>0);
+    if(!has_prior || distorted || n<4)
+    {
+        fullRansac(p3d,p2d,K,D,T_c_w_guess,T_c_w,status);
+        return PNP_FULL_RANSAC;
+    }
+    fx = K.at<double>(0,0);
+    fy = K.at<double>(1,1);
+    cx = K.at<double>(0,2);
+    cy = K.at<double>(1,2);
+    uv.resize(n);
+    xy.resize(n);
+    for(int i=0; i<n; i++)
+    {
+        uv[i] = Vec2(p2d[i].x,p2d[i].y);
+        xy[i] = Vec2((p2d[i].x-cx)/fx,(p2d[i].y-cy)/fy);
+    }
+    status.assign(n,0);
+
+    //STEP1: prior pose
+    setRotation(p3d,T_c_w_prior.rotation_matrix());
+    Vec3 t_prior = T_c_w_prior.translation();
+    int prior_cnt = countInliers(t_prior,-1,&status);
+    if(prior_cnt >= PNP_PRIOR_ACCEPT_RATIO*n)
+    {
+        T_c_w = T_c_w_prior;
+        return PNP_FROM_PRIOR;
+    }
+
+    //STEP2: 2-point translation only RANSAC, adaptive iterations
+    Vec3 best_t = t_prior;
+    int  best_cnt = prior_cnt;
+    int  max_iter = PNP_MAX_ITERATIONS;
+    std::uniform_int_distribution<int> pick(0,n-1);
+    for(int iter=0; iter<max_iter; iter++)
+    {
+        int idx[2];
+        idx[0] = pick(rng);
+        do{idx[1] = pick(rng);}while(idx[1]==idx[0]);
+        Vec3 t;
+        if(!solveTranslation(idx,2,t)) continue;
+        int cnt = countInliers(t,best_cnt,NULL);
+        if(cnt>best_cnt)
+        {
+            best_cnt = cnt;
+            best_t = t;
+            //N = log(1-p)/log(1-w^2)
+            double w = static_cast<double>(best_cnt)/n;
+            double denom = log(1.0-w*w);
+            if(denom<0)
+            {
+                double need = log(1.0-PNP_CONFIDENCE)/denom;
+                if(need<max_iter) max_iter = static_cast<int>(ceil(need));
+            }
+        }
+    }
+    countInliers(best_t,-1,&status);
+    Vec3 t_refined;
+    if(solveTranslation(status,t_refined))
+    {
+        vector<uchar> status_refined(n,0);
+        if(countInliers(t_refined,-1,&status_refined)>=best_cnt)
+        {
+            best_t = t_refined;
+            status.swap(status_refined);
+        }
+    }
+    best_cnt = 0;
+    for(int i=0; i<n; i++) best_cnt += status[i];
+    if(best_cnt >= PNP_TRANSLATION_MIN_RATIO*n)
+    {
+        T_c_w = SE3(T_c_w_prior.so3(),best_t);
+        return PNP_TRANSLATION_ONLY;
+    }
+
+    //STEP3: the rotation prior does not fit
+    fullRansac(p3d,p2d,K,D,T_c_w_guess,T_c_w,status);
+    return PNP_FULL_RANSAC;
+}
@@ -0,0 +1,217 @@
+#include "include/stereo_matcher.h"
+#include "include/task_pool.h"
+#include <climits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+//SAD of two STEREO_BLOCK_W x STEREO_BLOCK_H blocks
+static inline int blockSAD(const uchar* a, const size_t step_a,
+                           const uchar* b, const size_t step_b)
+{
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for(int r=0; r<STEREO_BLOCK_H; r++)
+    {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a+r*step_a));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b+r*step_b));
+        acc = _mm_add_epi64(acc,_mm_sad_epu8(va,vb));
+    }
+    return _mm_cvtsi128_si32(acc)+_mm_cvtsi128_si32(_mm_unpackhi_epi64(acc,acc));
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint16x8_t acc = vdupq_n_u16(0);
+    for(int r=0; r<STEREO_BLOCK_H; r++)
+    {
+        uint8x16_t va = vld1q_u8(a+r*step_a);
+        uint8x16_t vb = vld1q_u8(b+r*step_b);
+        acc = vabal_u8(acc,vget_low_u8(va),vget_low_u8(vb));
+        acc = vabal_u8(acc,vget_high_u8(va),vget_high_u8(vb));
+    }
+    uint64x2_t s = vpaddlq_u32(vpaddlq_u16(acc));
+    return static_cast<int>(vgetq_lane_u64(s,0)+vgetq_lane_u64(s,1));
+#else
+    int sum = 0;
+    for(int r=0; r<STEREO_BLOCK_H; r++)
+    {
+        const uchar* pa = a+r*step_a;
+        const uchar* pb = b+r*step_b;
+        for(int c=0; c<STEREO_BLOCK_W; c++)
+        {
+            sum += abs(static_cast<int>(pa[c])-static_cast<int>(pb[c]));
+        }
+    }
+    return sum;
+#endif
+}
+
+//cost[d-d_lo] of the reference block against the block of img at column x_left+sign*d
+//return the disparity of the minimum cost
+static int searchRow(const uchar* ref, const size_t ref_step,
+                     const cv::Mat& img, const int y_top, const int x_left, const int sign,
+                     const int d_lo, const int d_hi, int* cost)
+{
+    const uchar* row = img.ptr<uchar>(y_top);
+    int best = d_lo;
+    int best_cost = INT_MAX;
+    for(int d=d_lo; d<=d_hi; d++)
+    {
+        int c = blockSAD(ref,ref_step,row+x_left+sign*d,img.step);
+        cost[d-d_lo] = c;
+        if(c<best_cost)
+        {
+            best_cost = c;
+            best = d;
+        }
+    }
+    return best;
+}
+
+class StereoMatchLoopBody : public cv::ParallelLoopBody
+{
+public:
+    StereoMatchLoopBody(const StereoMatcher* matcher,
+                        const cv::Mat& img0, const cv::Mat& img1,
+                        const vector<Vec2>& pts0, const vector<double>& disparity_prior,
+                        vector<Vec2>& pts1, vector<unsigned char>& status)
+        : matcher(matcher), img0(img0), img1(img1),
+          pts0(pts0), disparity_prior(disparity_prior),
+          pts1(pts1), status(status) {}
+    virtual void operator()(const cv::Range& range) const
+    {
+        bool has_prior = (disparity_prior.size()==pts0.size());
+        for(int i=range.start; i<range.end; i++)
+        {
+            double d = 0;
+            double d_prior = has_prior?disparity_prior.at(i):-1.0;
+            TYPEOFSTEREOMATCH result = matcher->matchPoint(img0,img1,pts0.at(i),d_prior,d);
+            if(result==STEREO_MATCH_OK)
+            {
+                pts1.at(i) = Vec2(pts0.at(i)[0]-d,pts0.at(i)[1]);
+            }else
+            {
+                pts1.at(i) = pts0.at(i);
+            }
+            status.at(i) = static_cast<unsigned char>(result);
+        }
+    }
+private:
+    const StereoMatcher* matcher;
+    const cv::Mat& img0;
+    const cv::Mat& img1;
+    const vector<Vec2>& pts0;
+    const vector<double>& disparity_prior;
+    vector<Vec2>& pts1;
+    vector<unsigned char>& status;
+};
+
+StereoMatcher::StereoMatcher(const Mat3x4& P0, const Mat3x4& P1,
+                             const double min_depth, const double max_depth)
+{
+    fb  = P0(0,3)-P1(0,3);
+    dcx = P0(0,2)-P1(0,2);
+    if(fb>0)
+    {
+        d_min = static_cast<int>(floor(fb/max_depth+dcx));
+        d_max = static_cast<int>(ceil(fb/min_depth+dcx));
+        d_max = std::min(d_max,d_min+STEREO_MAX_DISPARITY);
+    }else
+    {
+        d_min = d_max = 0;//not a left-right rectified pair
+    }
+}
+
+TYPEOFSTEREOMATCH StereoMatcher::matchPoint(const cv::Mat& img0,
+                                            const cv::Mat& img1,
+                                            const Vec2& pt0,
+                                            const double d_prior,
+                                            double& d) const
+{
+    const int W = STEREO_BLOCK_W;
+    const int H = STEREO_BLOCK_H;
+    int x0 = cvRound(pt0[0]);
+    int y0 = cvRound(pt0[1]);
+    int x_left = x0-W/2;
+    int y_top  = y0-H/2;
+    if(x_left<0 || y_top<0 || (x_left+W)>img0.cols || (y_top+H)>img0.rows) return STEREO_MATCH_FAIL;
+    //block in img1 at x_left-d must be inside the image
+    int lo = std::max(d_min,x_left+W-img1.cols);
+    int hi = std::min(d_max,x_left);
+    if(hi-lo<2) return STEREO_MATCH_FAIL;
+
+    int cost[STEREO_MAX_DISPARITY+1];
+    const uchar* ref0 = img0.ptr<uchar>(y_top)+x_left;
+    int b_lo = lo;
+    int b_hi = hi;
+    if(d_prior>=0)
+    {
+        int dp = cvRound(d_prior);
+        b_lo = std::max(lo,dp-STEREO_PRIOR_BAND);
+        b_hi = std::min(hi,dp+STEREO_PRIOR_BAND);
+        if(b_hi-b_lo<2)
+        {
+            b_lo = lo;
+            b_hi = hi;
+        }
+    }
+    int best = searchRow(ref0,img0.step,img1,y_top,x_left,-1,b_lo,b_hi,cost);
+    if((best==b_lo && b_lo>lo) || (best==b_hi && b_hi<hi))
+    {   //the minimum is not inside the prior band
+        b_lo = lo;
+        b_hi = hi;
+        best = searchRow(ref0,img0.step,img1,y_top,x_left,-1,b_lo,b_hi,cost);
+    }
+    if(best==b_lo && b_lo==d_min) return STEREO_MATCH_FAR;//beyond max depth
+    if(best==b_lo || best==b_hi) return STEREO_MATCH_FAIL;//out of the depth range or the image
+    int c_best = cost[best-b_lo];
+    if(c_best>STEREO_MAX_MEAN_SAD*W*H) return STEREO_MATCH_FAIL;
+    int c_second = INT_MAX;
+    for(int k=b_lo; k<=b_hi; k++)
+    {
+        if(abs(k-best)>1 && cost[k-b_lo]<c_second) c_second = cost[k-b_lo];
+    }
+    if(c_second!=INT_MAX && c_second*100<c_best*(100+STEREO_UNIQUENESS_RATIO)) return STEREO_MATCH_FAIL;
+
+    //left-right check
+    int cost_lr[STEREO_MAX_DISPARITY+1];
+    int xr_left = x_left-best;
+    const uchar* ref1 = img1.ptr<uchar>(y_top)+xr_left;
+    int lr_lo = std::max(b_lo,-xr_left);
+    int lr_hi = std::min(b_hi,img0.cols-W-xr_left);
+    if(lr_hi<lr_lo) return STEREO_MATCH_FAIL;
+    int best_lr = searchRow(ref1,img1.step,img0,y_top,xr_left,1,lr_lo,lr_hi,cost_lr);
+    if(abs(best_lr-best)>STEREO_LR_THRESHOLD) return STEREO_MATCH_FAIL;
+
+    //sub-pixel
+    double cm = cost[best-b_lo-1];
+    double cp = cost[best-b_lo+1];
+    double denom = cm-2.0*c_best+cp;
+    double delta = 0;
+    if(denom>0)
+    {
+        delta = 0.5*(cm-cp)/denom;
+        if(delta> 0.5) delta= 0.5;
+        if(delta<-0.5) delta=-0.5;
+    }
+    d = best+delta;
+    return STEREO_MATCH_OK;
+}
+
+void StereoMatcher::match(const cv::Mat& img0,
+                          const cv::Mat& img1,
+                          const vector<Vec2>& pts0,
+                          const vector<double>& disparity_prior,
+                          vector<Vec2>& pts1,
+                          vector<unsigned char>& status) const
+{
+    int n = static_cast<int>(pts0.size());
+    pts1.resize(n);
+    status.assign(n,0);
+    if(n==0 || img0.empty() || img1.empty()) return;
+    CV_Assert(img0.type()==CV_8UC1 && img1.type()==CV_8UC1);
+    StereoMatchLoopBody body(this,img0,img1,pts0,disparity_prior,pts1,status);
+    TaskPool::instance().parallelFor(cv::Range(0,n),body,std::max(1.0,n/64.0));
+}
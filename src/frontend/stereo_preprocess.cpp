@@ -0,0 +1,117 @@
+#include "include/stereo_preprocess.h"
+#include "include/task_pool.h"
+
+//Calculate histogram of both eyes
+class HistLoopBody : public cv::ParallelLoopBody
+{
+public:
+    HistLoopBody(const cv::Mat* src, cv::Mat* lut, int grid_step)
+        :src(src),lut(lut),grid_step(grid_step){}
+    virtual void operator()(const cv::Range& range) const
+    {
+        for(int i=range.start; i<range.end; i++)
+        {
+            StereoPreprocess::calEqualizeLUT(src[i],grid_step,lut[i]);
+        }
+    }
+private:
+    const cv::Mat* src;
+    cv::Mat*       lut;
+    int            grid_step;
+};
+
+//Rectify and equalize row bands, job index = eye*band_cnt+band
+class RemapLUTLoopBody : public cv::ParallelLoopBody
+{
+public:
+    RemapLUTLoopBody(const cv::Mat* src, cv::Mat* dst,
+                     const cv::Mat* map1, const cv::Mat* map2,
+                     const cv::Mat* lut, int band_cnt)
+        :src(src),dst(dst),map1(map1),map2(map2),lut(lut),band_cnt(band_cnt){}
+    virtual void operator()(const cv::Range& range) const
+    {
+        for(int i=range.start; i<range.end; i++)
+        {
+            int eye  = i/band_cnt;
+            int band = i%band_cnt;
+            int row_begin = band*PREPROCESS_BAND_ROWS;
+            int row_end   = std::min(row_begin+PREPROCESS_BAND_ROWS,dst[eye].rows);
+            cv::Mat dst_band = dst[eye].rowRange(row_begin,row_end);
+            cv::remap(src[eye], dst_band,
+                      map1[eye].rowRange(row_begin,row_end),
+                      map2[eye].rowRange(row_begin,row_end),
+                      cv::INTER_LINEAR);
+            cv::LUT(dst_band, lut[eye], dst_band);
+        }
+    }
+private:
+    const cv::Mat* src;
+    cv::Mat*       dst;
+    const cv::Mat* map1;
+    const cv::Mat* map2;
+    const cv::Mat* lut;
+    int            band_cnt;
+};
+
+StereoPreprocess::StereoPreprocess(const cv::Mat (&c0_RM)[2],
+                                   const cv::Mat (&c1_RM)[2],
+                                   int hist_grid_step)
+{
+    map1[0] = c0_RM[0];
+    map2[0] = c0_RM[1];
+    map1[1] = c1_RM[0];
+    map2[1] = c1_RM[1];
+    grid_step = (hist_grid_step<1)?1:hist_grid_step;
+}
+
+//Same LUT as cv::equalizeHist, but the histogram is sampled every grid_step pixel
+void StereoPreprocess::calEqualizeLUT(const cv::Mat& img, int grid_step, cv::Mat& lut)
+{
+    int hist[256] = {0};
+    int total = 0;
+    for(int y=0; y<img.rows; y+=grid_step)
+    {
+        const uchar* row = img.ptr<uchar>(y);
+        for(int x=0; x<img.cols; x+=grid_step)
+        {
+            hist[row[x]]++;
+            total++;
+        }
+    }
+    lut.create(1,256,CV_8U);
+    uchar* p_lut = lut.ptr<uchar>(0);
+    int i = 0;
+    while(i<255 && hist[i]==0) i++;
+    if(hist[i]==total)
+    {//single intensity image
+        for(int j=0; j<256; j++) p_lut[j] = static_cast<uchar>(i);
+        return;
+    }
+    for(int j=0; j<=i; j++) p_lut[j] = 0;
+    float scale = 255.0f/(total-hist[i]);
+    int sum = 0;
+    for(i++; i<256; i++)
+    {
+        sum += hist[i];
+        p_lut[i] = cv::saturate_cast<uchar>(sum*scale);
+    }
+}
+
+void StereoPreprocess::process(const cv::Mat& img0_in,
+                               const cv::Mat& img1_in,
+                               cv::Mat& img0_out,
+                               cv::Mat& img1_out)
+{
+    //create() keeps the existing allocation of img0_out/img1_out if the size matches
+    img0_out.create(map1[0].size(),CV_8UC1);
+    img1_out.create(map1[1].size(),CV_8UC1);
+    cv::Mat src[2] = {img0_in,img1_in};
+    cv::Mat dst[2] = {img0_out,img1_out};
+    cv::Mat lut[2];
+
+    TaskPool::instance().parallelFor(cv::Range(0,2),HistLoopBody(src,lut,grid_step));
+
+    int band_cnt = (dst[0].rows+PREPROCESS_BAND_ROWS-1)/PREPROCESS_BAND_ROWS;
+    TaskPool::instance().parallelFor(cv::Range(0,2*band_cnt),
+                                     RemapLUTLoopBody(src,dst,map1,map2,lut,band_cnt));
+}
@@ -0,0 +1,225 @@
+#include "include/task_pool.h"
+#include <iostream>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+//cv::ParallelLoopBody adaptor of a function
+class FunctionLoopBody : public cv::ParallelLoopBody
+{
+public:
+    explicit FunctionLoopBody(const std::function<void(const cv::Range&)>& func) : func(func) {}
+    virtual void operator()(const cv::Range& range) const
+    {
+        func(range);
+    }
+private:
+    const std::function<void(const cv::Range&)>& func;
+};
+
+TaskPool& TaskPool::instance(void)
+{
+    static TaskPool pool;
+    return pool;
+}
+
+TaskPool::TaskPool()
+    : next_worker(0),
+      queued(0),
+      stopping(false)
+{
+    start(autoSize(1),TASK_POOL_NO_PINNING);
+}
+
+TaskPool::~TaskPool()
+{
+    stop();
+}
+
+int TaskPool::autoSize(const int busy_threads)
+{
+    int cpus = static_cast<int>(std::thread::hardware_concurrency());
+    if(cpus<=0) cpus = 1;
+    return std::max(0,cpus-std::max(0,busy_threads));
+}
+
+void TaskPool::configure(const int threads, const int first_cpu)
+{
+    stop();
+    start((threads<0)?autoSize(1):threads,first_cpu);
+}
+
+void TaskPool::start(const int threads, const int first_cpu)
+{
+    int cpus = std::max(1,static_cast<int>(std::thread::hardware_concurrency()));
+    for(int i=0; i<threads; i++)
+    {
+        workers.push_back(new Worker());
+    }
+    for(int i=0; i<threads; i++)
+    {
+        int cpu = (first_cpu<0)?TASK_POOL_NO_PINNING:((first_cpu+i)%cpus);
+        workers.at(i)->thread = std::thread(&TaskPool::workerLoop,this,i,cpu);
+    }
+    std::cout << "task pool: " << threads << " workers";
+    if(first_cpu>=0) std::cout << " pinned from cpu " << first_cpu;
+    std::cout << std::endl;
+}
+
+void TaskPool::stop(void)
+{
+    {
+        std::lock_guard<std::mutex> lk(sleep_mtx);
+        stopping = true;
+        wake.notify_all();
+    }
+    //join all before deleting, a running worker may still look into the other deques
+    for(size_t i=0; i<workers.size(); i++)
+    {
+        workers.at(i)->thread.join();
+    }
+    for(size_t i=0; i<workers.size(); i++)
+    {
+        delete workers.at(i);
+    }
+    workers.clear();
+    std::lock_guard<std::mutex> lk(sleep_mtx);
+    stopping = false;
+}
+
+void TaskPool::workerLoop(const int id, const int cpu)
+{
+#if defined(__linux__)
+    if(cpu>=0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu,&set);
+        if(pthread_setaffinity_np(pthread_self(),sizeof(cpu_set_t),&set)!=0)
+        {
+            std::cout << "task pool: can not pin worker " << id << " to cpu " << cpu << std::endl;
+        }
+    }
+#else
+    (void)cpu;
+#endif
+    Task task;
+    while(true)
+    {
+        if(tryPop(id,task))
+        {
+            run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(sleep_mtx);
+        wake.wait(lk,[this]{return stopping || queued>0;});
+        if(stopping) return;
+    }
+}
+
+bool TaskPool::tryPop(const int id, Task& task)
+{
+    int n = size();
+    //own deque, newest first (its data is still in the cache)
+    if(id>=0)
+    {
+        Worker* w = workers.at(id);
+        std::lock_guard<std::mutex> lk(w->mtx);
+        if(!w->tasks.empty())
+        {
+            task = w->tasks.back();
+            w->tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+    //steal the oldest task of the others
+    for(int k=0; k<n; k++)
+    {
+        int v = (id<0)?k:((id+1+k)%n);
+        if(v==id) continue;
+        Worker* w = workers.at(v);
+        std::lock_guard<std::mutex> lk(w->mtx);
+        if(!w->tasks.empty())
+        {
+            task = w->tasks.front();
+            w->tasks.pop_front();
+            queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::run(const Task& task)
+{
+    Group* g = task.group;
+    try
+    {
+        (*task.body)(task.range);
+    }
+    catch(...)
+    {
+        std::lock_guard<std::mutex> lk(g->mtx);
+        if(!g->error) g->error = std::current_exception();
+    }
+    //under the lock, the group lives on the stack of the submitting thread
+    std::lock_guard<std::mutex> lk(g->mtx);
+    if(--g->pending==0) g->done.notify_all();
+}
+
+void TaskPool::parallelFor(const cv::Range& range,
+                           const cv::ParallelLoopBody& body,
+                           const double nstripes)
+{
+    int n = range.end-range.start;
+    if(n<=0) return;
+    int stripes = (nstripes>0)?static_cast<int>(ceil(nstripes))
+                              :TASK_POOL_STRIPES_PER_CPU*(size()+1);
+    stripes = std::min(stripes,n);
+    if(workers.empty() || stripes<=1)
+    {
+        body(range);
+        return;
+    }
+
+    //STEP1: deal the chunks
+    Group group;
+    group.pending = stripes;
+    {
+        std::lock_guard<std::mutex> lk(sleep_mtx);
+        queued += stripes;
+    }
+    unsigned w0 = next_worker++;
+    for(int s=0; s<stripes; s++)
+    {
+        Task task;
+        task.body  = &body;
+        task.range = cv::Range(range.start+static_cast<int>(static_cast<int64_t>(n)*s/stripes),
+                               range.start+static_cast<int>(static_cast<int64_t>(n)*(s+1)/stripes));
+        task.group = &group;
+        Worker* w = workers.at((w0+s)%workers.size());
+        std::lock_guard<std::mutex> lk(w->mtx);
+        w->tasks.push_back(task);
+    }
+    wake.notify_all();
+
+    //STEP2: take part until no task is left, then wait for the running ones
+    Task task;
+    while(group.pending>0 && tryPop(-1,task))
+    {
+        run(task);
+    }
+    std::unique_lock<std::mutex> lk(group.mtx);
+    group.done.wait(lk,[&group]{return group.pending==0;});
+    if(group.error) std::rethrow_exception(group.error);
+}
+
+void TaskPool::parallelFor(const cv::Range& range,
+                           const std::function<void(const cv::Range&)>& func,
+                           const double nstripes)
+{
+    FunctionLoopBody body(func);
+    parallelFor(range,body,nstripes);
+}
@@ -0,0 +1,188 @@
+#include "include/tracking_pipeline.h"
+
+static inline double elapsedMs(const std::chrono::steady_clock::time_point& t0,
+                               const std::chrono::steady_clock::time_point& t1)
+{
+    return std::chrono::duration<double,std::milli>(t1-t0).count();
+}
+
+void StageLatency::add(const double ms)
+{
+    last_ms = ms;
+    mean_ms = (count==0)?ms:(0.95*mean_ms+0.05*ms);
+    if(ms>max_ms) max_ms = ms;
+    count++;
+}
+
+TrackingPipeline::TrackingPipeline(F2FTracking* tracker,
+                                   PoseCallback pose_cb,
+                                   FrameCallback frame_cb,
+                                   const int queue_size)
+    : tracker(tracker),
+      pose_cb(pose_cb),
+      frame_cb(frame_cb),
+      input_queue(std::max(1,queue_size)),
+      preprocessed_queue(std::max(1,queue_size)),
+      tracked_queue(1),
+      map_pending(false),
+      stopping(false)
+{
+    //camera model of the pooled frames
+    frame_template = std::make_shared<CameraFrame>();
+    frame_template->d_camera = tracker->curr_frame->d_camera;
+    frame_template->width    = tracker->curr_frame->width;
+    frame_template->height   = tracker->curr_frame->height;
+    //in flight: A + preprocessed queue + B/C (curr) + last
+    for(int i=0; i<(std::max(1,queue_size)+3); i++)
+    {
+        pool.push_back(newFrame());
+    }
+    thread_a = std::thread(&TrackingPipeline::stagePreprocess,this);
+    thread_b = std::thread(&TrackingPipeline::stageTracking,this);
+    thread_c = std::thread(&TrackingPipeline::stageMapping,this);
+}
+
+TrackingPipeline::~TrackingPipeline()
+{
+    {
+        std::lock_guard<std::mutex> lk(map_mtx);
+        stopping = true;
+        map_cv.notify_all();
+    }
+    input_queue.close();
+    preprocessed_queue.close();
+    tracked_queue.close();
+    thread_a.join();
+    thread_b.join();
+    thread_c.join();
+}
+
+CameraFrame::Ptr TrackingPipeline::acquireFrame(void)
+{
+    for(size_t i=0; i<pool.size(); i++)
+    {
+        if(pool.at(i).use_count()==1)//only held by the pool
+        {
+            return pool.at(i);
+        }
+    }
+    pool.push_back(newFrame());
+    return pool.back();
+}
+
+CameraFrame::Ptr TrackingPipeline::newFrame(void)
+{
+    CameraFrame::Ptr frame = std::make_shared<CameraFrame>();
+    frame->d_camera = frame_template->d_camera;
+    frame->width    = frame_template->width;
+    frame->height   = frame_template->height;
+    return frame;
+}
+
+void TrackingPipeline::push(const double time,
+                            const cv::Mat& img0_in,
+                            const cv::Mat& img1_in,
+                            const boost::shared_ptr<const void> img0_holder,
+                            const boost::shared_ptr<const void> img1_holder)
+{
+    InputJob job;
+    job.time = time;
+    job.img0 = img0_in;
+    job.img1 = img1_in;
+    job.holder[0] = img0_holder;
+    job.holder[1] = img1_holder;
+    job.t_in = std::chrono::steady_clock::now();
+    input_queue.push(job);
+}
+
+void TrackingPipeline::stagePreprocess(void)
+{
+    InputJob in;
+    while(input_queue.pop(in))
+    {
+        TimePoint t0 = std::chrono::steady_clock::now();
+        FrameJob job;
+        job.frame = acquireFrame();
+        job.time  = in.time;
+        job.t_in  = in.t_in;
+        tracker->preprocess(job.frame,in.time,in.img0,in.img1,in.holder[0],in.holder[1]);
+        in = InputJob();//release the input buffers
+        addLatency(LATENCY_PREPROCESS,elapsedMs(t0,std::chrono::steady_clock::now()));
+        if(!preprocessed_queue.push(job)) break;
+    }
+}
+
+void TrackingPipeline::stageTracking(void)
+{
+    FrameJob job;
+    while(preprocessed_queue.pop(job))
+    {
+        {   //the landmarks of the previous frame must be complete
+            std::unique_lock<std::mutex> lk(map_mtx);
+            map_cv.wait(lk,[this]{return stopping || !map_pending;});
+            if(stopping) break;
+            map_pending = true;
+        }
+        TimePoint t0 = std::chrono::steady_clock::now();
+        job.need_map_update = tracker->trackFrame(job.frame,job.new_keyframe,job.reset_cmd);
+        job.frame = tracker->curr_frame;//may be the last frame if this one was escaped
+        TimePoint t1 = std::chrono::steady_clock::now();
+        job.tracking_ms = elapsedMs(t0,t1);
+        addLatency(LATENCY_TRACKING,job.tracking_ms);
+        if(pose_cb) pose_cb(job.frame,job.time);
+        addLatency(LATENCY_POSE_OUTPUT,elapsedMs(job.t_in,std::chrono::steady_clock::now()));
+        if(!tracked_queue.push(job)) break;
+    }
+}
+
+void TrackingPipeline::stageMapping(void)
+{
+    FrameJob job;
+    while(tracked_queue.pop(job))
+    {
+        TimePoint t0 = std::chrono::steady_clock::now();
+        if(job.need_map_update)
+        {
+            tracker->updateMap(job.new_keyframe);
+        }
+        double mapping_ms = elapsedMs(t0,std::chrono::steady_clock::now());
+        addLatency(LATENCY_MAPPING,mapping_ms);
+        job.frame->solving_time = (job.tracking_ms+mapping_ms)/1000.0;
+        if(frame_cb) frame_cb(job.frame,job.time,job.new_keyframe,job.reset_cmd);
+        {
+            std::lock_guard<std::mutex> lk(map_mtx);
+            map_pending = false;
+            map_cv.notify_all();
+        }
+        addLatency(LATENCY_END_TO_END,elapsedMs(job.t_in,std::chrono::steady_clock::now()));
+        job = FrameJob();
+        if(PIPELINE_REPORT_PERIOD>0 && (getLatency(LATENCY_END_TO_END).count%PIPELINE_REPORT_PERIOD)==0)
+        {
+            printLatency();
+        }
+    }
+}
+
+void TrackingPipeline::addLatency(const TYPEOFLATENCY type, const double ms)
+{
+    std::lock_guard<std::mutex> lk(latency_mtx);
+    latency[type].add(ms);
+}
+
+StageLatency TrackingPipeline::getLatency(const TYPEOFLATENCY type)
+{
+    std::lock_guard<std::mutex> lk(latency_mtx);
+    return latency[type];
+}
+
+void TrackingPipeline::printLatency(void)
+{
+    const char* names[LATENCY_TYPES] = {"preprocess","tracking","mapping","pose output","end-to-end"};
+    std::lock_guard<std::mutex> lk(latency_mtx);
+    cout << "tracking pipeline latency [ms] (last/mean/max):" << endl;
+    for(int i=0; i<LATENCY_TYPES; i++)
+    {
+        cout << "  " << names[i] << ": "
+             << latency[i].last_ms << "/" << latency[i].mean_ms << "/" << latency[i].max_ms << endl;
+    }
+}
@@ -1,5 +1,6 @@
 #include "include/triangulation.h"
 #include <Eigen/Dense>
+#include <limits>
 
 Triangulation::Triangulation()
 {
@@ -28,7 +29,7 @@ Vec3 Triangulation::triangulationPt(Vec2 pt1, Vec2 pt2, Mat3x4 projection_matrix
     A.row(2)=v2*PT3_pm2-PT2_pm2;
     A.row(3)=PT1_pm2-u2*PT3_pm2;
 
-    Eigen::JacobiSVD<Eigen::MatrixXd> svd(A, Eigen::ComputeThinV);
+    Eigen::JacobiSVD<Mat4x4> svd(A, Eigen::ComputeFullV);
     Mat4x4 V = svd.matrixV();
 
     V(0, 3) /= V(3, 3);
@@ -38,20 +39,6 @@ Vec3 Triangulation::triangulationPt(Vec2 pt1, Vec2 pt2, Mat3x4 projection_matrix
     return V.block<3, 1>(0, 3);
 }
 
-bool Triangulation::trignaulationPtFromStereo(Vec2 pt0, Vec2 pt1,
-                                              Mat3x4 P0, Mat3x4 P1,
-                                              Vec3 &pt3d_c)
-{
-    pt3d_c = triangulationPt(pt0,pt1,P0,P1);
-    if(pt3d_c[2]< 0 || pt3d_c[2]>25)
-    {
-        return false;
-    }else
-    {
-        return true;
-    }
-}
-
 bool Triangulation::trignaulationPtFromStereo(Vec2 pt0, Vec2 pt1,
                                               Mat3x3 c0Matrix, Mat3x3 c1Matrix,
                                               SE3 T_c1_c0,
@@ -82,19 +69,13 @@ Vec3 Triangulation::triangulationPt(Vec2 pt1, Vec2 pt2,
                                     SE3 T_c_w1, SE3 T_c_w2,
                                     double fx, double fy, double cx, double cy)
 {
-    Mat3x3 K;//Kamera matrix
-    K<<fx,0,cx,0,fy,cy,0,0,1;
-
-    Mat3x4 T1,T2;//Transformation matrix
-    T1.topLeftCorner(3,3)=T_c_w1.rotation_matrix();
-    T1.topRightCorner(3,1)=T_c_w1.translation();
-    T2.topLeftCorner(3,3)=T_c_w2.rotation_matrix();
-    T2.topRightCorner(3,1)=T_c_w2.translation();
-
-    Mat3x4 P1,P2;//Projection Matrix
-    P1 = K*T1;
-    P2 = K*T2;
-    return triangulationPt(pt1,pt2,P1,P2);
+    vector<Vec2> pts1(1,pt1),pts2(1,pt2);
+    vector<Vec3> pts3d_w;
+    vector<unsigned char> status;
+    triangulationPts(pts1,pts2,T_c_w1,T_c_w2,fx,fy,cx,cy,
+                     -std::numeric_limits<double>::max(),std::numeric_limits<double>::max(),
+                     pts3d_w,status);
+    return pts3d_w.at(0);
 }
 
 Vec2 Triangulation::reProjection(Vec3 pt, SE3 T_c_w, double fx, double fy, double cx, double cy)
@@ -118,3 +99,76 @@ Vec2 Triangulation::reProjection(Vec3 pt, SE3 T_c_w, double fx, double fy, doubl
     //    cout << pt2d_homogeneous.transpose() << endl;
     return Vec2(pt2d_homogeneous(0)/pt2d_homogeneous(2),pt2d_homogeneous(1)/pt2d_homogeneous(2));
 }
+
+void Triangulation::triangulationPts(const vector<Vec2>& pts1,
+                                     const vector<Vec2>& pts2,
+                                     const SE3& T_c_w1,
+                                     const SE3& T_c_w2,
+                                     double fx, double fy, double cx, double cy,
+                                     double min_depth, double max_depth,
+                                     vector<Vec3>& pts3d_w,
+                                     vector<unsigned char>& status)
+{
+    size_t n = pts1.size();
+    pts3d_w.resize(n);
+    status.resize(n);
+    if(n==0) return;
+    //ray of camera 1 in camera 2: lambda1*(R_21*f1)+t_21, ray of camera 2: lambda2*f2
+    //f = ((u-cx)/fx,(v-cy)/fy,1), lambda is the depth
+    SE3 T_c2_c1 = T_c_w2*T_c_w1.inverse();
+    SE3 T_w_c2  = T_c_w2.inverse();
+    Mat3x3 R = T_c2_c1.rotation_matrix();
+    Vec3   t = T_c2_c1.translation();
+    vector<double> lambda1(n),lambda2(n),det(n);
+    for(size_t i=0; i<n; i++)
+    {
+        Vec3 f1((pts1[i][0]-cx)/fx,(pts1[i][1]-cy)/fy,1.0);
+        Vec3 f2((pts2[i][0]-cx)/fx,(pts2[i][1]-cy)/fy,1.0);
+        Vec3 a = R*f1;
+        //min |lambda1*a+t-lambda2*f2|^2
+        double aa = a.dot(a);
+        double af = a.dot(f2);
+        double ff = f2.dot(f2);
+        double at = a.dot(t);
+        double ft = f2.dot(t);
+        double d  = aa*ff-af*af;
+        double l1 = (-at*ff+af*ft)/d;
+        double l2 = ( aa*ft-af*at)/d;
+        det[i] = d/(aa*ff);//sin^2 of the parallax angle
+        lambda1[i] = l1;
+        lambda2[i] = l2;
+        pts3d_w[i] = T_w_c2*(0.5*(l1*a+t+l2*f2));
+    }
+    for(size_t i=0; i<n; i++)
+    {
+        status[i] = (det[i]>1e-12) & (lambda1[i]>0) & (lambda2[i]>=min_depth) & (lambda2[i]<=max_depth);
+    }
+}
+
+void Triangulation::trignaulationPtsFromStereo(const vector<Vec2>& pts0,
+                                               const vector<Vec2>& pts1,
+                                               const Mat3x4& P0,
+                                               const Mat3x4& P1,
+                                               double min_depth, double max_depth,
+                                               vector<Vec3>& pts3d_c,
+                                               vector<unsigned char>& status)
+{
+    size_t n = pts0.size();
+    pts3d_c.resize(n);
+    status.resize(n);
+    double fb  = P0(0,3)-P1(0,3);
+    double dcx = P0(0,2)-P1(0,2);
+    double fx_inv = 1.0/P0(0,0);
+    double fy_inv = 1.0/P0(1,1);
+    double cx = P0(0,2);
+    double cy = P0(1,2);
+    for(size_t i=0; i<n; i++)
+    {
+        double d = (pts0[i][0]-pts1[i][0])-dcx;
+        double z = fb/d;
+        pts3d_c[i] = Vec3((pts0[i][0]-cx)*z*fx_inv,
+                          (pts0[i][1]-cy)*z*fy_inv,
+                          z);
+        status[i] = (d>0) & (z>=min_depth) & (z<=max_depth);
+    }
+}
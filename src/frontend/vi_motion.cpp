@@ -25,6 +25,15 @@ VIMOTION::VIMOTION(SE3 T_i_c_fromCalibration,
     this->para_2=para_2_in;
     this->para_3=para_3_in;
     this->para_4=para_4_in;
+    this->states.init(STATES_QUEUE_SIZE);
+    this->has_request = false;
+    this->has_reset = false;
+    this->has_correction = false;
+}
+
+void VIMOTION::setStatesCapacity(const int capacity)
+{
+    this->states.init(capacity);
 }
 
 void VIMOTION::viIMUinitialization(const IMUSTATE imu_read,
@@ -52,8 +61,7 @@ void VIMOTION::viIMUinitialization(const IMUSTATE imu_read,
                  << "roll:"   << rpy[0]*57.2958
                  << " pitch:" << rpy[1]*57.2958
                  << " yaw:"   << rpy[2]*57.2958 << endl;
-            this->states.push_back(init_state);
-            if(states.size()>=STATES_QUEUE_SIZE) {states.pop_front();}
+            this->states.push(init_state);
             this->is_first_data =  false;
             q_w_i = rpy2Q(rpy);
         }
@@ -95,9 +103,7 @@ void VIMOTION::viIMUinitialization(const IMUSTATE imu_read,
         Quaterniond q_new = q_plus_q(q_prev,scalar_multi_q(dt,qdot));
         q_new.normalize();
         this->init_state.q_w_i = q_new;
-        this->states.push_back(init_state);
-        Vec3 rpy =  Q2rpy(states.back().q_w_i);
-        if(states.size()>=STATES_QUEUE_SIZE) {states.pop_front();}
+        this->states.push(init_state);
         if(states.size()>30)
         {
             Vec3 rpy =  Q2rpy(states.back().q_w_i);
@@ -112,8 +118,8 @@ void VIMOTION::viIMUinitialization(const IMUSTATE imu_read,
 
 void VIMOTION::viVisiontrigger(Quaterniond &init_orientation)
 {
-    this->mtx_states_RW.lock();
-    MOTION_STATE state = this->states.back();
+    MOTION_STATE state;
+    states.latestState(state);
     state.pos = Vec3(0,0,0);
     state.vel = Vec3(0,0,0);
     //reset yaw angle to zero
@@ -122,9 +128,13 @@ void VIMOTION::viVisiontrigger(Quaterniond &init_orientation)
     Quaterniond q = rpy2Q(rpy);
     q.normalize();
     state.q_w_i = q;
-    states.clear();
-    states.push_back(state);
-    this->mtx_states_RW.unlock();
+    //the IMU thread restarts the ring from this state
+    this->mtx_request.lock();
+    this->reset_state = state;
+    this->has_reset = true;
+    this->has_correction = false;
+    this->has_request = true;
+    this->mtx_request.unlock();
     cout << "Vision Trigger at: "
          << "roll:"   << rpy[0]*57.2958
          << " pitch:" << rpy[1]*57.2958
@@ -132,11 +142,69 @@ void VIMOTION::viVisiontrigger(Quaterniond &init_orientation)
     init_orientation = state.q_w_i;
 }
 
+void VIMOTION::postBiasFeedback(const Vec3& acc_bias_est, const Vec3& gyro_bias_est)
+{
+    BIAS_FEEDBACK b;
+    b.acc_bias_est  = acc_bias_est;
+    b.gyro_bias_est = gyro_bias_est;
+    this->mtx_request.lock();
+    this->bias_feedback.push_back(b);
+    this->has_request = true;
+    this->mtx_request.unlock();
+}
+
+void VIMOTION::applyRequests(void)
+{
+    if(!has_request) return;
+    //never wait for the image thread, try again with the next IMU data
+    if(!this->mtx_request.try_lock()) return;
+    bool reset = has_reset;
+    bool corr  = has_correction;
+    MOTION_STATE      s_reset = reset_state;
+    VISION_CORRECTION c = correction;
+    vector<BIAS_FEEDBACK> bias_steps;
+    bias_steps.swap(bias_feedback);
+    has_reset = has_correction = false;
+    has_request = false;
+    this->mtx_request.unlock();
+
+    if(reset)
+    {
+        states.reset(s_reset);
+    }
+    if(corr)
+    {
+        Mat3x3 R_diff = c.q_diff.toRotationMatrix();
+        states.updateFrom(c.t_vel,[&c](MOTION_STATE& s){
+            s.vel += c.dv;
+        });
+        states.updateFrom(c.t_pose,[&c,&R_diff](MOTION_STATE& s){
+            s.q_w_i = c.q_diff*s.q_w_i;
+            s.q_w_i.normalize();
+            s.pos   = R_diff*s.pos+c.t_diff;
+        });
+    }
+    //same update as applied directly by viCorrectionFromVision before, one step per call
+    for(size_t k=0; k<bias_steps.size(); k++)
+    {
+        acc_bias  = acc_bias*(1-this->para_3) + (this->para_3)*bias_steps[k].acc_bias_est;
+        gyro_bias = acc_bias*(1-this->para_4) + (this->para_4)*bias_steps[k].gyro_bias_est;
+        for (int i=0; i<3; i++)
+        {
+            if(acc_bias[i]>1.0) acc_bias[i] = 1.0;
+            if(acc_bias[i]<-1.0) acc_bias[i] = -1.0;
+            if(gyro_bias[i]>0.1) gyro_bias[i] = 0.1;
+            if(gyro_bias[i]<-0.1) gyro_bias[i] = -0.1;
+        }
+    }
+}
+
 void VIMOTION::viIMUPropagation(const IMUSTATE imu_read,
                                 Quaterniond& q_w_i,
                                 Vec3& pos_w_i,
                                 Vec3& vel_w_i)
 {
+    applyRequests();
     MOTION_STATE s_prev,s_new;//previous state and new state
     Vec3 acc, gyro;
     acc =  imu_read.acc_raw  - acc_bias;
@@ -191,21 +259,14 @@ void VIMOTION::viIMUPropagation(const IMUSTATE imu_read,
     s_new.vel = v_prev+v_dot;
     s_new.imu_data = imu_read;
 
-    this->mtx_states_RW.lock();
-    states.push_back(s_new);
-    if(states.size()>=STATES_QUEUE_SIZE) {states.pop_front();}
-    this->mtx_states_RW.unlock();
+    states.push(s_new);
     q_w_i   = s_new.q_w_i;
     pos_w_i = s_new.pos;
     vel_w_i = s_new.vel;
 }
-//this->mtx_states_RW.lock();
-//this->mtx_states_RW.unlock();
 void VIMOTION::viCorrectionFromVision(const double t_curr, const SE3 Tcw_curr,
                                       const double t_last, const SE3 Tcw_last)
 {
-    Vec3 acc_bias_est=Vec3(0,0,0);
-    Vec3 gyro_bias_est=Vec3(0,0,0);
     double dt = t_curr-t_last;
     SE3 Twi_curr =  (Tcw_curr.inverse())*T_c_i;
     SE3 Twi_last =  (Tcw_last.inverse())*T_c_i;
@@ -215,13 +276,14 @@ void VIMOTION::viCorrectionFromVision(const double t_curr, const SE3 Tcw_curr,
     Quaterniond qwi_last = Twi_last.unit_quaternion();
     Quaterniond qwi_mid_v = qwi_last.slerp(0.5,qwi_curr);
 
-    this->mtx_states_RW.lock();
-    int idx_mid,idx_curr;
     double t_mid=0.5*dt+t_last;
-    if(viFindStateIdx(t_mid, idx_mid)&&viFindStateIdx(t_curr, idx_curr))
+    MOTION_STATE mid0, mid1, curr0, curr1;
+    if(states.find(t_mid,mid0,mid1)&&states.find(t_curr,curr0,curr1))
     {
-        Quaterniond qwi_mid_i = states.at(idx_mid).q_w_i;
-        Vec3 vwi_mid_i = states.at(idx_mid).vel;
+        MOTION_STATE s_mid  = MotionStateRing::lerp(mid0,mid1,t_mid);
+        MOTION_STATE s_curr = MotionStateRing::lerp(curr0,curr1,t_curr);
+        Quaterniond qwi_mid_i = s_mid.q_w_i;
+        Vec3 vwi_mid_i = s_mid.vel;
 
         Quaterniond dq_vision_imu = qwi_mid_v.inverse() * qwi_mid_i;
         Vec3 dv_vision_imu_wf = vwi_mid_v - vwi_mid_i;//in world frame
@@ -233,37 +295,31 @@ void VIMOTION::viCorrectionFromVision(const double t_curr, const SE3 Tcw_curr,
         //        cout << "dv_vision_imu_wf: " << dv_vision_imu_wf.transpose() << endl;
         //        cout << "dv_vision_imu_if: " << dv_vision_imu_if.transpose() << endl;
 
-        acc_bias_est = -(1.0/dt)*dv_vision_imu_if;
-        gyro_bias_est[0] = (1.0/dt)*dq_vision_imu.x();
-        gyro_bias_est[1] = (1.0/dt)*dq_vision_imu.y();
-        gyro_bias_est[2] = (1.0/dt)*dq_vision_imu.z();
-        for(int i=idx_mid; i<states.size(); i++)
-        {
-            states.at(i).vel+=dv_vision_imu_wf;
-        }
-        SE3 T_diff = Twi_curr*SE3(states.at(idx_curr).q_w_i,states.at(idx_curr).pos).inverse();
-        for(int i=idx_curr; i<states.size(); i++)
-        {
-            SE3 newT = T_diff*SE3(states.at(i).q_w_i,states.at(i).pos);
-            states.at(i).q_w_i = newT.unit_quaternion();
-            states.at(i).pos = newT.translation();
-        }
+        Vec3 gyro_bias_est((1.0/dt)*dq_vision_imu.x(),
+                           (1.0/dt)*dq_vision_imu.y(),
+                           (1.0/dt)*dq_vision_imu.z());
+        postBiasFeedback(-(1.0/dt)*dv_vision_imu_if,gyro_bias_est);
+        VISION_CORRECTION c;
+        //from the sample before t, the interpolation at t is corrected as well
+        c.t_vel  = mid0.imu_data.timestamp;
+        c.dv     = dv_vision_imu_wf;
+        c.t_pose = curr0.imu_data.timestamp;
+        //T_diff = Twi_curr*T_w_i(t_curr)^-1
+        c.q_diff = qwi_curr*s_curr.q_w_i.inverse();
+        c.q_diff.normalize();
+        c.t_diff = Twi_curr.translation()-c.q_diff.toRotationMatrix()*s_curr.pos;
+        //a newer correction replaces one not applied yet
+        this->mtx_request.lock();
+        this->correction = c;
+        this->has_correction = true;
+        this->has_request = true;
+        this->mtx_request.unlock();
     }
     else
     {
         cout << "No Correction" << endl;
-    }
-    this->mtx_states_RW.unlock();
-    //correct
-
-    acc_bias  = acc_bias*(1-this->para_3) + (this->para_3)*acc_bias_est;
-    gyro_bias = acc_bias*(1-this->para_4) + (this->para_4)*gyro_bias_est;
-    for (int i=0; i<3; i++)
-    {
-        if(acc_bias[i]>1.0) acc_bias[i] = 1.0;
-        if(acc_bias[i]<-1.0) acc_bias[i] = -1.0;
-        if(gyro_bias[i]>0.1) gyro_bias[i] = 0.1;
-        if(gyro_bias[i]<-0.1) gyro_bias[i] = -0.1;
+        //zero estimates: the biases decay by (1-para_3)/(1-para_4)
+        postBiasFeedback(Vec3(0,0,0),Vec3(0,0,0));
     }
 
 //    cout << "acc_bias : " << acc_bias.transpose() << endl;
@@ -271,97 +327,72 @@ void VIMOTION::viCorrectionFromVision(const double t_curr, const SE3 Tcw_curr,
 }
 
 
-// 1   2   3   4   5   6   7   8   9   10   //states queue
-//                   |                      //the state
-// return the state 5
-bool VIMOTION::viFindStateIdx(const double time, int& idx_in_q)
+//interpolated state at time
+bool VIMOTION::viFindState(const double time, MOTION_STATE& state)
 {
-    bool ret;
-    int idx=9999;
-
-    for(int i=states.size()-1; i>=0; i--)
+    if(states.interpolate(time,state))
     {
-        if((states.at(i).imu_data.timestamp-time)>0)
-        {
-            idx = i;
-        }
-        else
-        {
-            idx = i;
-            break;
-        }
+        return true;
     }
-
-    if(idx>0 && idx!=9999)
+    MOTION_STATE latest;
+    cout << "[Critical Warning]: motion not in queue! please enlarge the buffer size" << endl;
+    cout << " queue size:" << states.size()
+         << " querry time:" << std::setprecision (15) << time;
+    if(states.latestState(latest))
     {
-        idx_in_q = idx;
-        //    cout << "idx in queue:" << idx << endl;
-        //    cout << "      time  :" << this->states.at(idx).imu_data.timestamp << endl;
-        ret = true;
+        cout << " q end  :" << latest.imu_data.timestamp;
     }
-    else
-    {
-        cout << "[Critical Warning]: motion not in queue! please enlarge the buffer size" << endl;
-        cout << " queue size:" << states.size()
-             << " querry time:" << std::setprecision (15) << time
-             << " q begin:" << this->states.front().imu_data.timestamp
-             << " q end  :" << this->states.back().imu_data.timestamp << endl;
-        ret = false;
-    }
-    return ret;
+    cout << endl;
+    return false;
 }
 
 
 bool VIMOTION::viGetIMURollPitchAtTime(const double time, double &roll, double &pitch)
 {
     MOTION_STATE state;
-    bool found;
-    this->mtx_states_RW.lock();
-    int idx;
-    if(this->viFindStateIdx(time,idx))
-    {
-        state=states.at(idx);
-        SE3 T_w_i = SE3(state.q_w_i,state.pos);
-        Vec3 rpy= Q2rpy(T_w_i.so3().unit_quaternion());
-        roll  = rpy[0];
-        pitch = rpy[1];
-        found = true;
-    }else
-    {
-        found = false;
-    }
-    this->mtx_states_RW.unlock();
-    return found;
+    if(!this->viFindState(time,state)) return false;
+    Vec3 rpy= Q2rpy(state.q_w_i);
+    roll  = rpy[0];
+    pitch = rpy[1];
+    return true;
 }
 
 void VIMOTION::viGetLatestImuState(SE3 &T_w_i, Vec3 &vel)
 {
-    this->mtx_states_RW.lock();
-    T_w_i = SE3(SO3(states.back().q_w_i),states.back().pos);
-    vel   = states.back().vel;
-    this->mtx_states_RW.unlock();
+    MOTION_STATE state;
+    if(!states.latestState(state)) return;
+    T_w_i = SE3(SO3(state.q_w_i),state.pos);
+    vel   = state.vel;
 }
 
 bool VIMOTION::viGetCorrFrameState(const double time, SE3 &T_c_w)
 {
-    bool ret;
-    int  idx;
     MOTION_STATE state;
-    this->mtx_states_RW.lock();
-    if(this->viFindStateIdx(time,idx))
-    {
-        state=states.at(idx);
-        SE3 T_w_i = SE3(state.q_w_i,state.pos);
-        SE3 T_w_c = T_w_i * this->T_i_c;
-        T_c_w = T_w_c.inverse();
-        cout << T_w_i.translation() << endl;
-        ret = true;
-    }else
-    {
-        ret = false;
-    }
-    this->mtx_states_RW.unlock();
-    return ret;
+    if(!this->viFindState(time,state)) return false;
+    SE3 T_w_i = SE3(state.q_w_i,state.pos);
+    SE3 T_w_c = T_w_i * this->T_i_c;
+    T_c_w = T_w_c.inverse();
+    cout << T_w_i.translation() << endl;
+    return true;
+}
+
+bool VIMOTION::viGetCamPoseAtTime(const double time, SE3 &T_w_c)
+{
+    MOTION_STATE state;
+    //not viFindState: a miss is expected here (before the IMU covers the frame) and not reported
+    if(!states.interpolate(time,state)) return false;
+    T_w_c = SE3(state.q_w_i,state.pos)*this->T_i_c;
+    return true;
+}
+
+bool VIMOTION::viGetRelativeCamMotion(const double t_from, const double t_to, SE3 &T_cto_cfrom)
+{
+    MOTION_STATE s_from, s_to;
+    if(!this->viFindState(t_from,s_from) || !this->viFindState(t_to,s_to)) return false;
+    SE3 T_w_i_from = SE3(s_from.q_w_i,s_from.pos);
+    SE3 T_w_i_to   = SE3(s_to.q_w_i,s_to.pos);
+    T_cto_cfrom = this->T_c_i*T_w_i_to.inverse()*T_w_i_from*this->T_i_c;
+    return true;
 }
 
 void VIMOTION::viVisionRPCompensation(const double time, SE3 &T_c_w)
@@ -15,13 +15,16 @@
 #include <include/tic_toc_ros.h>
 #include <include/common.h>
 #include <include/f2f_tracking.h>
+#include <include/tracking_pipeline.h>
+#include <include/frame_admission.h>
+#include <include/task_pool.h>
 #include <include/rviz_frame.h>
 #include <include/rviz_path.h>
 #include <include/rviz_pose.h>
 #include <include/rviz_odom.h>
 
 #include <include/yamlRead.h>
-#include <include/cv_draw.h>
+#include <include/frame_visualizer.h>
 #include <flvis/KeyFrame.h>
 #include <flvis/CorrectionInf.h>
 #include <include/keyframe_msg.h>
@@ -40,13 +43,15 @@ enum TYPEOFIMU{D435I,
 class TrackingNodeletClass : public nodelet::Nodelet
 {
 public:
-  TrackingNodeletClass()  {;}
-  ~TrackingNodeletClass() {;}
+  TrackingNodeletClass()  {tracking_pipeline=NULL;frame_admission=NULL;visualizer=NULL;}
+  ~TrackingNodeletClass() {delete frame_admission;delete tracking_pipeline;delete visualizer;}
 private:
   bool is_lite_version;
   enum TYPEOFCAMERA cam_type;
   enum TYPEOFIMU imu_type;
   F2FTracking   *cam_tracker;
+  TrackingPipeline *tracking_pipeline;//NULL: image_feed on the callback thread
+  FrameAdmission   *frame_admission;//NULL: every synchronized pair is processed
   //Subscribers
   message_filters::Subscriber<sensor_msgs::Image> img0_sub;
   message_filters::Subscriber<sensor_msgs::Image> img1_sub;
@@ -58,18 +63,15 @@ private:
   //Octomap
   OctomapFeeder* octomap_pub;
   //Visualization
-  cv::Mat img0_vis;
-  cv::Mat img1_vis;
-  image_transport::Publisher img0_pub;
-  image_transport::Publisher img1_pub;
+  FrameVisualizer* visualizer;//images and frame markers, on its own thread
   ros::Publisher imu_pose_pub;
   ros::Publisher vision_pose_pub;
-  RVIZFrame* frame_pub;
   RVIZPath*  vision_path_pub;
   RVIZPath*  imu_path_pub;
   RVIZPath*  path_lc_pub;
   RVIZOdom*  odom_imu_pub;
   RVIZPose*  pose_imu_pub;
+  RVIZPose*  bridge_pose_pub;
   KeyFrameMsg* kf_pub;
   tf::StampedTransform tranOdomMap;
   tf::TransformListener listenerOdomMap;
@@ -83,15 +85,12 @@ private:
     vision_path_pub = new RVIZPath(nh,"/vision_path","map",1,3000);
     path_lc_pub     = new RVIZPath(nh,"/vision_path_lc","map",1,3000);
     imu_path_pub    = new RVIZPath(nh,"/imu_path","map",1,400);
-    frame_pub       = new RVIZFrame(nh,"/vo_camera_pose","map","/vo_curr_frame","map");
     pose_imu_pub    = new RVIZPose(nh,"/imu_pose","map");
+    bridge_pose_pub = new RVIZPose(nh,"/vo_bridge_pose","map");
     odom_imu_pub    = new RVIZOdom(nh,"/imu_odom","map");
     kf_pub          = new KeyFrameMsg(nh,"/vo_kf");
     //        octomap_pub  = new OctomapFeeder(nh,"/vo_octo_tracking","vo_local",1);
     //        octomap_pub->d_camera=curr_frame->d_camera;
-    image_transport::ImageTransport it(nh);
-    img0_pub = it.advertise("/vo_img0", 1);
-    img1_pub = it.advertise("/vo_img1", 1);
 
     cam_tracker = new F2FTracking();
     //Load Parameter
@@ -106,6 +105,15 @@ private:
     int vi_type_from_yaml = getIntVariableFromYaml(configFilePath,"type_of_vi");
     int image_width  = getIntVariableFromYaml(configFilePath,"image_width");
     int image_height = getIntVariableFromYaml(configFilePath,"image_height");
+    int detector_from_yaml = getIntVariableFromYaml(configFilePath,"feature_detector",0);
+    int pipeline_from_yaml = getIntVariableFromYaml(configFilePath,"pipeline_tracking",0);
+    int pipeline_queue_size = getIntVariableFromYaml(configFilePath,"pipeline_queue_size",PIPELINE_QUEUE_SIZE);
+    int task_pool_threads = getIntVariableFromYaml(configFilePath,"task_pool_threads",TASK_POOL_AUTO_SIZE);
+    int task_pool_first_cpu = getIntVariableFromYaml(configFilePath,"task_pool_first_cpu",TASK_POOL_NO_PINNING);
+    int imu_states_capacity = getIntVariableFromYaml(configFilePath,"imu_states_capacity",STATES_QUEUE_SIZE);
+    int admission_from_yaml = getIntVariableFromYaml(configFilePath,"frame_admission",0);
+    int admission_max_age_ms = getIntVariableFromYaml(configFilePath,"admission_max_age_ms",ADMISSION_NO_MAX_AGE);
+    int kf_compression_from_yaml = getIntVariableFromYaml(configFilePath,"kf_image_compression",0);
     Vec4 parameter = Vec4(getDoubleVariableFromYaml(configFilePath,"para_1"),
                           getDoubleVariableFromYaml(configFilePath,"para_2"),
                           getDoubleVariableFromYaml(configFilePath,"para_3"),
@@ -114,6 +122,18 @@ private:
     cv::Mat cam0_distCoeffs   = distCoeffsFromYaml(configFilePath,"cam0_distortion_coeffs");
     cout << "image_width :" << image_width << endl;
     cout << "image_height:" << image_height << endl;
+    cout << "feature_detector:" << detector_from_yaml << endl;
+    cout << "pipeline_tracking:" << pipeline_from_yaml << endl;
+    cout << "frame_admission:" << admission_from_yaml << endl;
+    cout << "kf_image_compression:" << kf_compression_from_yaml << endl;
+    if(kf_compression_from_yaml==1) kf_pub->enableImageCompression();
+    //auto: leave one core to each thread that submits loops (image callback or the three
+    //pipeline stages) and one to the backend nodelets sharing the manager
+    if(task_pool_threads<0)
+    {
+      task_pool_threads = TaskPool::autoSize(((pipeline_from_yaml==1)?3:1)+1);
+    }
+    TaskPool::instance().configure(task_pool_threads,task_pool_first_cpu);
     cout << "cam0_cameraMatrix:" << endl << cam0_cameraMatrix << endl;
     cout << "cam0_distCoeffs  :" << endl << cam0_distCoeffs << endl;
     if(vi_type_from_yaml==0)
@@ -173,6 +193,24 @@ private:
       img0_sub.subscribe(nh, "/vo/image0", 1);
       img1_sub.subscribe(nh, "/vo/image1", 1);
     }
+    cam_tracker->vimotion->setStatesCapacity(imu_states_capacity);//before the IMU subscriber
+    visualizer = new FrameVisualizer(nh,cam_type,!is_lite_version);
+    cam_tracker->feature_dem->setDetectorBackend((detector_from_yaml==1)?FAST_DETECTOR:GFTT_DETECTOR);
+    if(pipeline_from_yaml==1)
+    {
+      tracking_pipeline = new TrackingPipeline(cam_tracker,
+                                               boost::bind(&TrackingNodeletClass::pub_pose,this,_1,_2),
+                                               boost::bind(&TrackingNodeletClass::pub_frame,this,_1,_2,_3,_4),
+                                               pipeline_queue_size);
+    }
+
+    if(admission_from_yaml==1)
+    {
+      frame_admission = new FrameAdmission(boost::bind(&TrackingNodeletClass::process_frame,this,_1),
+                                           boost::bind(&TrackingNodeletClass::bridge_pose,this,_1),
+                                           admission_max_age_ms,
+                                           tracking_pipeline!=NULL);
+    }
 
     correction_inf_sub = nh.subscribe<flvis::CorrectionInf>(
           "/vo_localmap_feedback",
@@ -239,39 +277,14 @@ private:
 
   void correction_feedback_callback(const flvis::CorrectionInf::ConstPtr& msg)
   {
-    //unpacking and update the structure
-    CorrectionInfStruct correction_inf;
-    CorrectionInfMsg::unpack(msg,
-                             correction_inf.frame_id,
-                             correction_inf.T_c_w,
-                             correction_inf.lm_count,
-                             correction_inf.lm_id,
-                             correction_inf.lm_3d,
-                             correction_inf.lm_outlier_count,
-                             correction_inf.lm_outlier_id);
+    //unpack into the mailbox, the tracking thread picks the latest one up at STEP1
+    cam_tracker->correction_feed(msg);
   }
 
-  void image_input_callback(const sensor_msgs::ImageConstPtr & img0_Ptr,
-                            const sensor_msgs::ImageConstPtr & img1_Ptr)
+  void pub_pose(const CameraFrame::Ptr& frame, const double time)
   {
-    //tic_toc_ros tt_cb;
-    ros::Time tstamp = img0_Ptr->header.stamp;
-
-    cv_bridge::CvImagePtr cvbridge_img0  = cv_bridge::toCvCopy(img0_Ptr, img0_Ptr->encoding);
-    cv_bridge::CvImagePtr cvbridge_img1  = cv_bridge::toCvCopy(img1_Ptr, img1_Ptr->encoding);
-    bool newkf;//new key frame
-    bool reset_cmd;//reset command to localmap node
-    this->cam_tracker->image_feed(tstamp.toSec(),
-                                  cvbridge_img0->image,
-                                  cvbridge_img1->image,
-                                  newkf,
-                                  reset_cmd);
-    if(newkf) kf_pub->pub(*cam_tracker->curr_frame,tstamp);
-    if(reset_cmd) kf_pub->cmdLMResetPub(ros::Time(tstamp));
-    frame_pub->pubFramePtsPoseT_c_w(this->cam_tracker->curr_frame->getValid3dPts(),
-                                    this->cam_tracker->curr_frame->T_c_w,
-                                    tstamp);
-    vision_path_pub->pubPathT_c_w(this->cam_tracker->curr_frame->T_c_w,tstamp);
+    ros::Time tstamp(time);
+    vision_path_pub->pubPathT_c_w(frame->T_c_w,tstamp);
     SE3 T_map_c =SE3();
     try{
       listenerOdomMap.lookupTransform("map","odom",ros::Time(0), tranOdomMap);
@@ -279,31 +292,84 @@ private:
       tf::Quaternion tf_q = tranOdomMap.getRotation();
       SE3 T_map_odom(Quaterniond(tf_q.w(),tf_q.x(),tf_q.y(),tf_q.z()),
                      Vec3(tf_t.x(),tf_t.y(),tf_t.z()));
-      T_map_c = T_map_odom.inverse()*this->cam_tracker->curr_frame->T_c_w.inverse();
+      T_map_c = T_map_odom.inverse()*frame->T_c_w.inverse();
       path_lc_pub->pubPathT_w_c(T_map_c,tstamp);
     }
     catch (tf::TransformException ex)
     {
       //cout<<"no transform between map and odom yet."<<endl;
     }
-    if(!is_lite_version)
+  }
+
+  void pub_frame(const CameraFrame::Ptr& frame, const double time,
+                 const bool newkf, const bool reset_cmd)
+  {
+    ros::Time tstamp(time);
+    if(newkf) kf_pub->pub(*frame,tstamp);
+    if(reset_cmd) kf_pub->cmdLMResetPub(tstamp);
+    //snapshot only, drawing and publishing are done by the visualizer thread
+    visualizer->submit(*frame,tstamp);
+  }
+
+  //IMU propagated camera pose at the time of a frame the admission dropped
+  void bridge_pose(const double time)
+  {
+    if(!cam_tracker->has_imu || !cam_tracker->vimotion->imu_initialized) return;
+    SE3 T_w_c;
+    if(cam_tracker->vimotion->viGetCamPoseAtTime(time,T_w_c))
+    {
+      bridge_pose_pub->pubPose(T_w_c.unit_quaternion(),T_w_c.translation(),ros::Time(time));
+    }
+  }
+
+  void process_frame(const AdmittedFrame& in)
+  {
+    if(tracking_pipeline!=NULL)
+    {
+      //pub_pose/pub_frame are called from the pipeline threads
+      tracking_pipeline->push(in.time,in.img0,in.img1,in.holder[0],in.holder[1]);
+      return;
+    }
+    bool newkf;//new key frame
+    bool reset_cmd;//reset command to localmap node
+    this->cam_tracker->image_feed(in.time,
+                                  in.img0,
+                                  in.img1,
+                                  newkf,
+                                  reset_cmd,
+                                  in.holder[0],
+                                  in.holder[1]);
+    pub_pose(cam_tracker->curr_frame,in.time);
+    pub_frame(cam_tracker->curr_frame,in.time,newkf,reset_cmd);
+  }
+
+  void image_input_callback(const sensor_msgs::ImageConstPtr & img0_Ptr,
+                            const sensor_msgs::ImageConstPtr & img1_Ptr)
+  {
+    //tic_toc_ros tt_cb;
+    ros::Time tstamp = img0_Ptr->header.stamp;
+
+    //share the message buffer, cvbridge_img0/1 keep the message alive while the frame uses it
+    cv_bridge::CvImageConstPtr cvbridge_img0  = cv_bridge::toCvShare(img0_Ptr, img0_Ptr->encoding);
+    cv_bridge::CvImageConstPtr cvbridge_img1  = cv_bridge::toCvShare(img1_Ptr, img1_Ptr->encoding);
+    if(frame_admission!=NULL)
     {
-      cvtColor(cam_tracker->curr_frame->img0,img0_vis,CV_GRAY2BGR);
-      if(cam_type==DEPTH_D435)
-      {
-        drawFrame(img0_vis,*this->cam_tracker->curr_frame,1,6);
-        visualizeDepthImg(img1_vis,*this->cam_tracker->curr_frame);
-      }
-      if(cam_type==STEREO_EuRoC_MAV)
-      {
-        drawFrame(img0_vis,*this->cam_tracker->curr_frame,1,11);
-        cvtColor(cam_tracker->curr_frame->img1,img1_vis,CV_GRAY2BGR);
-      }
-      sensor_msgs::ImagePtr img0_msg = cv_bridge::CvImage(std_msgs::Header(), "bgr8", img0_vis).toImageMsg();
-      sensor_msgs::ImagePtr img1_msg = cv_bridge::CvImage(std_msgs::Header(), "bgr8", img1_vis).toImageMsg();
-      img0_pub.publish(img0_msg);
-      img1_pub.publish(img1_msg);
+      //returns at once, the admission thread runs process_frame on the newest pair
+      frame_admission->push(tstamp.toSec(),
+                            (ros::Time::now()-tstamp).toSec()*1000.0,
+                            cvbridge_img0->image,
+                            cvbridge_img1->image,
+                            cvbridge_img0,
+                            cvbridge_img1);
+      return;
     }
+    AdmittedFrame in;
+    in.time = tstamp.toSec();
+    in.img0 = cvbridge_img0->image;
+    in.img1 = cvbridge_img1->image;
+    in.holder[0] = cvbridge_img0;
+    in.holder[1] = cvbridge_img1;
+    process_frame(in);
   }//image_input_callback(const sensor_msgs::ImageConstPtr & imgPtr, const sensor_msgs::ImageConstPtr & depthImgPtr)
 
 };//class TrackingNodeletClass
@@ -19,7 +19,9 @@ void CorrectionInfMsg::pub(const int64_t         &frame_id_in,
                            const vector<int64_t> &lm_outlier_id_in,
                            ros::Time             stamp)
 {
-    flvis::CorrectionInf c_inf;
+    //shared_ptr<const>: no serialization for the subscribers in the same nodelet manager
+    flvis::CorrectionInfPtr c_inf_ptr(new flvis::CorrectionInf());
+    flvis::CorrectionInf& c_inf = *c_inf_ptr;
     c_inf.frame_id = frame_id_in;
 
     Vec3 t=T_c_w_in.translation();
@@ -41,14 +43,12 @@ void CorrectionInfMsg::pub(const int64_t         &frame_id_in,
     c_inf.lm_id_data.data.clear();
     c_inf.lm_id_data.data.insert(c_inf.lm_id_data.data.end(),lm_id_in.begin(),lm_id_in.end());
 
-    for(size_t i=0; i<lm_id_in.size(); i++)
+    c_inf.version = LM_MSG_VERSION_PACKED;
+    if(!LMBlob::pack(c_inf.lm_data,lm_id_in.size(),NULL,&lm_3d_in))
     {
-        Vec3 p3d=lm_3d_in.at(i);
-        geometry_msgs::Vector3 vp3d;
-        vp3d.x = p3d[0];
-        vp3d.y = p3d[1];
-        vp3d.z = p3d[2];
-        c_inf.lm_3d_data.push_back(vp3d);
+        cout << "CorrectionInf " << frame_id_in << ": " << lm_id_in.size() << " ids but "
+             << lm_3d_in.size() << " 3D points, landmarks not sent" << endl;
+        c_inf.lm_count = 0;
     }
 
     c_inf.lm_outlier_count = lm_outlier_count_in;
@@ -60,7 +60,7 @@ void CorrectionInfMsg::pub(const int64_t         &frame_id_in,
     c_inf.lm_outlier_id_data.data.clear();
     c_inf.lm_outlier_id_data.data.insert(c_inf.lm_outlier_id_data.data.end(),lm_outlier_id_in.begin(),lm_outlier_id_in.end());
 
-    this->correction_inf_pub.publish(c_inf);
+    this->correction_inf_pub.publish(flvis::CorrectionInfConstPtr(c_inf_ptr));
 }
 
 void CorrectionInfMsg::unpack(flvis::CorrectionInfConstPtr c_inf_ptr,
@@ -89,15 +89,28 @@ void CorrectionInfMsg::unpack(flvis::CorrectionInfConstPtr c_inf_ptr,
     uq.z() = c_inf_ptr->T_c_w.rotation.z;
     T_c_w_out = SE3(uq,t);
 
-    lm_count_out = c_inf_ptr->lm_count;
-    for(auto i=0; i<lm_count_out; i++)
+    //a short or malformed message (remote publisher) must not be read past the arrays
+    lm_count_out = std::max(0,std::min(c_inf_ptr->lm_count,static_cast<int>(c_inf_ptr->lm_id_data.data.size())));
+    if(c_inf_ptr->version==LM_MSG_VERSION_PACKED)
     {
-        lm_id_out.push_back(c_inf_ptr->lm_id_data.data[i]);
-        Vec3 p3d(c_inf_ptr->lm_3d_data.at(i).x,c_inf_ptr->lm_3d_data.at(i).y,c_inf_ptr->lm_3d_data.at(i).z);
-        lm_3d_out.push_back(p3d);
+        LMBlob::unpack3d(c_inf_ptr->lm_data,lm_count_out,0,lm_3d_out);
+        if(static_cast<int>(lm_3d_out.size())!=lm_count_out) lm_count_out = 0;//blob too short
+        lm_id_out.assign(c_inf_ptr->lm_id_data.data.begin(),
+                         c_inf_ptr->lm_id_data.data.begin()+lm_count_out);
+    }
+    else
+    {
+        lm_count_out = std::min(lm_count_out,static_cast<int>(c_inf_ptr->lm_3d_data.size()));
+        for(auto i=0; i<lm_count_out; i++)
+        {
+            lm_id_out.push_back(c_inf_ptr->lm_id_data.data[i]);
+            Vec3 p3d(c_inf_ptr->lm_3d_data.at(i).x,c_inf_ptr->lm_3d_data.at(i).y,c_inf_ptr->lm_3d_data.at(i).z);
+            lm_3d_out.push_back(p3d);
+        }
     }
 
-    lm_outlier_count_out = c_inf_ptr->lm_outlier_count;
+    lm_outlier_count_out = std::max(0,std::min(c_inf_ptr->lm_outlier_count,
+                                               static_cast<int>(c_inf_ptr->lm_outlier_id_data.data.size())));
     for(auto i=0; i<lm_outlier_count_out; i++)
     {
         lm_outlier_id_out.push_back(c_inf_ptr->lm_outlier_id_data.data[i]);
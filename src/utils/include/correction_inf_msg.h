@@ -6,6 +6,7 @@
 #include <flvis/CorrectionInf.h>
 #include <include/common.h>
 #include <include/camera_frame.h>
+#include <include/lm_blob.h>
 
 struct CorrectionInfStruct {
     int64_t         frame_id;
@@ -6,42 +6,100 @@
 #include <flvis/KeyFrame.h>
 #include <include/common.h>
 #include <include/camera_frame.h>
+#include <include/lm_blob.h>
+#include <include/kf_image_codec.h>
+#include <include/lm_descriptor.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 #define KFMSG_CMD_NONE          (0)
 #define KFMSG_CMD_RESET_LM      (1)
 
+/* Keyframes go out on two topics of the same message type
+ *  //<topic>:     light, geometry only (ids, 2D, 3D, pose) and the commands, for the local map
+ *  //<topic>_img: heavy, appearance (images, descriptors) and pose, for loop closing,
+ *                 built and published only while it has subscribers
+ *                 landmarks: only the ones with an ORB descriptor (row i of lm_descriptor_data
+ *                 belongs to landmark i), so the backend gets id and 3D of every descriptor
+ * */
+#define KFMSG_APPEARANCE_SUFFIX "_img"
 
-struct KeyFrameStruct {
-    cv::Mat         img;
-    cv::Mat         d_img;
-    int64_t         frame_id;
-    int             lm_count;
+/* Optional lossless compression of the appearance images (enableImageCompression)
+ *  //For a backend on another machine, the images are PNG (mono8) / RVL (16UC1) coded
+ *  //Encoding runs on the encoder thread of KeyFrameMsg, pub() only clones the images,
+ *    view() decodes on the thread of the subscriber callback, the result is bit exact
+ * */
+#define KFMSG_ENCODE_QUEUE_SIZE    (4)
+#define KFMSG_CODEC_REPORT_PERIOD  (50)//keyframes, 0: no report
+
+struct KeyFrameAppearance {
+    ros::Time stamp;
+    int64_t   frame_id;
+    SE3       T_c_w;
+    cv::Mat   img;
+    cv::Mat   d_img;
     vector<int64_t> lm_id;
     vector<Vec2>    lm_2d;
     vector<Vec3>    lm_3d;
-    vector<cv::Mat>     lm_descriptor;
+};
+
+
+/* Borrowed view of a KeyFrame message (no copy)
+ *  //Holds the message, the images share the message buffers (read only), compressed images are decoded
+ *  //Landmarks are read in place through lmId/lm2d/lm3d (packed v2 columns or the legacy arrays),
+ *    view() checks every array against lm_count (0 if one is short), i<lm_count is always valid
+ *  //Published as shared_ptr<const>, so the nodelets in the same manager all see one instance
+ * */
+struct KeyFrameView {
+    flvis::KeyFrameConstPtr msg;
+    int64_t         frame_id;
+    int             command;
+    ros::Time       stamp;
     SE3             T_c_w;
+    cv::Mat         img;//empty if the message has no image
+    cv::Mat         d_img;
+    int             lm_count;
+    const float*    lm_col[5];//u v x y z of a v2 message, NULL: legacy layout
+    const uint8_t*  lm_desc;//LM_DESC_BYTES per landmark, NULL: no descriptors
+
+    int64_t lmId(const int i) const {return msg->lm_id_data.data[i];}
+    Vec2    lm2d(const int i) const
+    {
+        if(lm_col[0]!=NULL) return Vec2(lm_col[0][i],lm_col[1][i]);
+        return Vec2(msg->lm_2d_data[i].x,msg->lm_2d_data[i].y);
+    }
+    Vec3    lm3d(const int i) const
+    {
+        if(lm_col[2]!=NULL) return Vec3(lm_col[2][i],lm_col[3][i],lm_col[4][i]);
+        return Vec3(msg->lm_3d_data[i].x,msg->lm_3d_data[i].y,msg->lm_3d_data[i].z);
+    }
 };
 
 class KeyFrameMsg
 {
     ros::Publisher kf_pub;
+    ros::Publisher kf_img_pub;
+    //encoder thread
+    bool                    compress;
+    bool                    stopping;
+    std::mutex              enc_mtx;
+    std::condition_variable enc_cv;
+    std::deque<KeyFrameAppearance> enc_queue;
+    uint64_t                enc_dropped;
+    std::thread             encoder;
+    LMDescriptorExtractor   desc_extractor;//used by the thread that runs pubAppearance
+    void encoderLoop(void);
+    void pubAppearance(const KeyFrameAppearance& kf_app, const bool compressed);
 public:
     KeyFrameMsg();
     KeyFrameMsg(ros::NodeHandle& nh, string topic_name, int buffersize=2);
+    ~KeyFrameMsg();
+    void enableImageCompression(void);
     void cmdLMResetPub(ros::Time stamp=ros::Time::now());//publish reset command to localmap thread
     void pub(CameraFrame& frame, ros::Time stamp=ros::Time::now());
-    static void unpack(flvis::KeyFrameConstPtr kf_const_ptr,
-                       int64_t         &frame_id,
-                       cv::Mat             &img,
-                       cv::Mat             &d_img,
-                       int             &lm_count,
-                       vector<int64_t> &lm_id,
-                       vector<Vec2>    &lm_2d,
-                       vector<Vec3>    &lm_3d,
-                       vector<cv::Mat>     &lm_descriptors,
-                       SE3             &T_c_w,
-                       ros::Time       &T);
+    static void view(const flvis::KeyFrameConstPtr& kf_const_ptr, KeyFrameView& kf);
 };
 
 #endif // KEYFRAME_MSG_H
@@ -0,0 +1,69 @@
+#ifndef KF_IMAGE_CODEC_H
+#define KF_IMAGE_CODEC_H
+
+#include <opencv2/opencv.hpp>
+#include <sensor_msgs/Image.h>
+#include <include/common.h>
+#include <mutex>
+#include <stdint.h>
+
+/* Lossless codecs of the keyframe images (bit exact round trip)
+ *  //mono8: PNG, zlib level 1 (fastest), filters take care of the gradients
+ *  //16UC1: RVL (Wilson 2017), runs of zero (invalid) pixels and zigzag deltas of the valid ones,
+ *           all as variable length nibbles, a few ms per VGA depth image
+ *  //The encoded image keeps width/height of the sensor_msgs/Image, encoding is set to
+ *    KFCODEC_ENC_PNG/KFCODEC_ENC_RVL and data holds the code, so a generic image consumer fails
+ *    clearly instead of showing garbage
+ *  //Size and time of every encode/decode are accumulated (process wide)
+ *  //selfTest(): round trip of the edge cases (all zero, 0xFFFF, alternating zero/nonzero runs,
+ *    odd sizes, padded ROI, mono8 PNG), KeyFrameMsg runs it before it turns compression on
+ *  //KFCODEC_VERIFY: every encode() is decoded again and compared, a mismatch is reported and
+ *    the image is sent raw (debug, doubles the encoding time)
+ * */
+
+#define KFCODEC_ENC_PNG         "flvis/png"
+#define KFCODEC_ENC_RVL         "flvis/rvl"
+#define KFCODEC_PNG_LEVEL       (1)
+#define KFCODEC_VERIFY          (false)
+
+enum TYPEOFCODECSTAT{CODEC_ENCODE=0,
+                     CODEC_DECODE,
+                     CODEC_STAT_TYPES};
+
+struct CodecStats
+{
+    uint64_t images;
+    uint64_t raw_bytes;
+    uint64_t coded_bytes;
+    double   total_ms;
+    double   max_ms;
+    CodecStats() : images(0), raw_bytes(0), coded_bytes(0), total_ms(0), max_ms(0) {}
+};
+
+class KFImageCodec
+{
+public:
+    //img: mono8 or 16UC1, false for other types (the caller sends it raw)
+    static bool encode(const cv::Mat& img, sensor_msgs::Image& msg);
+    static bool isEncoded(const sensor_msgs::Image& msg);
+    //false if the code is corrupt
+    static bool decode(const sensor_msgs::Image& msg, cv::Mat& img);
+
+    //round trip of the edge cases, false (and a report) if one is not bit exact
+    static bool selfTest(void);
+
+    static void rvlEncode(const cv::Mat& img, vector<uint8_t>& code);
+    static bool rvlDecode(const uint8_t* code, const size_t size, cv::Mat& img);
+
+    static CodecStats getStats(const TYPEOFCODECSTAT type);
+    static void printStats(void);
+
+private:
+    static std::mutex stats_mtx;
+    static CodecStats stats[CODEC_STAT_TYPES];
+    static bool sameImage(const cv::Mat& a, const cv::Mat& b);
+    static bool roundTrip(const cv::Mat& img, const char* name);
+    static void addStats(const TYPEOFCODECSTAT type, const size_t raw, const size_t coded, const double ms);
+};
+
+#endif // KF_IMAGE_CODEC_H
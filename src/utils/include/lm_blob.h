@@ -0,0 +1,33 @@
+#ifndef LM_BLOB_H
+#define LM_BLOB_H
+
+#include <include/common.h>
+#include <stdint.h>
+
+/* Packed landmark payload of the KeyFrame/CorrectionInf messages (version 2)
+ *  //One uint8[] blob of float32 columns back to back, n values each, little endian:
+ *    KeyFrame:      u v x y z
+ *    CorrectionInf: x y z
+ *  //4 bytes per value instead of the 8 of a geometry_msgs/Vector3 field (and no unused z for 2D),
+ *    one memcpy per message instead of a field by field (de)serialization
+ *  //Version 0 (field missing/default, bags recorded before v2): the Vector3 arrays are used
+ * */
+
+#define LM_MSG_VERSION_LEGACY  (0)
+#define LM_MSG_VERSION_PACKED  (2)
+
+class LMBlob
+{
+public:
+    //columns of lm_2d (u v, optional) followed by the columns of lm_3d (x y z)
+    //n: number of landmarks (size of lm_id), false and empty blob if a column has another size
+    static bool pack(vector<uint8_t>& blob,
+                     const size_t n,
+                     const vector<Vec2>* lm_2d,
+                     const vector<Vec3>* lm_3d);
+    //column c of a blob of n values per column, NULL if the blob is shorter
+    static const float* column(const vector<uint8_t>& blob, const int n, const int c);
+    static void unpack3d(const vector<uint8_t>& blob, const int n, const int first_col, vector<Vec3>& lm_3d);
+};
+
+#endif // LM_BLOB_H
@@ -58,4 +58,11 @@ inline int getIntVariableFromYaml(string FilePath, string vName)
   const int ret = config[vName].as<int>();
   return ret;
 }
+inline int getIntVariableFromYaml(string FilePath, string vName, int default_value)
+{
+  YAML::Node config = YAML::LoadFile(FilePath);
+  if(!config[vName]) return default_value;
+  const int ret = config[vName].as<int>();
+  return ret;
+}
 #endif // YAML_EIGEN_H
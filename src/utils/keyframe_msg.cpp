@@ -1,44 +1,109 @@
 #include "include/keyframe_msg.h"
 
 KeyFrameMsg::KeyFrameMsg()
+    : compress(false),
+      stopping(false),
+      enc_dropped(0)
 {
 
 }
 
 KeyFrameMsg::KeyFrameMsg(ros::NodeHandle &nh, string topic_name, int buffersize)
+    : compress(false),
+      stopping(false),
+      enc_dropped(0)
 {
-    kf_pub = nh.advertise<flvis::KeyFrame>(topic_name,1);
+    kf_pub     = nh.advertise<flvis::KeyFrame>(topic_name,1);
+    kf_img_pub = nh.advertise<flvis::KeyFrame>(topic_name+KFMSG_APPEARANCE_SUFFIX,1);
+}
+
+KeyFrameMsg::~KeyFrameMsg()
+{
+    if(!encoder.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lk(enc_mtx);
+        stopping = true;
+        enc_cv.notify_all();
+    }
+    encoder.join();
+}
+
+void KeyFrameMsg::enableImageCompression(void)
+{
+    if(compress) return;
+    if(!KFImageCodec::selfTest())
+    {
+        cout << "keyframe images: codec self test failed, images are sent raw" << endl;
+        return;
+    }
+    compress = true;
+    encoder = std::thread(&KeyFrameMsg::encoderLoop,this);
+    cout << "keyframe images: lossless compression on the encoder thread" << endl;
+}
+
+void KeyFrameMsg::encoderLoop(void)
+{
+    uint64_t encoded = 0;
+    while(true)
+    {
+        KeyFrameAppearance kf_app;
+        {
+            std::unique_lock<std::mutex> lk(enc_mtx);
+            enc_cv.wait(lk,[this]{return stopping || !enc_queue.empty();});
+            if(stopping) return;
+            kf_app = enc_queue.front();
+            enc_queue.pop_front();
+        }
+        pubAppearance(kf_app,true);
+        encoded++;
+        if(KFMSG_CODEC_REPORT_PERIOD>0 && (encoded%KFMSG_CODEC_REPORT_PERIOD)==0)
+        {
+            KFImageCodec::printStats();
+            std::lock_guard<std::mutex> lk(enc_mtx);
+            if(enc_dropped>0) cout << "keyframe images: " << enc_dropped << " dropped, encoder behind" << endl;
+        }
+    }
 }
 
 void KeyFrameMsg::cmdLMResetPub(ros::Time stamp)
 {
-    flvis::KeyFrame kf;
+    flvis::KeyFramePtr kf_ptr(new flvis::KeyFrame());
+    flvis::KeyFrame& kf = *kf_ptr;
     kf.header.stamp = stamp;
     kf.frame_id = 0;
     kf.lm_count = 0;
     kf.command = KFMSG_CMD_RESET_LM;
-    kf.img = sensor_msgs::Image();
-    kf.d_img = sensor_msgs::Image();
-    kf.lm_count = 0;
-    kf.lm_id_data = std_msgs::Int64MultiArray();
-    kf.lm_2d_data.clear();
-    kf.lm_3d_data.clear();
-    kf.lm_descriptor_data = std_msgs::UInt8MultiArray();
+    kf.version = LM_MSG_VERSION_PACKED;
     kf.T_c_w = geometry_msgs::Transform();
-    kf_pub.publish(kf);
+    kf_pub.publish(flvis::KeyFrameConstPtr(kf_ptr));
 }
-void KeyFrameMsg::pub(CameraFrame& frame, ros::Time stamp)
-{
-    flvis::KeyFrame kf;
 
+static void fillFrameInf(flvis::KeyFrame& kf, const int64_t frame_id, const SE3& T_c_w, const ros::Time& stamp)
+{
     kf.header.stamp = stamp;
-    kf.frame_id = frame.frame_id;
+    kf.frame_id = frame_id;
     kf.command = KFMSG_CMD_NONE;
-    cv_bridge::CvImage cvimg(std_msgs::Header(), "mono8", frame.img0);
-    cvimg.toImageMsg(kf.img);
+    kf.version = LM_MSG_VERSION_PACKED;
+    //cout << "SE3 T_c_w: " << T_c_w << endl;
+    Vec3 t=T_c_w.translation();
+    Quaterniond uq= T_c_w.unit_quaternion();
+    kf.T_c_w.translation.x=t[0];
+    kf.T_c_w.translation.y=t[1];
+    kf.T_c_w.translation.z=t[2];
+    kf.T_c_w.rotation.w=uq.w();
+    kf.T_c_w.rotation.x=uq.x();
+    kf.T_c_w.rotation.y=uq.y();
+    kf.T_c_w.rotation.z=uq.z();
+}
 
-    cv_bridge::CvImage cv_d_img(std_msgs::Header(), "16UC1", frame.d_img);
-    cv_d_img.toImageMsg(kf.d_img);
+//published as shared_ptr<const>: the subscribers of the same nodelet manager get this instance
+//without serialization, it must not be modified after publish
+void KeyFrameMsg::pub(CameraFrame& frame, ros::Time stamp)
+{
+    //light: geometry
+    flvis::KeyFramePtr kf_ptr(new flvis::KeyFrame());
+    flvis::KeyFrame& kf = *kf_ptr;
+    fillFrameInf(kf,frame.frame_id,frame.T_c_w,stamp);
 
     vector<int64_t> lm_id;
     vector<Vec2> lm_2d;
@@ -57,104 +122,157 @@ void KeyFrameMsg::pub(CameraFrame& frame, ros::Time stamp)
     kf.lm_id_data.layout.dim[0].size = static_cast<uint32_t>(lm_id.size());
     kf.lm_id_data.layout.dim[0].stride = static_cast<uint32_t>(lm_id.size());
 
-    kf.lm_id_data.data.clear();
     kf.lm_id_data.data.insert(kf.lm_id_data.data.end(),lm_id.begin(),lm_id.end());
+    if(!LMBlob::pack(kf.lm_data,lm_id.size(),&lm_2d,&lm_3d))
+    {
+        cout << "KeyFrame " << frame.frame_id << ": landmark columns of different size, landmarks not sent" << endl;
+        kf.lm_count = 0;
+    }
+    kf_pub.publish(flvis::KeyFrameConstPtr(kf_ptr));
+
+    //heavy: appearance, only built if someone listens
+    if(kf_img_pub.getNumSubscribers()==0) return;
+    KeyFrameAppearance kf_app;
+    kf_app.stamp    = stamp;
+    kf_app.frame_id = frame.frame_id;
+    kf_app.T_c_w    = frame.T_c_w;
+    kf_app.lm_id.swap(lm_id);
+    kf_app.lm_2d.swap(lm_2d);
+    kf_app.lm_3d.swap(lm_3d);
+    if(!compress)
+    {
+        kf_app.img   = frame.img0;
+        kf_app.d_img = frame.d_img;
+        pubAppearance(kf_app,false);
+        return;
+    }
+    //the frame buffers are reused, the encoder gets its own copy
+    kf_app.img   = frame.img0.clone();
+    kf_app.d_img = frame.d_img.clone();
+    std::lock_guard<std::mutex> lk(enc_mtx);
+    if(enc_queue.size()>=KFMSG_ENCODE_QUEUE_SIZE)
+    {
+        enc_queue.pop_front();
+        enc_dropped++;
+    }
+    enc_queue.push_back(kf_app);
+    enc_cv.notify_one();
+}
+
+void KeyFrameMsg::pubAppearance(const KeyFrameAppearance& kf_app, const bool compressed)
+{
+    flvis::KeyFramePtr kf_ptr(new flvis::KeyFrame());
+    flvis::KeyFrame& kf = *kf_ptr;
+    fillFrameInf(kf,kf_app.frame_id,kf_app.T_c_w,kf_app.stamp);
+    //raw if not compressed or no codec for the type
+    if(!compressed || !KFImageCodec::encode(kf_app.img,kf.img))
+    {
+        cv_bridge::CvImage cvimg(std_msgs::Header(), "mono8", kf_app.img);
+        cvimg.toImageMsg(kf.img);
+    }
+    if(!compressed || !KFImageCodec::encode(kf_app.d_img,kf.d_img))
+    {
+        cv_bridge::CvImage cv_d_img(std_msgs::Header(), "16UC1", kf_app.d_img);
+        cv_d_img.toImageMsg(kf.d_img);
+    }
+
+    //descriptors at the landmarks, the landmarks without one are left out
+    cv::Mat lm_descriptors;
+    vector<int> index;
+    desc_extractor.compute(kf_app.img,kf_app.lm_2d,lm_descriptors,index);
+    vector<int64_t> lm_id;
+    vector<Vec2> lm_2d;
+    vector<Vec3> lm_3d;
+    lm_id.reserve(index.size());
+    lm_2d.reserve(index.size());
+    lm_3d.reserve(index.size());
+    for(size_t i=0; i<index.size(); i++)
+    {
+        lm_id.push_back(kf_app.lm_id[index[i]]);
+        lm_2d.push_back(kf_app.lm_2d[index[i]]);
+        lm_3d.push_back(kf_app.lm_3d[index[i]]);
+    }
+    kf.lm_count = static_cast<int32_t>(lm_id.size());
+    kf.lm_id_data.layout.dim.push_back(std_msgs::MultiArrayDimension());
+    kf.lm_id_data.layout.dim[0].label = "lm_id";
+    kf.lm_id_data.layout.dim[0].size = static_cast<uint32_t>(lm_id.size());
+    kf.lm_id_data.layout.dim[0].stride = static_cast<uint32_t>(lm_id.size());
+    kf.lm_id_data.data.insert(kf.lm_id_data.data.end(),lm_id.begin(),lm_id.end());
+    LMBlob::pack(kf.lm_data,lm_id.size(),&lm_2d,&lm_3d);//built together above, same size
 
     kf.lm_descriptor_data.layout.dim.push_back(std_msgs::MultiArrayDimension());
     kf.lm_descriptor_data.layout.dim.push_back(std_msgs::MultiArrayDimension());
 
     kf.lm_descriptor_data.layout.dim[0].label = "lm_descriptor";
-    kf.lm_descriptor_data.layout.dim[0].size = 0;
-    kf.lm_descriptor_data.layout.dim[0].stride = 0;
-//    kf.lm_descriptor_data.layout.dim[0].size = static_cast<uint32_t>(lm_id.size());
-//    kf.lm_descriptor_data.layout.dim[0].stride = static_cast<uint32_t>(32*lm_id.size());
+    kf.lm_descriptor_data.layout.dim[0].size = static_cast<uint32_t>(lm_id.size());
+    kf.lm_descriptor_data.layout.dim[0].stride = static_cast<uint32_t>(LM_DESC_BYTES*lm_id.size());
     kf.lm_descriptor_data.layout.dim[1].label = "32uint_descriptor";
-    kf.lm_descriptor_data.layout.dim[1].size = 0;
-    kf.lm_descriptor_data.layout.dim[1].stride = 0;
-//    kf.lm_descriptor_data.layout.dim[1].size = 1;
-//    kf.lm_descriptor_data.layout.dim[1].stride = 32;
-
-
-//    for(size_t i=0; i<lm_id.size(); i++)
-//    {
-//        //cout << "i:" << lm_descriptors.at(i).type() << "  " << "size:" << lm_descriptors.at(i).size << endl;
-//        //cout << "i " << lm_descriptors.at(i) << endl;
-//        for(int j=0; j<32; j++)
-//        {
-//            kf.lm_descriptor_data.data.push_back(lm_descriptors.at(i).at<uint8_t>(0,j));
-//            //cout << unsigned(lm_descriptors.at(i).at<uint8_t>(0,j)) << " ";
-//        }
-//    }
-
-    for(size_t i=0; i<lm_id.size(); i++)
+    kf.lm_descriptor_data.layout.dim[1].size = LM_DESC_BYTES;
+    kf.lm_descriptor_data.layout.dim[1].stride = LM_DESC_BYTES;
+    //rows of the cv::Mat are contiguous (created by ORB compute)
+    if(!lm_descriptors.empty())
     {
-        Vec2 p2d=lm_2d.at(i);
-        Vec3 p3d=lm_3d.at(i);
-        geometry_msgs::Vector3 vp2d;
-        geometry_msgs::Vector3 vp3d;
-        vp2d.x = p2d[0];
-        vp2d.y = p2d[1];
-        kf.lm_2d_data.push_back(vp2d);
-        vp3d.x = p3d[0];
-        vp3d.y = p3d[1];
-        vp3d.z = p3d[2];
-        kf.lm_3d_data.push_back(vp3d);
+        kf.lm_descriptor_data.data.assign(lm_descriptors.data,
+                                          lm_descriptors.data+lm_descriptors.total()*lm_descriptors.elemSize());
     }
-    //cout << "SE3 T_c_w: " << frame.T_c_w << endl;
-    Vec3 t=frame.T_c_w.translation();
-    Quaterniond uq= frame.T_c_w.unit_quaternion();
-    kf.T_c_w.translation.x=t[0];
-    kf.T_c_w.translation.y=t[1];
-    kf.T_c_w.translation.z=t[2];
-    kf.T_c_w.rotation.w=uq.w();
-    kf.T_c_w.rotation.x=uq.x();
-    kf.T_c_w.rotation.y=uq.y();
-    kf.T_c_w.rotation.z=uq.z();
-    kf.command = KFMSG_CMD_NONE;
 
-    kf_pub.publish(kf);
+    kf_img_pub.publish(flvis::KeyFrameConstPtr(kf_ptr));
+}
+
+//share the message buffer if the encoding matches (it always does for the keyframes),
+//decode a compressed image
+static cv::Mat shareImage(const flvis::KeyFrameConstPtr& kf_const_ptr, const sensor_msgs::Image& img)
+{
+    if(img.data.empty()) return cv::Mat();
+    if(KFImageCodec::isEncoded(img))
+    {
+        cv::Mat decoded;
+        if(!KFImageCodec::decode(img,decoded))
+        {
+            cout << "KeyFrame " << kf_const_ptr->frame_id << ": corrupt " << img.encoding << " image" << endl;
+            return cv::Mat();
+        }
+        uint64_t n = KFImageCodec::getStats(CODEC_DECODE).images;
+        if(KFMSG_CODEC_REPORT_PERIOD>0 && (n%KFMSG_CODEC_REPORT_PERIOD)==0) KFImageCodec::printStats();
+        return decoded;
+    }
+    return cv_bridge::toCvShare(img,kf_const_ptr,img.encoding)->image;
 }
 
-void KeyFrameMsg::unpack(flvis::KeyFrameConstPtr kf_const_ptr,
-                         int64_t         &frame_id,
-                         cv::Mat         &img,
-                         cv::Mat         &d_img,
-                         int             &lm_count,
-                         vector<int64_t> &lm_id,
-                         vector<Vec2>    &lm_2d,
-                         vector<Vec3>    &lm_3d,
-                         vector<cv::Mat> &lm_descriptors,
-                         SE3             &T_c_w,
-                         ros::Time       &T)
+void KeyFrameMsg::view(const flvis::KeyFrameConstPtr& kf_const_ptr, KeyFrameView& kf)
 {
-    img.release();
-    lm_id.clear();
-    lm_2d.clear();
-    lm_3d.clear();
-    lm_descriptors.clear();
-
-    frame_id = kf_const_ptr->frame_id;
-    cv_bridge::CvImagePtr cvbridge_image  = cv_bridge::toCvCopy(kf_const_ptr->img, kf_const_ptr->img.encoding);
-    img=cvbridge_image->image;
-    cv_bridge::CvImagePtr cvbridge_d_image = cv_bridge::toCvCopy(kf_const_ptr->d_img, kf_const_ptr->d_img.encoding);
-    d_img = cvbridge_d_image->image;
-    lm_count = kf_const_ptr->lm_count;
-    int count =  kf_const_ptr->lm_count;
-    for(auto i=0; i<count; i++)
+    kf.msg      = kf_const_ptr;
+    kf.frame_id = kf_const_ptr->frame_id;
+    kf.command  = kf_const_ptr->command;
+    kf.stamp    = kf_const_ptr->header.stamp;
+    kf.img      = shareImage(kf_const_ptr,kf_const_ptr->img);
+    kf.d_img    = shareImage(kf_const_ptr,kf_const_ptr->d_img);
+    kf.lm_count = kf_const_ptr->lm_count;
+    //lmId(i) indexes lm_id_data unchecked, a short or malformed message gets no landmarks
+    if(kf.lm_count<0 || kf_const_ptr->lm_id_data.data.size()<static_cast<size_t>(kf.lm_count))
     {
-//        cv::Mat descriptor = cv::Mat(1,32,CV_8U);
-//        for(auto j=0; j<32; j++)
-//        {
-//            descriptor.at<uint8_t>(0,j)=kf_const_ptr->lm_descriptor_data.data.at(i*32+j);
-//        }
-//        lm_descriptors.push_back(descriptor);
-        //cout << lm_descriptors.at(i) << endl;
-        lm_id.push_back(kf_const_ptr->lm_id_data.data[i]);
-        Vec2 p2d(kf_const_ptr->lm_2d_data.at(i).x,kf_const_ptr->lm_2d_data.at(i).y);
-        Vec3 p3d(kf_const_ptr->lm_3d_data.at(i).x,kf_const_ptr->lm_3d_data.at(i).y,kf_const_ptr->lm_3d_data.at(i).z);
-        lm_2d.push_back(p2d);
-        lm_3d.push_back(p3d);
+        if(kf.lm_count!=0) cout << "KeyFrame " << kf.frame_id << ": lm_count " << kf.lm_count << " with "
+                                << kf_const_ptr->lm_id_data.data.size() << " ids, landmarks ignored" << endl;
+        kf.lm_count = 0;
     }
+    for(int c=0; c<5; c++)
+    {
+        kf.lm_col[c] = (kf_const_ptr->version==LM_MSG_VERSION_PACKED)?LMBlob::column(kf_const_ptr->lm_data,kf.lm_count,c):NULL;
+    }
+    if(kf_const_ptr->version==LM_MSG_VERSION_PACKED && kf.lm_count>0 && kf.lm_col[4]==NULL)
+    {
+        cout << "KeyFrame " << kf.frame_id << ": landmark blob too short, landmarks ignored" << endl;
+        kf.lm_count = 0;
+    }
+    if(kf_const_ptr->version==LM_MSG_VERSION_LEGACY
+            && (kf_const_ptr->lm_2d_data.size()<static_cast<size_t>(kf.lm_count)
+                || kf_const_ptr->lm_3d_data.size()<static_cast<size_t>(kf.lm_count)))
+    {
+        kf.lm_count = 0;
+    }
+    kf.lm_desc = (kf.lm_count>0
+                  && kf_const_ptr->lm_descriptor_data.data.size()==static_cast<size_t>(kf.lm_count)*LM_DESC_BYTES)
+            ?kf_const_ptr->lm_descriptor_data.data.data():NULL;
     Vec3 t;
     Quaterniond uq;
     t(0) = kf_const_ptr->T_c_w.translation.x;
@@ -164,7 +282,5 @@ void KeyFrameMsg::unpack(flvis::KeyFrameConstPtr kf_const_ptr,
     uq.x() = kf_const_ptr->T_c_w.rotation.x;
     uq.y() = kf_const_ptr->T_c_w.rotation.y;
     uq.z() = kf_const_ptr->T_c_w.rotation.z;
-    T_c_w = SE3(uq,t);
-    T = kf_const_ptr->header.stamp;
-
+    kf.T_c_w = SE3(uq,t);
 }
@@ -0,0 +1,286 @@
+#include "include/kf_image_codec.h"
+#include <chrono>
+#include <cstring>
+
+std::mutex KFImageCodec::stats_mtx;
+CodecStats KFImageCodec::stats[CODEC_STAT_TYPES];
+
+static inline double elapsedMs(const std::chrono::steady_clock::time_point& t0)
+{
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-t0).count();
+}
+
+//RVL: 32 bit words of 8 nibbles, most significant nibble first
+//nibble = 3 bits of value + continuation bit
+class NibbleWriter
+{
+public:
+    explicit NibbleWriter(vector<uint8_t>& out) : out(out), word(0), nibbles(0) {}
+    void put(uint32_t value)
+    {
+        do
+        {
+            uint32_t nibble = value&0x7;
+            value >>= 3;
+            if(value) nibble |= 0x8;
+            word = (word<<4)|nibble;
+            if(++nibbles==8) flush();
+        }while(value);
+    }
+    void finish(void)
+    {
+        if(nibbles==0) return;
+        word <<= 4*(8-nibbles);
+        flush();
+    }
+private:
+    vector<uint8_t>& out;
+    uint32_t word;
+    int      nibbles;
+    void flush(void)
+    {
+        size_t n = out.size();
+        out.resize(n+4);
+        memcpy(&out[n],&word,4);
+        word = 0;
+        nibbles = 0;
+    }
+};
+
+class NibbleReader
+{
+public:
+    NibbleReader(const uint8_t* code, const size_t size) : p(code), end(code+size), word(0), nibbles(0) {}
+    bool get(uint32_t& value)
+    {
+        value = 0;
+        int shift = 0;
+        while(true)
+        {
+            if(nibbles==0)
+            {
+                if(end-p<4) return false;
+                memcpy(&word,p,4);
+                p += 4;
+                nibbles = 8;
+            }
+            uint32_t nibble = word>>28;
+            word <<= 4;
+            nibbles--;
+            if(shift>=32) return false;//corrupt, longer than any 32 bit value
+            value |= (nibble&0x7)<<shift;
+            shift += 3;
+            if(!(nibble&0x8)) return true;
+        }
+    }
+private:
+    const uint8_t* p;
+    const uint8_t* end;
+    uint32_t word;
+    int      nibbles;
+};
+
+void KFImageCodec::rvlEncode(const cv::Mat& img, vector<uint8_t>& code)
+{
+    code.clear();
+    code.reserve(img.total());
+    NibbleWriter w(code);
+    int previous = 0;
+    for(int r=0; r<img.rows; r++)
+    {
+        //runs stop at the end of a row (a padded Mat is fine), the decoder does the same
+        const uint16_t* in  = img.ptr<uint16_t>(r);
+        const uint16_t* end = in+img.cols;
+        while(in!=end)
+        {
+            uint32_t zeros = 0;
+            uint32_t nonzeros = 0;
+            for(; in!=end && *in==0; in++) zeros++;
+            w.put(zeros);
+            for(const uint16_t* p=in; p!=end && *p!=0; p++) nonzeros++;
+            w.put(nonzeros);
+            for(uint32_t i=0; i<nonzeros; i++, in++)
+            {
+                int delta = static_cast<int>(*in)-previous;
+                w.put((static_cast<uint32_t>(delta)<<1)^static_cast<uint32_t>(delta>>31));//zigzag
+                previous = *in;
+            }
+        }
+    }
+    w.finish();
+}
+
+bool KFImageCodec::rvlDecode(const uint8_t* code, const size_t size, cv::Mat& img)
+{
+    NibbleReader rd(code,size);
+    int previous = 0;
+    for(int r=0; r<img.rows; r++)
+    {
+        uint16_t* out = img.ptr<uint16_t>(r);
+        uint16_t* end = out+img.cols;
+        while(out!=end)
+        {
+            uint32_t zeros, nonzeros;
+            if(!rd.get(zeros) || zeros>static_cast<uint32_t>(end-out)) return false;
+            memset(out,0,zeros*sizeof(uint16_t));
+            out += zeros;
+            if(!rd.get(nonzeros) || nonzeros>static_cast<uint32_t>(end-out)) return false;
+            for(uint32_t i=0; i<nonzeros; i++)
+            {
+                uint32_t positive;
+                if(!rd.get(positive)) return false;
+                int delta = static_cast<int>(positive>>1)^-static_cast<int>(positive&1);
+                previous += delta;
+                *out++ = static_cast<uint16_t>(previous);
+            }
+        }
+    }
+    return true;
+}
+
+bool KFImageCodec::encode(const cv::Mat& img, sensor_msgs::Image& msg)
+{
+    if(img.empty() || (img.type()!=CV_8UC1 && img.type()!=CV_16UC1)) return false;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    msg.height = static_cast<uint32_t>(img.rows);
+    msg.width  = static_cast<uint32_t>(img.cols);
+    msg.is_bigendian = 0;
+    if(img.type()==CV_8UC1)
+    {
+        vector<int> para;
+        para.push_back(cv::IMWRITE_PNG_COMPRESSION);
+        para.push_back(KFCODEC_PNG_LEVEL);
+        if(!cv::imencode(".png",img,msg.data,para)) return false;
+        msg.encoding = KFCODEC_ENC_PNG;
+        msg.step = msg.width;
+    }
+    else
+    {
+        rvlEncode(img,msg.data);
+        msg.encoding = KFCODEC_ENC_RVL;
+        msg.step = msg.width*2;
+    }
+    addStats(CODEC_ENCODE,img.total()*img.elemSize(),msg.data.size(),elapsedMs(t0));
+    if(KFCODEC_VERIFY)
+    {
+        cv::Mat decoded;
+        if(!decode(msg,decoded) || !sameImage(img,decoded))
+        {
+            cout << "keyframe image: " << msg.encoding << " round trip not bit exact, sent raw" << endl;
+            msg = sensor_msgs::Image();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool KFImageCodec::isEncoded(const sensor_msgs::Image& msg)
+{
+    return msg.encoding==KFCODEC_ENC_PNG || msg.encoding==KFCODEC_ENC_RVL;
+}
+
+bool KFImageCodec::decode(const sensor_msgs::Image& msg, cv::Mat& img)
+{
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    bool ok = false;
+    if(msg.encoding==KFCODEC_ENC_PNG)
+    {
+        img = cv::imdecode(msg.data,cv::IMREAD_UNCHANGED);
+        ok = !img.empty() && img.type()==CV_8UC1
+                && img.rows==static_cast<int>(msg.height) && img.cols==static_cast<int>(msg.width);
+    }
+    if(msg.encoding==KFCODEC_ENC_RVL)
+    {
+        img.create(static_cast<int>(msg.height),static_cast<int>(msg.width),CV_16UC1);
+        ok = rvlDecode(msg.data.data(),msg.data.size(),img);
+    }
+    if(!ok)
+    {
+        img.release();
+        return false;
+    }
+    addStats(CODEC_DECODE,img.total()*img.elemSize(),msg.data.size(),elapsedMs(t0));
+    return true;
+}
+
+bool KFImageCodec::sameImage(const cv::Mat& a, const cv::Mat& b)
+{
+    if(a.size()!=b.size() || a.type()!=b.type()) return false;
+    return cv::countNonZero(a!=b)==0;
+}
+
+bool KFImageCodec::roundTrip(const cv::Mat& img, const char* name)
+{
+    sensor_msgs::Image msg;
+    cv::Mat decoded;
+    if(encode(img,msg) && decode(msg,decoded) && sameImage(img,decoded)) return true;
+    cout << "keyframe image codec self test: " << name << " (" << img.cols << "x" << img.rows
+         << ") round trip failed" << endl;
+    return false;
+}
+
+bool KFImageCodec::selfTest(void)
+{
+    bool ok = true;
+    //16UC1, odd sizes so the runs do not line up with the 8 nibble words
+    cv::Mat d(37,53,CV_16UC1);
+    d.setTo(0);
+    ok &= roundTrip(d,"16UC1 all zero");
+    d.setTo(0xFFFF);
+    ok &= roundTrip(d,"16UC1 all 0xFFFF");
+    for(int r=0; r<d.rows; r++)
+    {
+        for(int c=0; c<d.cols; c++)
+        {   //alternating zero/nonzero runs of growing length, full range deltas
+            d.at<uint16_t>(r,c) = (((r*d.cols+c)/(1+r%5))%2)?static_cast<uint16_t>(((r+1)*(c+1)*7919)&0xFFFF):0;
+        }
+    }
+    d.at<uint16_t>(0,0) = 0xFFFF;
+    d.at<uint16_t>(0,1) = 1;
+    ok &= roundTrip(d,"16UC1 alternating runs");
+    cv::Mat d_rand(31,47,CV_16UC1);
+    cv::randu(d_rand,cv::Scalar(0),cv::Scalar(65536));
+    ok &= roundTrip(d_rand,"16UC1 random");
+    ok &= roundTrip(cv::Mat(1,1,CV_16UC1,cv::Scalar(0xFFFF)),"16UC1 single pixel");
+    ok &= roundTrip(d(cv::Rect(3,2,17,11)),"16UC1 ROI");//padded rows
+    //mono8 PNG
+    cv::Mat g(29,43,CV_8UC1);
+    cv::randu(g,cv::Scalar(0),cv::Scalar(256));
+    ok &= roundTrip(g,"mono8 random");
+    g.setTo(255);
+    ok &= roundTrip(g,"mono8 all 255");
+    ok &= roundTrip(g(cv::Rect(1,1,13,7)),"mono8 ROI");
+    return ok;
+}
+
+void KFImageCodec::addStats(const TYPEOFCODECSTAT type, const size_t raw, const size_t coded, const double ms)
+{
+    std::lock_guard<std::mutex> lk(stats_mtx);
+    CodecStats& s = stats[type];
+    s.images++;
+    s.raw_bytes   += raw;
+    s.coded_bytes += coded;
+    s.total_ms    += ms;
+    if(ms>s.max_ms) s.max_ms = ms;
+}
+
+CodecStats KFImageCodec::getStats(const TYPEOFCODECSTAT type)
+{
+    std::lock_guard<std::mutex> lk(stats_mtx);
+    return stats[type];
+}
+
+void KFImageCodec::printStats(void)
+{
+    const char* names[CODEC_STAT_TYPES] = {"encode","decode"};
+    std::lock_guard<std::mutex> lk(stats_mtx);
+    for(int i=0; i<CODEC_STAT_TYPES; i++)
+    {
+        const CodecStats& s = stats[i];
+        if(s.images==0) continue;
+        cout << "keyframe image " << names[i] << ": " << s.images << " images, "
+             << s.raw_bytes/1024 << " KiB -> " << s.coded_bytes/1024 << " KiB ("
+             << 100.0*s.coded_bytes/std::max<uint64_t>(1,s.raw_bytes) << "%), "
+             << "mean/max " << s.total_ms/s.images << "/" << s.max_ms << " ms" << endl;
+    }
+}
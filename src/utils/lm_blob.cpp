@@ -0,0 +1,67 @@
+#include "include/lm_blob.h"
+
+//strided double -> contiguous float, vectorized by the compiler
+static inline void packColumn(float* dst, const double* src, const int stride, const size_t n)
+{
+    for(size_t i=0; i<n; i++)
+    {
+        dst[i] = static_cast<float>(src[i*stride]);
+    }
+}
+
+bool LMBlob::pack(vector<uint8_t>& blob,
+                  const size_t n,
+                  const vector<Vec2>* lm_2d,
+                  const vector<Vec3>* lm_3d)
+{
+    if((lm_2d!=NULL && lm_2d->size()!=n) || (lm_3d!=NULL && lm_3d->size()!=n))
+    {
+        blob.clear();
+        return false;
+    }
+    int cols = ((lm_2d!=NULL)?2:0)+((lm_3d!=NULL)?3:0);
+    blob.resize(cols*n*sizeof(float));
+    if(n==0) return true;
+    //the vector buffer comes from operator new, columns start at a multiple of 4 bytes
+    float* dst = reinterpret_cast<float*>(blob.data());
+    if(lm_2d!=NULL)
+    {
+        const double* src = lm_2d->front().data();
+        for(int c=0; c<2; c++, dst+=n)
+        {
+            packColumn(dst,src+c,2,n);
+        }
+    }
+    if(lm_3d!=NULL)
+    {
+        const double* src = lm_3d->front().data();
+        for(int c=0; c<3; c++, dst+=n)
+        {
+            packColumn(dst,src+c,3,n);
+        }
+    }
+    return true;
+}
+
+const float* LMBlob::column(const vector<uint8_t>& blob, const int n, const int c)
+{
+    if(n<=0 || blob.size()<(c+1)*n*sizeof(float)) return NULL;
+    return reinterpret_cast<const float*>(blob.data())+c*n;
+}
+
+void LMBlob::unpack3d(const vector<uint8_t>& blob, const int n, const int first_col, vector<Vec3>& lm_3d)
+{
+    lm_3d.resize(std::max(0,n));
+    const float* x = column(blob,n,first_col);
+    const float* y = column(blob,n,first_col+1);
+    const float* z = column(blob,n,first_col+2);
+    if(x==NULL || y==NULL || z==NULL)
+    {
+        lm_3d.clear();
+        return;
+    }
+    for(int i=0; i<n; i++)
+    {
+        lm_3d[i] = Vec3(x[i],y[i],z[i]);
+    }
+}
@@ -0,0 +1,135 @@
+#include <include/frame_visualizer.h>
+#include <include/cv_draw.h>
+#include <cv_bridge/cv_bridge.h>
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//message buffers are immutable and kept alive by the holder, pooled buffers are reused
+static cv::Mat shareOrClone(const cv::Mat& m, const CameraFrame& frame)
+{
+  if(m.empty()) return cv::Mat();
+  for(int k=0; k<2; k++)
+  {
+    if(m.datastart==frame.cvt_pool[k].datastart || m.datastart==frame.rect_pool[k].datastart)
+    {
+      return m.clone();
+    }
+  }
+  if(frame.img_holder[0] || frame.img_holder[1]) return m;
+  return m.clone();
+}
+
+FrameVisualizer::FrameVisualizer(ros::NodeHandle& nh,
+                                 const TYPEOFCAMERA cam_type,
+                                 const bool pub_images)
+  : cam_type(cam_type),
+    pub_images(pub_images),
+    stopping(false),
+    submitted_cnt(0),
+    dropped_cnt(0)
+{
+  frame_pub = new RVIZFrame(nh,"/vo_camera_pose","map","/vo_curr_frame","map");
+  image_transport::ImageTransport it(nh);
+  img0_pub = it.advertise("/vo_img0", 1);
+  img1_pub = it.advertise("/vo_img1", 1);
+  worker = std::thread(&FrameVisualizer::workerLoop,this);
+}
+
+FrameVisualizer::~FrameVisualizer()
+{
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    stopping = true;
+    cv_pending.notify_all();
+  }
+  worker.join();
+  delete frame_pub;
+}
+
+void FrameVisualizer::submit(const CameraFrame& frame, const ros::Time& stamp)
+{
+  bool pub_img0    = pub_images && img0_pub.getNumSubscribers()>0;
+  bool pub_img1    = pub_images && img1_pub.getNumSubscribers()>0;
+  bool pub_markers = frame_pub->getNumSubscribers()>0;
+  if(!pub_img0 && !pub_img1 && !pub_markers) return;
+
+  std::shared_ptr<FrameSnapshot> snapshot = std::make_shared<FrameSnapshot>();
+  snapshot->stamp = stamp;
+  snapshot->T_c_w = frame.T_c_w;
+  snapshot->solving_time = frame.solving_time;
+  snapshot->reprojection_error = frame.reprojection_error;
+  snapshot->pub_img0 = pub_img0;
+  snapshot->pub_img1 = pub_img1;
+  snapshot->pub_markers = pub_markers;
+  const LandMarkTable& lms = frame.landmarks;
+  for(size_t i=0; i<lms.size(); i++)
+  {
+    if(!lms.hasDepthInf(i)) continue;
+    if(pub_img0)
+    {
+      snapshot->lm_2d.push_back(lms.lm_2d[i]);
+      snapshot->lm_depth.push_back(lms.lm_3d_c[i][2]);
+    }
+    if(pub_markers) snapshot->lm_3d_w.push_back(lms.lm_3d_w[i]);
+  }
+  if(pub_img0) snapshot->img0 = shareOrClone(frame.img0,frame);
+  if(pub_img1)
+  {
+    if(cam_type==DEPTH_D435)       snapshot->d_img = shareOrClone(frame.d_img,frame);
+    if(cam_type==STEREO_EuRoC_MAV) snapshot->img1  = shareOrClone(frame.img1,frame);
+  }
+  snapshot->img_holder[0] = frame.img_holder[0];
+  snapshot->img_holder[1] = frame.img_holder[1];
+
+  std::lock_guard<std::mutex> lk(mtx);
+  if(pending) dropped_cnt++;//stale, not rendered yet
+  pending = snapshot;
+  submitted_cnt++;
+  cv_pending.notify_one();
+}
+
+void FrameVisualizer::workerLoop(void)
+{
+#if defined(__linux__)
+  setpriority(PRIO_PROCESS,static_cast<id_t>(syscall(SYS_gettid)),VIS_WORKER_NICE);
+#endif
+  while(true)
+  {
+    FrameSnapshot::ConstPtr snapshot;
+    {
+      std::unique_lock<std::mutex> lk(mtx);
+      cv_pending.wait(lk,[this]{return stopping || pending;});
+      if(stopping) return;
+      snapshot.swap(pending);
+    }
+    render(*snapshot);
+  }
+}
+
+void FrameVisualizer::render(const FrameSnapshot& snapshot)
+{
+  if(snapshot.pub_markers)
+  {
+    frame_pub->pubFramePtsPoseT_c_w(snapshot.lm_3d_w,snapshot.T_c_w,snapshot.stamp);
+  }
+  if(snapshot.pub_img0 && !snapshot.img0.empty())
+  {
+    cv::Mat img0_vis;
+    cv::cvtColor(snapshot.img0,img0_vis,CV_GRAY2BGR);
+    drawFrame(img0_vis,snapshot,1,(cam_type==DEPTH_D435)?6:11);
+    img0_pub.publish(cv_bridge::CvImage(std_msgs::Header(), "bgr8", img0_vis).toImageMsg());
+  }
+  if(snapshot.pub_img1)
+  {
+    cv::Mat img1_vis;
+    if(!snapshot.d_img.empty()) visualizeDepthImg(img1_vis,snapshot.d_img);
+    if(!snapshot.img1.empty())  cv::cvtColor(snapshot.img1,img1_vis,CV_GRAY2BGR);
+    if(!img1_vis.empty())
+    {
+      img1_pub.publish(cv_bridge::CvImage(std_msgs::Header(), "bgr8", img1_vis).toImageMsg());
+    }
+  }
+}
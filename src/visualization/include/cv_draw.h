@@ -3,6 +3,7 @@
 
 #include <include/common.h>
 #include <include/camera_frame.h>
+#include <include/frame_visualizer.h>
 
 
 inline void drawFPS(cv::Mat& img, int fps)
@@ -56,7 +57,7 @@ inline void drawFlow(cv::Mat& img, const vector<Vec2>& from, const vector<Vec2>&
     }
 }
 
-inline void drawFrame(cv::Mat& img, CameraFrame& frame, int min, int max)
+inline void drawFrame(cv::Mat& img, const FrameSnapshot& frame, int min, int max)
 {
     drawRegion16(img);
     int fps=floor(1.0/frame.solving_time);
@@ -70,58 +71,27 @@ inline void drawFrame(cv::Mat& img, CameraFrame& frame, int min, int max)
     cv::putText(img, "ERR:"+stream.str(),
                 cv::Point(img.cols-150,20), cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(0,255,0), 2, cv::LINE_8);
     int gap= floor(250/(max-min));
-    for(auto lm:frame.landmarks)
+    for(size_t i=0; i<frame.lm_2d.size(); i++)
     {
-        if(lm.hasDepthInf())
-        {
-            float z=lm.lm_3d_c[2];
-            if(z>=max) z=max;
-            if(z<min)  z=min;
-            int b=floor((z-min)*gap);
-            int r=255-b;
-            cv::Point pt(round(lm.lm_2d[0]),round(lm.lm_2d[1]));
-            cv::circle(img, pt, 2, cv::Scalar( b, 0, r ), 2);
-//            if(lm.is_belong_to_kf)
-//            {
-//                cv::circle(img, pt, 3, cv::Scalar( b, 0, r ), 4);
-//            }
-//            else
-//            {
-//                cv::circle(img, pt, 2, cv::Scalar( b, 0, r ), 2);
-//            }
-        }
+        float z=frame.lm_depth[i];
+        if(z>=max) z=max;
+        if(z<min)  z=min;
+        int b=floor((z-min)*gap);
+        int r=255-b;
+        cv::Point pt(round(frame.lm_2d[i][0]),round(frame.lm_2d[i][1]));
+        cv::circle(img, pt, 2, cv::Scalar( b, 0, r ), 2);
     }
 }
 
-inline void visualizeDepthImg(cv::Mat& visualized_depth, CameraFrame& frame)
+//d_img may reference the input message buffer, it is read only here
+inline void visualizeDepthImg(cv::Mat& visualized_depth, const cv::Mat& d_img)
 {
-    cv::Mat d_img=frame.d_img;
-    int size=d_img.cols*d_img.rows;
-    for(int i=0; i<size; i++)
-    {
-        if(isnan(d_img.at<ushort>(i)))
-        {
-            d_img.at<ushort>(i)=0;
-        }
-        if(d_img.at<ushort>(i)>10000||d_img.at<ushort>(i)<200)
-        {
-            d_img.at<ushort>(i)=0;
-        }
-    }
+    cv::Mat invalid_mask = (d_img>10000)|(d_img<200);
     cv::Mat adjMap;
     d_img.convertTo(adjMap,CV_8UC1, 255 / (10000.0), 0);
+    adjMap.setTo(0,invalid_mask);
     cv::applyColorMap(adjMap, visualized_depth, cv::COLORMAP_RAINBOW);
-    for(int i=0; i<size; i++)
-    {
-        if(d_img.at<ushort>(i)==0)
-        {
-            cv::Vec3b color = visualized_depth.at<cv::Vec3b>(i);
-            color[0]=0;
-            color[1]=0;
-            color[2]=0;
-            visualized_depth.at<cv::Vec3b>(i)=color;
-        }
-    }
+    visualized_depth.setTo(cv::Scalar(0,0,0),invalid_mask);
 }
 
 #endif // CVDRAW_H
@@ -0,0 +1,78 @@
+#ifndef FRAME_VISUALIZER_H
+#define FRAME_VISUALIZER_H
+
+#include <ros/ros.h>
+#include <image_transport/image_transport.h>
+#include <include/common.h>
+#include <include/camera_frame.h>
+#include <include/rviz_frame.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/* Debug visualization of the tracking nodelet on a low priority worker thread
+ *  //submit() (tracking thread) takes an immutable snapshot of the frame: landmarks,
+ *    pose and the images, only the products someone subscribes to are captured,
+ *    nothing at all if there is no subscriber
+ *  //Images that reference the input message are shared (the snapshot holds the message),
+ *    pooled buffers (colour conversion/rectification) are cloned, they are reused by later frames
+ *  //One slot mailbox, a snapshot not yet rendered is replaced by the newer one (dropped)
+ *  //Worker: drawFrame, depth colour map, cv_bridge, /vo_img0 /vo_img1, RVIZFrame markers
+ * */
+
+#define VIS_WORKER_NICE  (10)
+
+struct FrameSnapshot
+{
+  typedef std::shared_ptr<const FrameSnapshot> ConstPtr;
+  ros::Time stamp;
+  SE3       T_c_w;
+  double    solving_time;
+  double    reprojection_error;
+  //landmarks with depth
+  vector<Vec2>   lm_2d;
+  vector<double> lm_depth;
+  vector<Vec3>   lm_3d_w;
+  //empty if not subscribed
+  cv::Mat img0;
+  cv::Mat img1;
+  cv::Mat d_img;
+  boost::shared_ptr<const void> img_holder[2];
+  bool pub_img0;
+  bool pub_img1;
+  bool pub_markers;
+};
+
+class FrameVisualizer
+{
+public:
+  FrameVisualizer(ros::NodeHandle& nh,
+                  const TYPEOFCAMERA cam_type,
+                  const bool pub_images=true);
+  ~FrameVisualizer();
+
+  void submit(const CameraFrame& frame, const ros::Time& stamp);
+
+  uint64_t submitted(void) const {return submitted_cnt;}
+  uint64_t dropped(void)   const {return dropped_cnt;}
+
+private:
+  TYPEOFCAMERA cam_type;
+  bool         pub_images;
+  image_transport::Publisher img0_pub;
+  image_transport::Publisher img1_pub;
+  RVIZFrame*   frame_pub;
+
+  std::mutex              mtx;
+  std::condition_variable cv_pending;
+  FrameSnapshot::ConstPtr pending;
+  bool                    stopping;
+  uint64_t                submitted_cnt;
+  uint64_t                dropped_cnt;
+  std::thread             worker;
+
+  void workerLoop(void);
+  void render(const FrameSnapshot& snapshot);
+};
+
+#endif // FRAME_VISUALIZER_H
@@ -39,6 +39,8 @@ public:
                             const ros::Time stamp=ros::Time::now());
   void pubFramePoseT_c_w(const SE3 T_c_w,
                          const ros::Time stamp=ros::Time::now());
+  //pose and marker subscribers
+  uint32_t getNumSubscribers(void) const;
 
 };
 
@@ -15,6 +15,11 @@ RVIZFrame::RVIZFrame(ros::NodeHandle& nh,
 
 RVIZFrame::~RVIZFrame(){}
 
+uint32_t RVIZFrame::getNumSubscribers(void) const
+{
+  return pose_pub.getNumSubscribers()+marker_pub.getNumSubscribers();
+}
+
 //Trsnformation world to camera [R|t]
 void RVIZFrame::pubFramePoseT_c_w(const SE3 T_c_w,
                                   const ros::Time stamp)
@@ -45,7 +45,11 @@ void RVIZPath::pubPathT_w_c(const SE3 T_w_c, const ros::Time stamp)
     path.poses.erase(path.poses.begin());
   }
 
-  path_pub.publish(path);
+  //the path is kept anyway, only the message is skipped
+  if(path_pub.getNumSubscribers()>0)
+  {
+    path_pub.publish(path);
+  }
 }
 
 void RVIZPath::clearPath()